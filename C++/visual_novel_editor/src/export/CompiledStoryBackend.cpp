@@ -0,0 +1,152 @@
+#include "CompiledStoryBackend.h"
+
+#include <QHash>
+#include <QIODevice>
+#include <QList>
+#include <QString>
+#include <QtEndian>
+
+#include <cstring>
+#include <utility>
+
+#include "ExportIr.h"
+#include "runtime/StoryRuntimeFormat.h"
+
+using namespace StoryRuntimeFormat;
+
+namespace {
+class StringPool
+{
+public:
+    quint32 intern(const QString &value)
+    {
+        if (const auto it = m_indices.constFind(value); it != m_indices.cend()) {
+            return it.value();
+        }
+        const QByteArray utf8 = value.toUtf8();
+        const quint32 index = quint32(m_entries.size());
+        m_entries.append({quint32(m_bytes.size()), quint32(utf8.size())});
+        m_bytes += utf8;
+        m_indices.insert(value, index);
+        return index;
+    }
+
+    struct Entry {
+        quint32 offset;
+        quint32 size;
+    };
+
+    [[nodiscard]] const QList<Entry> &entries() const { return m_entries; }
+    [[nodiscard]] const QByteArray &bytes() const { return m_bytes; }
+
+private:
+    QHash<QString, quint32> m_indices;
+    QList<Entry> m_entries;
+    QByteArray m_bytes;
+};
+
+struct Instruction {
+    Opcode opcode;
+    quint32 a{0};
+    quint32 b{0};
+    quint32 c{0};
+};
+
+void appendUInt32(QByteArray &data, quint32 value)
+{
+    char bytes[4];
+    qToLittleEndian<quint32>(value, bytes);
+    data.append(bytes, sizeof(bytes));
+}
+
+void setUInt32(QByteArray &data, qsizetype offset, quint32 value)
+{
+    qToLittleEndian<quint32>(value, data.data() + offset);
+}
+}
+
+bool CompiledStoryBackend::write(const ExportIr &ir, QIODevice *device) const
+{
+    const QByteArray data = compile(ir);
+    return device->write(data) == data.size();
+}
+
+QByteArray CompiledStoryBackend::compile(const ExportIr &ir)
+{
+    const QList<ExportLabel> &labels = ir.labels();
+    QHash<ObjectId, quint32> labelIndices;
+    labelIndices.reserve(labels.size());
+    for (const ExportLabel &label : labels) {
+        labelIndices.insert(label.nodeId, quint32(labelIndices.size()));
+    }
+
+    StringPool strings;
+    QList<quint32> labelStarts;
+    QList<quint32> labelNames;
+    QList<Instruction> instructions;
+    labelStarts.reserve(labels.size());
+    labelNames.reserve(labels.size());
+    for (const ExportLabel &label : labels) {
+        labelStarts.append(quint32(instructions.size()));
+        labelNames.append(strings.intern(label.nodeId.toString()));
+        for (const RichText &line : label.lines) {
+            if (!line.text().isEmpty()) {
+                instructions.append({Opcode::Line, strings.intern(line.text())});
+            }
+        }
+        // A choice whose target is not in the story has nowhere to jump.
+        QList<const ExportChoice *> choices;
+        choices.reserve(label.choices.size());
+        for (const ExportChoice &choice : label.choices) {
+            if (labelIndices.contains(choice.targetNodeId)) {
+                choices.append(&choice);
+            }
+        }
+        if (choices.isEmpty()) {
+            instructions.append({Opcode::End});
+            continue;
+        }
+        instructions.append({Opcode::Menu, quint32(choices.size())});
+        for (const ExportChoice *choice : std::as_const(choices)) {
+            instructions.append({Opcode::Choice, strings.intern(choice->text), labelIndices.value(choice->targetNodeId),
+                                 choice->condition ? strings.intern(*choice->condition) : kNoString});
+        }
+    }
+
+    const qsizetype labelsOffset = kHeaderSize;
+    const qsizetype instructionsOffset = labelsOffset + labels.size() * kLabelSize;
+    const qsizetype stringsOffset = instructionsOffset + instructions.size() * kInstructionSize;
+    const qsizetype poolOffset = stringsOffset + strings.entries().size() * kStringSize;
+
+    QByteArray data(kHeaderSize, '\0');
+    data.reserve(poolOffset + strings.bytes().size());
+    std::memcpy(data.data(), kMagic, sizeof(kMagic));
+    qToLittleEndian<quint16>(kVersion, data.data() + 4);
+    setUInt32(data, kLabelCountOffset, quint32(labels.size()));
+    setUInt32(data, kEntryLabelOffset, 0);
+    setUInt32(data, kLabelsOffset, quint32(labelsOffset));
+    setUInt32(data, kInstructionCountOffset, quint32(instructions.size()));
+    setUInt32(data, kInstructionsOffset, quint32(instructionsOffset));
+    setUInt32(data, kStringCountOffset, quint32(strings.entries().size()));
+    setUInt32(data, kStringsOffset, quint32(stringsOffset));
+    setUInt32(data, kPoolSizeOffset, quint32(strings.bytes().size()));
+    setUInt32(data, kPoolOffset, quint32(poolOffset));
+
+    for (qsizetype i = 0; i < labels.size(); ++i) {
+        appendUInt32(data, labelStarts[i]);
+        appendUInt32(data, labelNames[i]);
+    }
+    for (const Instruction &instruction : std::as_const(instructions)) {
+        data.append(char(instruction.opcode));
+        data.append(3, '\0');
+        appendUInt32(data, instruction.a);
+        appendUInt32(data, instruction.b);
+        appendUInt32(data, instruction.c);
+    }
+    for (const StringPool::Entry &entry : strings.entries()) {
+        appendUInt32(data, entry.offset);
+        appendUInt32(data, entry.size);
+    }
+    data += strings.bytes();
+    return data;
+}
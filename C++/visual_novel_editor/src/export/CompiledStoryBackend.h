@@ -0,0 +1,18 @@
+#pragma once
+
+#include <QByteArray>
+
+#include "ExportBackend.h"
+
+// Compiles the story for StoryRuntime (see runtime/StoryRuntimeFormat.h).
+// Every label of the IR becomes one, entered at the first. Lines are stored
+// as plain text without their formatting and empty lines are dropped, as are
+// choices whose target is not a label of the IR.
+class CompiledStoryBackend : public ExportBackend
+{
+public:
+    [[nodiscard]] bool write(const ExportIr &ir, QIODevice *device) const override;
+    [[nodiscard]] bool isText() const override { return false; }
+
+    [[nodiscard]] static QByteArray compile(const ExportIr &ir);
+};
@@ -0,0 +1,55 @@
+#include "CsvBackend.h"
+
+#include <QIODevice>
+#include <QStringList>
+#include <QTextStream>
+
+#include <algorithm>
+
+#include "ExportIr.h"
+
+namespace {
+QString csvField(const QString &value)
+{
+    const auto needsQuotes = [](QChar c) {
+        return c == QLatin1Char(',') || c == QLatin1Char('"') || c == QLatin1Char('\n') || c == QLatin1Char('\r');
+    };
+    if (std::none_of(value.cbegin(), value.cend(), needsQuotes)) {
+        return value;
+    }
+    QString quoted = value;
+    quoted.replace(QLatin1Char('"'), QStringLiteral("\"\""));
+    return QLatin1Char('"') + quoted + QLatin1Char('"');
+}
+
+void writeRow(QTextStream &out, const QStringList &fields)
+{
+    for (qsizetype i = 0; i < fields.size(); ++i) {
+        if (i > 0) {
+            out << ',';
+        }
+        out << csvField(fields[i]);
+    }
+    out << '\n';
+}
+}
+
+bool CsvBackend::write(const ExportIr &ir, QIODevice *device) const
+{
+    QTextStream out(device);
+    out.setGenerateByteOrderMark(true);
+    writeRow(out, {QStringLiteral("label"), QStringLiteral("type"), QStringLiteral("index"), QStringLiteral("text")});
+    for (const ExportLabel &label : ir.labels()) {
+        const QString labelId = label.nodeId.toString();
+        int lineIndex = 0;
+        for (const RichText &line : label.lines) {
+            writeRow(out, {labelId, QStringLiteral("line"), QString::number(lineIndex++), line.text()});
+        }
+        int choiceIndex = 0;
+        for (const ExportChoice &choice : label.choices) {
+            writeRow(out, {labelId, QStringLiteral("choice"), QString::number(choiceIndex++), choice.text});
+        }
+    }
+    out.flush();
+    return out.status() == QTextStream::Ok;
+}
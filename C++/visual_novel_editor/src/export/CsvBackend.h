@@ -0,0 +1,14 @@
+#pragma once
+
+#include "ExportBackend.h"
+
+// A dialogue sheet for translators: one row per script line and per choice,
+// as label, type ("line" or "choice"), index within the label and text. Lines
+// are written as the script holds them, statements and all, so every line a
+// translation may touch has a row. UTF-8 with a byte order mark, which
+// spreadsheet applications need to detect it.
+class CsvBackend : public ExportBackend
+{
+public:
+    [[nodiscard]] bool write(const ExportIr &ir, QIODevice *device) const override;
+};
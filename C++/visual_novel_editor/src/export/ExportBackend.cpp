@@ -0,0 +1,21 @@
+#include "ExportBackend.h"
+
+#include <QSaveFile>
+#include <QtConcurrentMap>
+
+bool ExportBackend::writeAll(const ExportIr &ir, const QList<Target> &targets)
+{
+    const QList<bool> results = QtConcurrent::blockingMapped(targets, [&ir](const Target &target) {
+        QSaveFile file(target.fileName);
+        if (!target.backend) {
+            return false;
+        }
+        const QIODevice::OpenMode mode = target.backend->isText() ? QIODevice::WriteOnly | QIODevice::Text
+                                                                  : QIODevice::WriteOnly;
+        if (!file.open(mode)) {
+            return false;
+        }
+        return target.backend->write(ir, &file) && file.commit();
+    });
+    return !results.contains(false);
+}
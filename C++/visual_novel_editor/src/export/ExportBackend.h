@@ -0,0 +1,28 @@
+#pragma once
+
+#include <QList>
+#include <QString>
+
+class ExportIr;
+class QIODevice;
+
+// Turns an ExportIr into one output format. Backends keep no state while
+// writing, so one backend may write several outputs at once.
+class ExportBackend
+{
+public:
+    struct Target {
+        const ExportBackend *backend{nullptr};
+        QString fileName;
+    };
+
+    virtual ~ExportBackend() = default;
+
+    [[nodiscard]] virtual bool write(const ExportIr &ir, QIODevice *device) const = 0;
+    // Text outputs get the platform's line endings.
+    [[nodiscard]] virtual bool isText() const { return true; }
+
+    // Writes every target on its own pool thread, each file replaced only
+    // once it was written in full. Fails if any target failed.
+    [[nodiscard]] static bool writeAll(const ExportIr &ir, const QList<Target> &targets);
+};
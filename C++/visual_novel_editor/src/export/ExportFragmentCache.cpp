@@ -0,0 +1,94 @@
+#include "ExportFragmentCache.h"
+
+#include <QByteArray>
+#include <QByteArrayView>
+#include <QCborStreamReader>
+#include <QCborStreamWriter>
+#include <QFile>
+#include <QSaveFile>
+
+#include <utility>
+
+#include "model/CborUtils.h"
+
+namespace {
+constexpr char kMagic[] = {'V', 'N', 'E', 'C'};
+constexpr quint64 kVersion = 2;
+}
+
+QString ExportFragmentCache::cacheFileName(const QString &projectFileName)
+{
+    return projectFileName + QStringLiteral(".rpycache");
+}
+
+const QString *ExportFragmentCache::find(const ObjectId &nodeId, const QByteArray &key) const
+{
+    const auto it = m_fragments.constFind(nodeId);
+    if (it == m_fragments.cend() || it->key != key) {
+        return nullptr;
+    }
+    return &it->text;
+}
+
+void ExportFragmentCache::insert(const ObjectId &nodeId, QByteArray key, QString fragment)
+{
+    m_fragments.insert(nodeId, Fragment{std::move(key), std::move(fragment)});
+}
+
+void ExportFragmentCache::retain(const QSet<ObjectId> &written)
+{
+    m_fragments.removeIf([&written](const auto &it) { return !written.contains(it.key()); });
+}
+
+bool ExportFragmentCache::load(const QString &fileName)
+{
+    m_fragments.clear();
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+    const QByteArray data = file.readAll();
+    if (!data.startsWith(QByteArrayView(kMagic, sizeof(kMagic)))) {
+        return false;
+    }
+
+    // [version, [id, key, fragment]...]
+    QCborStreamReader cbor(data.mid(sizeof(kMagic)));
+    quint64 version = 0;
+    if (!enterCborArray(cbor) || !readCborUnsigned(cbor, version) || version != kVersion) {
+        return false;
+    }
+    QHash<ObjectId, Fragment> fragments;
+    while (cbor.hasNext()) {
+        ObjectId nodeId;
+        Fragment fragment;
+        if (!enterCborArray(cbor) || !readCborId(cbor, nodeId) || !readCborBytes(cbor, fragment.key)
+            || !readCborText(cbor, fragment.text) || !leaveCborArray(cbor)) {
+            return false;
+        }
+        fragments.insert(nodeId, std::move(fragment));
+    }
+    m_fragments = std::move(fragments);
+    return true;
+}
+
+bool ExportFragmentCache::save(const QString &fileName) const
+{
+    QSaveFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly)) {
+        return false;
+    }
+    file.write(kMagic, sizeof(kMagic));
+    QCborStreamWriter cbor(&file);
+    cbor.startArray();
+    cbor.append(kVersion);
+    for (auto it = m_fragments.cbegin(); it != m_fragments.cend(); ++it) {
+        cbor.startArray(3);
+        cbor.append(it.key().toString());
+        cbor.append(it->key);
+        cbor.append(it->text);
+        cbor.endArray();
+    }
+    cbor.endArray();
+    return file.commit();
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <QByteArray>
+#include <QHash>
+#include <QSet>
+#include <QString>
+#include <QtGlobal>
+
+#include "model/ObjectId.h"
+
+// Label blocks an export wrote, by node, each with the key of everything
+// the block was formatted from, a SHA-1 digest so that two different inputs
+// never share a block in practice. An export reuses a block whose key still
+// matches instead of formatting the node again. Kept for the session and,
+// optionally, in "<project>.rpycache" beside the project file.
+//
+// Lookups may run on several threads at once; insert() and everything that
+// changes the cache must not run concurrently with them.
+class ExportFragmentCache
+{
+public:
+    static QString cacheFileName(const QString &projectFileName);
+
+    [[nodiscard]] const QString *find(const ObjectId &nodeId, const QByteArray &key) const;
+    void insert(const ObjectId &nodeId, QByteArray key, QString fragment);
+    // Drops the blocks of nodes the last export did not write.
+    void retain(const QSet<ObjectId> &written);
+    void clear() { m_fragments.clear(); }
+    [[nodiscard]] qsizetype size() const { return m_fragments.size(); }
+
+    // A missing or unreadable file leaves the cache empty.
+    bool load(const QString &fileName);
+    bool save(const QString &fileName) const;
+
+private:
+    struct Fragment {
+        QByteArray key;
+        QString text;
+    };
+
+    QHash<ObjectId, Fragment> m_fragments;
+};
@@ -0,0 +1,64 @@
+#include "ExportIr.h"
+
+#include <QBitArray>
+#include <QtConcurrentMap>
+
+#include "ScriptFormatter.h"
+#include "model/StoryGraph.h"
+#include "model/StoryNode.h"
+
+ExportIr ExportIr::build(const ProjectSnapshot &snapshot, const QList<ObjectId> &selection)
+{
+    const StoryGraph graph(snapshot);
+    const QSet<ObjectId> selected(selection.cbegin(), selection.cend());
+    // Parsing scripts is most of the work and independent per node.
+    ExportIr ir;
+    ir.m_labels = QtConcurrent::blockingMapped(labelOrder(graph, selection), [&graph, &selected](int index) {
+        const StoryNode &node = graph.node(index);
+        return makeLabel(node, exportedChoices(node, selected));
+    });
+    return ir;
+}
+
+QList<int> ExportIr::labelOrder(const StoryGraph &graph, const QList<ObjectId> &selection)
+{
+    QList<int> starts;
+    QBitArray mask;
+    if (!selection.isEmpty()) {
+        mask.resize(int(graph.size()));
+        for (const ObjectId &nodeId : selection) {
+            if (const int index = graph.indexOf(nodeId); index >= 0) {
+                starts.append(index);
+                mask.setBit(index);
+            }
+        }
+    } else if (graph.size() > 0) {
+        starts.append(0);
+    }
+    return graph.traverse(starts, StoryGraph::Order::DepthFirst, mask);
+}
+
+QList<Choice> ExportIr::exportedChoices(const StoryNode &node, const QSet<ObjectId> &selection)
+{
+    QList<Choice> result;
+    result.reserve(node.choices().size());
+    for (const Choice &choice : node.choices()) {
+        if (selection.isEmpty() || selection.contains(choice.targetNodeId)) {
+            result.append(choice);
+        }
+    }
+    return result;
+}
+
+ExportLabel ExportIr::makeLabel(const StoryNode &node, const QList<Choice> &choices)
+{
+    ExportLabel label;
+    label.nodeId = node.id();
+    label.title = node.title();
+    label.lines = ScriptFormatter::lines(RichText::fromScript(node.script()));
+    label.choices.reserve(choices.size());
+    for (const Choice &choice : choices) {
+        label.choices.append({choice.text, choice.condition, choice.targetNodeId});
+    }
+    return label;
+}
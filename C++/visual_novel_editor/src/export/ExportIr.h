@@ -0,0 +1,55 @@
+#pragma once
+
+#include <QList>
+#include <QSet>
+#include <QString>
+
+#include <optional>
+
+#include "model/Choice.h"
+#include "model/ObjectId.h"
+#include "model/ProjectSnapshot.h"
+#include "model/RichText.h"
+
+class StoryGraph;
+
+struct ExportChoice {
+    QString text;
+    std::optional<QString> condition;
+    ObjectId targetNodeId;
+};
+
+struct ExportLabel {
+    ObjectId nodeId;
+    QString title;
+    // Trimmed, as ScriptFormatter::lines() splits them.
+    QList<RichText> lines;
+    // Only choices leading to labels of the same export.
+    QList<ExportChoice> choices;
+};
+
+// The story as export backends see it: labels in the order they are
+// written, with scripts parsed and split into lines once. Backends read it
+// from any number of threads.
+class ExportIr
+{
+public:
+    ExportIr() = default;
+
+    // Without a selection, the nodes reachable from the one with the
+    // smallest id; otherwise the selected nodes, walked from each in turn.
+    [[nodiscard]] static ExportIr build(const ProjectSnapshot &snapshot, const QList<ObjectId> &selection = {});
+
+    [[nodiscard]] const QList<ExportLabel> &labels() const { return m_labels; }
+
+    // The steps of build(), for exporters that make labels one at a time.
+    // A node is written where a depth-first walk first reaches it, so its
+    // targets follow it before its siblings' targets do.
+    [[nodiscard]] static QList<int> labelOrder(const StoryGraph &graph, const QList<ObjectId> &selection);
+    // An empty selection keeps every choice.
+    [[nodiscard]] static QList<Choice> exportedChoices(const StoryNode &node, const QSet<ObjectId> &selection);
+    [[nodiscard]] static ExportLabel makeLabel(const StoryNode &node, const QList<Choice> &choices);
+
+private:
+    QList<ExportLabel> m_labels;
+};
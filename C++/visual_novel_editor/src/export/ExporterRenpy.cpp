@@ -1,30 +1,95 @@
 #include "ExporterRenpy.h"
 
+#include <QBitArray>
+#include <QByteArray>
+#include <QByteArrayView>
+#include <QCryptographicHash>
+#include <QDir>
 #include <QFile>
+#include <QFileInfo>
+#include <QHash>
 #include <QList>
+#include <QSaveFile>
+#include <QSet>
 #include <QStringList>
-#include <QTextDocument>
+#include <QStringView>
 #include <QTextStream>
 #include <Qt>
+#include <QtConcurrentMap>
 #include <QtGlobal>
 
-#include "ScriptFormatter.h"
+#include <algorithm>
+#include <utility>
+
+#include "ExportFragmentCache.h"
+#include "ExportIr.h"
+#include "RenpyBackend.h"
 #include "model/Choice.h"
-#include "model/Project.h"
+#include "model/StoryGraph.h"
 #include "model/StoryNode.h"
 
-ExporterRenpy::ExporterRenpy(Project *project)
-    : m_project(project)
+namespace {
+constexpr QLatin1String kChapterPrefix("chapter_");
+// Lists the chapter files the last export wrote, one name per line; only
+// those are ever removed, so hand-written files next to them are safe.
+constexpr QLatin1String kManifestName(".chapter_files");
+constexpr qsizetype kFormatChunkSize = 1024;
+// Part of every fragment key; bump it when RenpyBackend::formatLabel()
+// writes differently.
+constexpr quint64 kFragmentFormat = 2;
+
+// Length first, so adjacent strings cannot trade characters.
+void addField(QCryptographicHash &hash, QStringView text)
 {
+    const quint64 size = quint64(text.size());
+    hash.addData(QByteArrayView(reinterpret_cast<const char *>(&size), sizeof(size)));
+    hash.addData(QByteArrayView(reinterpret_cast<const char *>(text.data()), text.size() * sizeof(QChar)));
 }
 
-void ExporterRenpy::setSelectedNodeIds(const QStringList &nodeIds)
+// A cache hit is trusted as it is, so the key is a cryptographic digest
+// rather than a short hash: a collision would put another node's code in the
+// output. Titles are left out because RenpyBackend does not write them, and
+// the node id because the cache is looked up by it.
+QByteArray fragmentKey(const StoryNode &node, const QList<Choice> &choices)
+{
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    addField(hash, QString::number(kFragmentFormat));
+    addField(hash, node.script());
+    addField(hash, QString::number(choices.size()));
+    for (const Choice &choice : choices) {
+        addField(hash, choice.text);
+        addField(hash, choice.targetNodeId.toString());
+        addField(hash, choice.condition ? QStringLiteral("1") : QStringLiteral("0"));
+        addField(hash, choice.condition.value_or(QString()));
+    }
+    return hash.result();
+}
+
+// Ids read from project files may hold any text.
+QString fileNamePart(const QString &id)
+{
+    QString result = id;
+    for (QChar &c : result) {
+        if (!c.isLetterOrNumber() && c != QLatin1Char('-') && c != QLatin1Char('_')) {
+            c = QLatin1Char('_');
+        }
+    }
+    return result;
+}
+}
+
+ExporterRenpy::ExporterRenpy(ProjectSnapshot snapshot)
+    : m_snapshot(std::move(snapshot))
+{
+}
+
+void ExporterRenpy::setSelectedNodeIds(const QList<ObjectId> &nodeIds)
 {
     m_selectionOrder.clear();
     m_selectedNodeIds.clear();
 
-    for (const QString &id : nodeIds) {
-        if (id.isEmpty() || m_selectedNodeIds.contains(id)) {
+    for (const ObjectId &id : nodeIds) {
+        if (id.isNull() || m_selectedNodeIds.contains(id)) {
             continue;
         }
         m_selectionOrder.append(id);
@@ -34,53 +99,122 @@ void ExporterRenpy::setSelectedNodeIds(const QStringList &nodeIds)
 
 bool ExporterRenpy::exportToFile(const QString &fileName)
 {
-    if (!m_project) {
-        return false;
-    }
-
     QFile file(fileName);
     if (!file.open(QIODevice::WriteOnly | QIODevice::Text)) {
         return false;
     }
 
     QTextStream out(&file);
-    out << "# Generated by Visual Novel Editor\n\n";
+    out << RenpyBackend::kFileHeader;
 
-    const QStringList order = exportOrder();
+    const StoryGraph graph(m_snapshot);
+    return writeBlocks(graph, ExportIr::labelOrder(graph, m_selectionOrder), [&out](qsizetype, const QString &block) { out << block; });
+}
 
-    if (order.isEmpty()) {
-        reportProgress();
-        return true;
+bool ExporterRenpy::exportToDirectory(const QString &directory)
+{
+    m_writtenFiles = 0;
+    m_unchangedFiles = 0;
+    QDir dir(directory);
+    if (!dir.mkpath(QStringLiteral("."))) {
+        return false;
     }
 
-    m_visited.clear();
-    m_processedNodes = 0;
-    m_wasCanceled = false;
-    if (hasSelection()) {
-        m_totalNodes = m_selectedNodeIds.size();
-    } else {
-        m_totalNodes = countReachableNodes(order.front());
-        if (m_totalNodes == 0) {
-            m_totalNodes = m_project->nodes().size();
+    const StoryGraph graph(m_snapshot);
+    const QList<int> order = ExportIr::labelOrder(graph, m_selectionOrder);
+    QList<ChapterFile> files;
+    const QList<int> fileOfLabel = partition(graph, order, files);
+    for (ChapterFile &file : files) {
+        file.path = dir.filePath(file.path);
+        file.contents = QString::fromLatin1(RenpyBackend::kFileHeader);
+    }
+    if (!writeBlocks(graph, order, [&files, &fileOfLabel](qsizetype position, const QString &block) {
+            files[fileOfLabel[position]].contents += block;
+        })) {
+        return false;
+    }
+
+    const QList<FileWrite> results = QtConcurrent::blockingMapped(files, &ExporterRenpy::writeIfChanged);
+    bool succeeded = true;
+    for (FileWrite result : results) {
+        succeeded = succeeded && result != FileWrite::Failed;
+        m_writtenFiles += result == FileWrite::Written ? 1 : 0;
+        m_unchangedFiles += result == FileWrite::Unchanged ? 1 : 0;
+    }
+
+    // Labels of files this export did not write would be defined twice, and
+    // Ren'Py loads a compiled file even when its source is gone.
+    QSet<QString> current;
+    for (const ChapterFile &file : std::as_const(files)) {
+        current.insert(QFileInfo(file.path).fileName());
+    }
+    QStringList manifest(current.cbegin(), current.cend());
+    for (const QString &name : readManifest(dir)) {
+        if (current.contains(name)) {
+            continue;
+        }
+        const QString compiled = name + QLatin1Char('c');
+        const bool removed = (!dir.exists(name) || dir.remove(name)) && (!dir.exists(compiled) || dir.remove(compiled));
+        if (!removed) {
+            // Kept in the manifest so the next export tries again.
+            manifest.append(name);
+            succeeded = false;
         }
     }
+    manifest.sort();
+    succeeded = writeManifest(dir, manifest) && succeeded;
+    return succeeded;
+}
+
+void ExporterRenpy::setMaxLabelsPerFile(int count)
+{
+    m_maxLabelsPerFile = qMax(0, count);
+}
+
+bool ExporterRenpy::writeBlocks(const StoryGraph &graph, const QList<int> &order,
+                                const std::function<void(qsizetype, const QString &)> &write)
+{
+    m_processedNodes = 0;
+    m_formattedNodes = 0;
+    m_wasCanceled = false;
+    m_totalNodes = int(order.size());
     if (!reportProgress()) {
         m_wasCanceled = true;
         return false;
     }
 
-    if (hasSelection()) {
-        for (const QString &nodeId : order) {
-            if (!generateNode(nodeId, out, 0)) {
-                return false;
+    QSet<ObjectId> written;
+    // Blocks are formatted a chunk at a time so memory stays bounded and
+    // progress and cancellation are handled here, between chunks.
+    for (qsizetype first = 0; first < order.size(); first += kFormatChunkSize) {
+        const QList<int> chunk = order.mid(first, kFormatChunkSize);
+        const QList<Block> blocks = QtConcurrent::blockingMapped(
+            chunk, [this, &graph](int index) { return formatBlock(graph.node(index)); });
+        for (qsizetype i = 0; i < blocks.size(); ++i) {
+            const Block &block = blocks[i];
+            write(first + i, block.text);
+            if (!block.reused) {
+                ++m_formattedNodes;
+            }
+            if (m_fragmentCache) {
+                const ObjectId nodeId = graph.node(chunk[i]).id();
+                if (!block.reused) {
+                    m_fragmentCache->insert(nodeId, block.key, block.text);
+                }
+                written.insert(nodeId);
             }
         }
-    } else {
-        if (!generateNode(order.front(), out, 0)) {
+        m_processedNodes += int(chunk.size());
+        if (!reportProgress()) {
+            m_wasCanceled = true;
             return false;
         }
     }
 
+    if (m_fragmentCache) {
+        m_fragmentCache->retain(written);
+    }
+
     if (m_processedNodes < m_totalNodes) {
         m_processedNodes = m_totalNodes;
         reportProgress();
@@ -89,125 +223,139 @@ bool ExporterRenpy::exportToFile(const QString &fileName)
     return !m_wasCanceled;
 }
 
+void ExporterRenpy::setFragmentCache(ExportFragmentCache *cache)
+{
+    m_fragmentCache = cache;
+}
+
 void ExporterRenpy::setProgressCallback(std::function<bool(int, int)> callback)
 {
     m_progressCallback = std::move(callback);
 }
 
-bool ExporterRenpy::generateNode(const QString &nodeId, QTextStream &out, int indent)
+QList<int> ExporterRenpy::partition(const StoryGraph &graph, const QList<int> &order, QList<ChapterFile> &files) const
 {
-    if (nodeId.isEmpty() || m_visited.contains(nodeId)) {
-        return true;
+    // Connected parts of the story never jump into each other, so they get
+    // files of their own, split further at the label cap. Files are named
+    // after their first label, which keeps names stable while other parts
+    // of the story change.
+    QBitArray mask(int(graph.size()));
+    for (int index : order) {
+        mask.setBit(index);
     }
-
-    if (hasSelection() && !m_selectedNodeIds.contains(nodeId)) {
-        return true;
-    }
-
-    m_visited.insert(nodeId);
-    StoryNode *node = m_project->getNode(nodeId);
-    if (!node) {
-        return true;
-    }
-
-    out << "label " << nodeId << ":\n";
-
-    QTextDocument document;
-    const QString script = node->script();
-    if (Qt::mightBeRichText(script)) {
-        document.setHtml(script);
-    } else {
-        document.setPlainText(script);
-    }
-    const QStringList lines = document.toPlainText().split('\n');
-    for (const QString &line : lines) {
-        out << ScriptFormatter::indent(indent + 4) << line.trimmed() << '\n';
-    }
-
-    QList<Choice> exportedChoices;
-    exportedChoices.reserve(node->choices().size());
-    for (const Choice &choice : node->choices()) {
-        if (!hasSelection() || m_selectedNodeIds.contains(choice.targetNodeId)) {
-            exportedChoices.append(choice);
+    const QList<int> components = graph.components(mask);
+    QHash<int, QList<qsizetype>> positionsByComponent;
+    QList<int> componentOrder;
+    for (qsizetype position = 0; position < order.size(); ++position) {
+        const int component = components[order[position]];
+        auto it = positionsByComponent.find(component);
+        if (it == positionsByComponent.end()) {
+            componentOrder.append(component);
+            it = positionsByComponent.insert(component, {});
         }
+        it->append(position);
     }
 
-    if (!exportedChoices.isEmpty()) {
-        out << ScriptFormatter::indent(indent + 4) << "menu:\n";
-        for (const Choice &choice : exportedChoices) {
-            out << ScriptFormatter::indent(indent + 8);
-            if (choice.condition.has_value()) {
-                out << "if " << choice.condition.value() << ": ";
+    QList<int> fileOfLabel(order.size());
+    // Checked against final file names, so a split part such as a_2 cannot
+    // meet a story that starts at a node named a_2.
+    QSet<QString> names;
+    for (int component : std::as_const(componentOrder)) {
+        const QList<qsizetype> &positions = positionsByComponent[component];
+        const qsizetype perFile = m_maxLabelsPerFile > 0 ? m_maxLabelsPerFile : positions.size();
+        const qsizetype parts = (positions.size() + perFile - 1) / perFile;
+        QString baseName = QString(kChapterPrefix) + fileNamePart(graph.node(order[positions.front()]).id().toString());
+        QStringList partNames;
+        for (;;) {
+            partNames.clear();
+            for (qsizetype part = 0; part < parts; ++part) {
+                partNames.append((parts == 1 ? baseName : baseName + QStringLiteral("_%1").arg(part + 1))
+                                 + QStringLiteral(".rpy"));
+            }
+            if (std::none_of(partNames.cbegin(), partNames.cend(),
+                             [&names](const QString &name) { return names.contains(name); })) {
+                break;
             }
-            out << '"' << choice.text << '"' << ":\n";
-            out << ScriptFormatter::indent(indent + 12) << "jump " << choice.targetNodeId << '\n';
+            baseName += QLatin1Char('_');
+        }
+        for (qsizetype part = 0; part < parts; ++part) {
+            ChapterFile file;
+            file.path = partNames[part];
+            names.insert(file.path);
+            for (qsizetype i = part * perFile; i < qMin(positions.size(), (part + 1) * perFile); ++i) {
+                fileOfLabel[positions[i]] = int(files.size());
+            }
+            files.append(file);
         }
-    } else {
-        out << ScriptFormatter::indent(indent + 4) << "# TODO: define next action\n";
     }
+    return fileOfLabel;
+}
 
-    out << '\n';
-
-    ++m_processedNodes;
-    if (!reportProgress()) {
-        m_wasCanceled = true;
-        return false;
+QStringList ExporterRenpy::readManifest(const QDir &dir)
+{
+    QFile file(dir.filePath(kManifestName));
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        return {};
     }
-
-    for (const Choice &choice : exportedChoices) {
-        if (!generateNode(choice.targetNodeId, out, indent)) {
-            return false;
+    QStringList names;
+    const QStringList lines = QString::fromUtf8(file.readAll()).split(QLatin1Char('\n'), Qt::SkipEmptyParts);
+    for (const QString &line : lines) {
+        // Anything but a plain chapter file name means the manifest was
+        // edited by hand; such entries are never deleted.
+        if (line.startsWith(kChapterPrefix) && line.endsWith(QStringLiteral(".rpy"))
+            && QFileInfo(line).fileName() == line) {
+            names.append(line);
         }
     }
-
-    return true;
+    return names;
 }
 
-bool ExporterRenpy::reportProgress() const
+bool ExporterRenpy::writeManifest(const QDir &dir, const QStringList &names)
 {
-    if (!m_progressCallback) {
-        return true;
+    const QByteArray data = names.isEmpty() ? QByteArray() : (names.join(QLatin1Char('\n')) + QLatin1Char('\n')).toUtf8();
+    QSaveFile output(dir.filePath(kManifestName));
+    if (!output.open(QIODevice::WriteOnly | QIODevice::Text) || output.write(data) != data.size()) {
+        return false;
     }
-
-    const int total = m_totalNodes <= 0 ? m_project->nodes().size() : m_totalNodes;
-    const int processed = qMin(m_processedNodes, total);
-    return m_progressCallback(processed, total > 0 ? total : 0);
+    return output.commit();
 }
 
-int ExporterRenpy::countReachableNodes(const QString &startId) const
+ExporterRenpy::FileWrite ExporterRenpy::writeIfChanged(const ChapterFile &file)
 {
-    if (!m_project || startId.isEmpty()) {
-        return 0;
+    const QByteArray data = file.contents.toUtf8();
+    QFile existing(file.path);
+    if (existing.open(QIODevice::ReadOnly | QIODevice::Text) && existing.readAll() == data) {
+        return FileWrite::Unchanged;
     }
+    existing.close();
 
-    const Project *project = m_project;
-    QSet<QString> visited;
-    QList<QString> toVisit;
-    toVisit.append(startId);
-
-    while (!toVisit.isEmpty()) {
-        const QString current = toVisit.takeFirst();
-        if (current.isEmpty() || visited.contains(current)) {
-            continue;
-        }
-        visited.insert(current);
-
-        const StoryNode *node = project->getNode(current);
-        if (!node) {
-            continue;
-        }
-        for (const Choice &choice : node->choices()) {
-            toVisit.append(choice.targetNodeId);
-        }
+    QSaveFile output(file.path);
+    if (!output.open(QIODevice::WriteOnly | QIODevice::Text) || output.write(data) != data.size()) {
+        return FileWrite::Failed;
     }
+    return output.commit() ? FileWrite::Written : FileWrite::Failed;
+}
 
-    return visited.size();
+ExporterRenpy::Block ExporterRenpy::formatBlock(const StoryNode &node) const
+{
+    const QList<Choice> choices = ExportIr::exportedChoices(node, m_selectedNodeIds);
+    if (!m_fragmentCache) {
+        return {{}, RenpyBackend::formatLabel(ExportIr::makeLabel(node, choices)), false};
+    }
+    const QByteArray key = fragmentKey(node, choices);
+    if (const QString *cached = m_fragmentCache->find(node.id(), key)) {
+        return {key, *cached, true};
+    }
+    return {key, RenpyBackend::formatLabel(ExportIr::makeLabel(node, choices)), false};
 }
 
-QStringList ExporterRenpy::exportOrder() const
+bool ExporterRenpy::reportProgress() const
 {
-    if (hasSelection()) {
-        return m_selectionOrder;
+    if (!m_progressCallback) {
+        return true;
     }
-    return m_project ? m_project->nodes().keys() : QStringList{};
+
+    const int total = m_totalNodes <= 0 ? int(m_snapshot.size()) : m_totalNodes;
+    const int processed = qMin(m_processedNodes, total);
+    return m_progressCallback(processed, total > 0 ? total : 0);
 }
@@ -1,37 +1,94 @@
 #pragma once
 
+#include <QByteArray>
+#include <QList>
 #include <QSet>
 #include <QString>
 #include <QStringList>
-#include <QTextStream>
 
 #include <functional>
 
-class Project;
+#include "model/ObjectId.h"
+#include "model/ProjectSnapshot.h"
 
+class ExportFragmentCache;
+class QDir;
+class StoryGraph;
+
+// Works on a snapshot, so an export may run on any thread while the project
+// keeps being edited. Node blocks are built as ExportIr labels and formatted
+// by RenpyBackend in parallel on the global thread pool, then written in
+// traversal order. Unlike ExportIr::build(), labels are made one chunk at a
+// time and only for nodes the fragment cache has no block for.
 class ExporterRenpy
 {
 public:
-    explicit ExporterRenpy(Project *project);
+    explicit ExporterRenpy(ProjectSnapshot snapshot);
 
     [[nodiscard]] bool exportToFile(const QString &fileName);
+    // Writes each connected part of the story to "chapter_<first label>.rpy"
+    // in directory, split into numbered files past the label cap. Files
+    // whose contents did not change are not touched. Chapter files the
+    // previous export wrote and this one did not are removed with their
+    // .rpyc; the names are kept in a manifest in directory, so other files
+    // are never deleted.
+    [[nodiscard]] bool exportToDirectory(const QString &directory);
+    // Zero, the default, puts no cap on the labels of a chapter file.
+    void setMaxLabelsPerFile(int count);
+    [[nodiscard]] int writtenFiles() const { return m_writtenFiles; }
+    [[nodiscard]] int unchangedFiles() const { return m_unchangedFiles; }
+    // Called on the exporting thread as formatted nodes are written;
+    // returning false cancels.
     void setProgressCallback(std::function<bool(int, int)> callback);
     [[nodiscard]] bool wasCanceled() const { return m_wasCanceled; }
-    void setSelectedNodeIds(const QStringList &nodeIds);
+    void setSelectedNodeIds(const QList<ObjectId> &nodeIds);
+    // Reuses the blocks of nodes that did not change since the cache was
+    // filled and leaves the cache holding the blocks of this export. The
+    // cache must outlive the export and not be used by anything else during
+    // it.
+    void setFragmentCache(ExportFragmentCache *cache);
+    // Nodes the last export formatted rather than took from the cache.
+    [[nodiscard]] int formattedNodes() const { return m_formattedNodes; }
 
 private:
-    bool generateNode(const QString &nodeId, QTextStream &out, int indent = 0);
+    struct ChapterFile {
+        QString path;
+        QString contents;
+    };
+    enum class FileWrite { Written, Unchanged, Failed };
+
+    struct Block {
+        QByteArray key;
+        QString text;
+        bool reused{false};
+    };
+
+    // Returns the file of each label in order and fills files with their
+    // names.
+    [[nodiscard]] QList<int> partition(const StoryGraph &graph, const QList<int> &order,
+                                       QList<ChapterFile> &files) const;
+    // Chapter file names from the manifest in dir, empty when there is none.
+    [[nodiscard]] static QStringList readManifest(const QDir &dir);
+    [[nodiscard]] static bool writeManifest(const QDir &dir, const QStringList &names);
+    [[nodiscard]] static FileWrite writeIfChanged(const ChapterFile &file);
+    // Formats the blocks of order and hands them to write by position.
+    [[nodiscard]] bool writeBlocks(const StoryGraph &graph, const QList<int> &order,
+                                   const std::function<void(qsizetype, const QString &)> &write);
+    // Safe to call from several threads at once.
+    [[nodiscard]] Block formatBlock(const StoryNode &node) const;
     [[nodiscard]] bool reportProgress() const;
-    [[nodiscard]] int countReachableNodes(const QString &startId) const;
-    [[nodiscard]] QStringList exportOrder() const;
     [[nodiscard]] bool hasSelection() const { return !m_selectedNodeIds.isEmpty(); }
 
-    Project *m_project{nullptr};
-    QSet<QString> m_visited;
+    ProjectSnapshot m_snapshot;
     std::function<bool(int, int)> m_progressCallback;
     int m_totalNodes{0};
     int m_processedNodes{0};
+    int m_formattedNodes{0};
+    int m_maxLabelsPerFile{0};
+    int m_writtenFiles{0};
+    int m_unchangedFiles{0};
+    ExportFragmentCache *m_fragmentCache{nullptr};
     bool m_wasCanceled{false};
-    QSet<QString> m_selectedNodeIds;
-    QStringList m_selectionOrder;
+    QSet<ObjectId> m_selectedNodeIds;
+    QList<ObjectId> m_selectionOrder;
 };
@@ -0,0 +1,97 @@
+#include "JsonBackend.h"
+
+#include <QColor>
+#include <QJsonDocument>
+
+#include "ExportIr.h"
+#include "model/JsonStreamWriter.h"
+
+namespace {
+void writeRun(JsonStreamWriter &json, const TextRun &run)
+{
+    json.beginObject();
+    json.writeName(QStringLiteral("start"));
+    json.writeNumber(double(run.start));
+    json.writeName(QStringLiteral("length"));
+    json.writeNumber(double(run.length));
+    if (run.flags & TextRun::Bold) {
+        json.writeName(QStringLiteral("bold"));
+        json.writeBool(true);
+    }
+    if (run.flags & TextRun::Italic) {
+        json.writeName(QStringLiteral("italic"));
+        json.writeBool(true);
+    }
+    if (run.flags & TextRun::Underline) {
+        json.writeName(QStringLiteral("underline"));
+        json.writeBool(true);
+    }
+    if (run.pointSize > 0) {
+        json.writeName(QStringLiteral("size"));
+        json.writeNumber(run.pointSize);
+    }
+    if (run.color != 0) {
+        json.writeName(QStringLiteral("color"));
+        json.writeString(QColor(run.color).name());
+    }
+    json.endObject();
+}
+
+void writeLabel(JsonStreamWriter &json, const ExportLabel &label)
+{
+    json.beginObject();
+    json.writeName(QStringLiteral("id"));
+    json.writeString(label.nodeId.toString());
+    json.writeName(QStringLiteral("title"));
+    json.writeString(label.title);
+
+    json.writeName(QStringLiteral("lines"));
+    json.beginArray();
+    for (const RichText &line : label.lines) {
+        json.beginObject();
+        json.writeName(QStringLiteral("text"));
+        json.writeString(line.text());
+        if (!line.isPlain()) {
+            json.writeName(QStringLiteral("runs"));
+            json.beginArray();
+            for (const TextRun &run : line.runs()) {
+                writeRun(json, run);
+            }
+            json.endArray();
+        }
+        json.endObject();
+    }
+    json.endArray();
+
+    json.writeName(QStringLiteral("choices"));
+    json.beginArray();
+    for (const ExportChoice &choice : label.choices) {
+        json.beginObject();
+        json.writeName(QStringLiteral("text"));
+        json.writeString(choice.text);
+        if (choice.condition.has_value()) {
+            json.writeName(QStringLiteral("condition"));
+            json.writeString(choice.condition.value());
+        }
+        json.writeName(QStringLiteral("target"));
+        json.writeString(choice.targetNodeId.toString());
+        json.endObject();
+    }
+    json.endArray();
+    json.endObject();
+}
+}
+
+bool JsonBackend::write(const ExportIr &ir, QIODevice *device) const
+{
+    JsonStreamWriter json(device, QJsonDocument::Compact);
+    json.beginObject();
+    json.writeName(QStringLiteral("labels"));
+    json.beginArray();
+    for (const ExportLabel &label : ir.labels()) {
+        writeLabel(json, label);
+    }
+    json.endArray();
+    json.endObject();
+    return json.flush() && !json.hasError();
+}
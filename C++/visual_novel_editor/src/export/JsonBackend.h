@@ -0,0 +1,12 @@
+#pragma once
+
+#include "ExportBackend.h"
+
+// The story as JSON for the web player: {"labels": [...]}, each label with
+// its id, title, lines and choices. Lines hold plain text and, when
+// formatted, runs with the set attributes only.
+class JsonBackend : public ExportBackend
+{
+public:
+    [[nodiscard]] bool write(const ExportIr &ir, QIODevice *device) const override;
+};
@@ -0,0 +1,50 @@
+#include "RenpyBackend.h"
+
+#include <QIODevice>
+#include <QTextStream>
+
+#include "ExportIr.h"
+#include "ScriptFormatter.h"
+
+const char RenpyBackend::kFileHeader[] = "# Generated by Visual Novel Editor\n\n";
+
+bool RenpyBackend::write(const ExportIr &ir, QIODevice *device) const
+{
+    QTextStream out(device);
+    out << kFileHeader;
+    for (const ExportLabel &label : ir.labels()) {
+        out << formatLabel(label);
+    }
+    out.flush();
+    return out.status() == QTextStream::Ok;
+}
+
+QString RenpyBackend::formatLabel(const ExportLabel &label)
+{
+    QString block;
+    QTextStream out(&block);
+
+    out << "label " << label.nodeId.toString() << ":\n";
+
+    for (const RichText &line : label.lines) {
+        out << ScriptFormatter::indent(4) << ScriptFormatter::renpyText(line) << '\n';
+    }
+
+    if (!label.choices.isEmpty()) {
+        out << ScriptFormatter::indent(4) << "menu:\n";
+        for (const ExportChoice &choice : label.choices) {
+            out << ScriptFormatter::indent(8);
+            if (choice.condition.has_value()) {
+                out << "if " << choice.condition.value() << ": ";
+            }
+            out << '"' << choice.text << '"' << ":\n";
+            out << ScriptFormatter::indent(12) << "jump " << choice.targetNodeId.toString() << '\n';
+        }
+    } else {
+        out << ScriptFormatter::indent(4) << "# TODO: define next action\n";
+    }
+
+    out << '\n';
+    out.flush();
+    return block;
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <QString>
+
+#include "ExportBackend.h"
+
+struct ExportLabel;
+
+// A single Ren'Py script, as ExporterRenpy writes it.
+class RenpyBackend : public ExportBackend
+{
+public:
+    static const char kFileHeader[];
+
+    [[nodiscard]] bool write(const ExportIr &ir, QIODevice *device) const override;
+
+    // The label, its lines and its menu, followed by a blank line.
+    [[nodiscard]] static QString formatLabel(const ExportLabel &label);
+};
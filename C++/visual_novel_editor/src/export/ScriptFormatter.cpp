@@ -1,5 +1,91 @@
 #include "ScriptFormatter.h"
 
+#include <QColor>
+#include <QStringView>
+
+#include <utility>
+
+#include "model/RichText.h"
+
+namespace {
+bool isLineBreak(QChar c)
+{
+    return c == QLatin1Char('\n') || c == QChar::LineSeparator || c == QChar::ParagraphSeparator;
+}
+
+// Non-breaking spaces become plain ones.
+void appendText(QString &line, const QString &text, qsizetype from, qsizetype to)
+{
+    for (qsizetype i = from; i < to; ++i) {
+        line += text[i] == QChar::Nbsp ? QChar(QLatin1Char(' ')) : text[i];
+    }
+}
+
+// Contents of the string literals of a statement, without the quotes. Ren'Py
+// reads text tags only there.
+QList<std::pair<qsizetype, qsizetype>> stringLiterals(QStringView text)
+{
+    QList<std::pair<qsizetype, qsizetype>> result;
+    QChar quote;
+    qsizetype start = 0;
+    for (qsizetype i = 0; i < text.size(); ++i) {
+        const QChar c = text[i];
+        if (quote.isNull()) {
+            if (c == QLatin1Char('"') || c == QLatin1Char('\'')) {
+                quote = c;
+                start = i + 1;
+            } else if (c == QLatin1Char('#')) {
+                break;
+            }
+        } else if (c == QLatin1Char('\\')) {
+            ++i;
+        } else if (c == quote) {
+            result.append({start, i});
+            quote = QChar();
+        }
+    }
+    return result;
+}
+
+void appendOpenTags(QString &line, const TextRun &run)
+{
+    if (run.flags & TextRun::Bold) {
+        line += QStringLiteral("{b}");
+    }
+    if (run.flags & TextRun::Italic) {
+        line += QStringLiteral("{i}");
+    }
+    if (run.flags & TextRun::Underline) {
+        line += QStringLiteral("{u}");
+    }
+    if (run.pointSize > 0) {
+        line += QStringLiteral("{size=%1}").arg(run.pointSize);
+    }
+    if (run.color != 0) {
+        line += QStringLiteral("{color=%1}").arg(QColor(run.color).name());
+    }
+}
+
+void appendCloseTags(QString &line, const TextRun &run)
+{
+    if (run.color != 0) {
+        line += QStringLiteral("{/color}");
+    }
+    if (run.pointSize > 0) {
+        line += QStringLiteral("{/size}");
+    }
+    if (run.flags & TextRun::Underline) {
+        line += QStringLiteral("{/u}");
+    }
+    if (run.flags & TextRun::Italic) {
+        line += QStringLiteral("{/i}");
+    }
+    if (run.flags & TextRun::Bold) {
+        line += QStringLiteral("{/b}");
+    }
+}
+}
+
 QString ScriptFormatter::indent(int spaces)
 {
     if (spaces <= 0) {
@@ -7,3 +93,89 @@ QString ScriptFormatter::indent(int spaces)
     }
     return QString(spaces, QLatin1Char(' '));
 }
+
+QList<RichText> ScriptFormatter::lines(const RichText &script)
+{
+    const QString &text = script.text();
+    const QList<TextRun> &runs = script.runs();
+    QList<RichText> result;
+    qsizetype runIndex = 0;
+    qsizetype lineStart = 0;
+    while (true) {
+        qsizetype lineEnd = lineStart;
+        while (lineEnd < text.size() && !isLineBreak(text[lineEnd])) {
+            ++lineEnd;
+        }
+        qsizetype begin = lineStart;
+        qsizetype end = lineEnd;
+        while (begin < end && text[begin].isSpace()) {
+            ++begin;
+        }
+        while (end > begin && text[end - 1].isSpace()) {
+            --end;
+        }
+
+        QString line;
+        line.reserve(end - begin);
+        appendText(line, text, begin, end);
+        QList<TextRun> lineRuns;
+        while (runIndex < runs.size() && runs[runIndex].start + runs[runIndex].length <= begin) {
+            ++runIndex;
+        }
+        for (qsizetype i = runIndex; i < runs.size() && runs[i].start < end; ++i) {
+            TextRun run = runs[i];
+            const qsizetype from = qMax(run.start, begin);
+            run.length = qMin(run.start + run.length, end) - from;
+            run.start = from - begin;
+            lineRuns.append(run);
+        }
+        result.append(RichText(std::move(line), std::move(lineRuns)));
+
+        if (lineEnd >= text.size()) {
+            break;
+        }
+        lineStart = lineEnd + 1;
+    }
+    return result;
+}
+
+QString ScriptFormatter::renpyText(const RichText &line)
+{
+    const QStringView text(line.text());
+    const QList<std::pair<qsizetype, qsizetype>> literals = stringLiterals(text);
+    QString result;
+    result.reserve(text.size());
+    qsizetype pos = 0;
+    qsizetype literal = 0;
+    for (const TextRun &run : line.runs()) {
+        const qsizetype runEnd = run.start + run.length;
+        while (literal < literals.size() && literals[literal].second <= run.start) {
+            ++literal;
+        }
+        // A run is written once per literal it overlaps; the statement
+        // around the literals stays plain.
+        for (qsizetype i = literal; i < literals.size() && literals[i].first < runEnd; ++i) {
+            const qsizetype from = qMax(run.start, literals[i].first);
+            const qsizetype to = qMin(runEnd, literals[i].second);
+            if (from >= to) {
+                continue;
+            }
+            result += text.sliced(pos, from - pos);
+            appendOpenTags(result, run);
+            result += text.sliced(from, to - from);
+            appendCloseTags(result, run);
+            pos = to;
+        }
+    }
+    result += text.sliced(pos);
+    return result;
+}
+
+QStringList ScriptFormatter::renpyLines(const RichText &script)
+{
+    QStringList result;
+    for (const RichText &line : lines(script)) {
+        result.append(renpyText(line));
+    }
+    return result;
+}
@@ -1,6 +1,10 @@
 #pragma once
 
+#include <QList>
 #include <QString>
+#include <QStringList>
+
+class RichText;
 
 class ScriptFormatter
 {
@@ -8,4 +12,12 @@ public:
     ScriptFormatter() = delete;
 
     static QString indent(int spaces);
+    // One trimmed line per paragraph or line break, with non-breaking spaces
+    // made plain and runs cut to the line.
+    static QList<RichText> lines(const RichText &script);
+    // A single line with its formatting written as Ren'Py text tags ({b},
+    // {i}, {u}, {size=N}, {color=#rrggbb}). Tags only go inside string
+    // literals; formatting of the statement around them is dropped.
+    static QString renpyText(const RichText &line);
+    static QStringList renpyLines(const RichText &script);
 };
@@ -0,0 +1,77 @@
+#include "AutoSaveSettingsDialog.h"
+
+#include <QCheckBox>
+#include <QDialogButtonBox>
+#include <QEvent>
+#include <QFormLayout>
+#include <QLabel>
+#include <QPushButton>
+#include <QSpinBox>
+
+AutoSaveSettingsDialog::AutoSaveSettingsDialog(bool enabled, int intervalMinutes, int backupCount, QWidget *parent)
+    : QDialog(parent)
+    , m_layout(new QFormLayout(this))
+    , m_enabledCheckBox(new QCheckBox(this))
+    , m_intervalSpinBox(new QSpinBox(this))
+    , m_backupCountSpinBox(new QSpinBox(this))
+{
+    m_enabledCheckBox->setChecked(enabled);
+    m_layout->addRow(m_enabledCheckBox);
+
+    m_intervalSpinBox->setRange(1, 120);
+    m_intervalSpinBox->setValue(qMax(1, intervalMinutes));
+    m_layout->addRow(QString(), m_intervalSpinBox);
+
+    m_backupCountSpinBox->setRange(1, 20);
+    m_backupCountSpinBox->setValue(qMax(1, backupCount));
+    m_layout->addRow(QString(), m_backupCountSpinBox);
+
+    m_buttonBox = new QDialogButtonBox(QDialogButtonBox::Ok | QDialogButtonBox::Cancel, this);
+    m_layout->addRow(m_buttonBox);
+    connect(m_buttonBox, &QDialogButtonBox::accepted, this, &AutoSaveSettingsDialog::accept);
+    connect(m_buttonBox, &QDialogButtonBox::rejected, this, &AutoSaveSettingsDialog::reject);
+
+    retranslateUi();
+}
+
+bool AutoSaveSettingsDialog::isAutoSaveEnabled() const
+{
+    return m_enabledCheckBox->isChecked();
+}
+
+int AutoSaveSettingsDialog::intervalMinutes() const
+{
+    return m_intervalSpinBox->value();
+}
+
+int AutoSaveSettingsDialog::backupCount() const
+{
+    return m_backupCountSpinBox->value();
+}
+
+void AutoSaveSettingsDialog::changeEvent(QEvent *event)
+{
+    if (event->type() == QEvent::LanguageChange) {
+        retranslateUi();
+    }
+    QDialog::changeEvent(event);
+}
+
+void AutoSaveSettingsDialog::retranslateUi()
+{
+    setWindowTitle(tr("Auto Save Settings"));
+    m_enabledCheckBox->setText(tr("Enable automatic backups"));
+    m_intervalSpinBox->setSuffix(tr(" minutes"));
+    if (QWidget *label = m_layout->labelForField(m_intervalSpinBox)) {
+        static_cast<QLabel *>(label)->setText(tr("Interval"));
+    }
+    if (QWidget *label = m_layout->labelForField(m_backupCountSpinBox)) {
+        static_cast<QLabel *>(label)->setText(tr("Backups to keep"));
+    }
+    if (QPushButton *okButton = m_buttonBox->button(QDialogButtonBox::Ok)) {
+        okButton->setText(tr("OK"));
+    }
+    if (QPushButton *cancelButton = m_buttonBox->button(QDialogButtonBox::Cancel)) {
+        cancelButton->setText(tr("Cancel"));
+    }
+}
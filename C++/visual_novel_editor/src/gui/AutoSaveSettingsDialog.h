@@ -0,0 +1,31 @@
+#pragma once
+
+#include <QDialog>
+
+class QCheckBox;
+class QDialogButtonBox;
+class QFormLayout;
+class QSpinBox;
+
+class AutoSaveSettingsDialog : public QDialog
+{
+    Q_OBJECT
+public:
+    AutoSaveSettingsDialog(bool enabled, int intervalMinutes, int backupCount, QWidget *parent = nullptr);
+
+    [[nodiscard]] bool isAutoSaveEnabled() const;
+    [[nodiscard]] int intervalMinutes() const;
+    [[nodiscard]] int backupCount() const;
+
+protected:
+    void changeEvent(QEvent *event) override;
+
+private:
+    void retranslateUi();
+
+    QFormLayout *m_layout{nullptr};
+    QCheckBox *m_enabledCheckBox{nullptr};
+    QSpinBox *m_intervalSpinBox{nullptr};
+    QSpinBox *m_backupCountSpinBox{nullptr};
+    QDialogButtonBox *m_buttonBox{nullptr};
+};
@@ -71,7 +71,7 @@ QPointF anchorForRect(const QRectF &rect, const QPointF &towards)
 } // namespace
 
 EdgeItem::EdgeItem(NodeItem *source, NodeItem *target,
-                   const QString &choiceId, QGraphicsItem *parent)
+                   const ObjectId &choiceId, QGraphicsItem *parent)
     : QGraphicsObject(parent)
     , m_source(source)
     , m_target(target)
@@ -103,6 +103,11 @@ void EdgeItem::setLabelText(const QString &text)
     updateLabelPosition();
 }
 
+QString EdgeItem::labelText() const
+{
+    return m_label ? m_label->toPlainText() : QString();
+}
+
 void EdgeItem::setParallelInfo(int index, int total)
 {
     m_parallelIndex = std::max(0, index);
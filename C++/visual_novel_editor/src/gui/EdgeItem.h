@@ -5,6 +5,8 @@
 #include <QPainterPath>
 #include <QString>
 
+#include "model/ObjectId.h"
+
 class NodeItem;
 // class Choice;               // 若未使用可删除
 
@@ -15,7 +17,7 @@ class EdgeItem : public QGraphicsObject
 {
     Q_OBJECT
 public:
-    EdgeItem(NodeItem *source, NodeItem *target, const QString &choiceId,
+    EdgeItem(NodeItem *source, NodeItem *target, const ObjectId &choiceId,
              QGraphicsItem *parent = nullptr);
 
     void updatePosition();
@@ -28,19 +30,20 @@ public:
 
     NodeItem *sourceItem() const { return m_source; }
     NodeItem *targetItem() const { return m_target; }
-    QString   choiceId()   const { return m_choiceId; }
+    ObjectId  choiceId()   const { return m_choiceId; }
 
     void setLabelText(const QString &text);
+    QString labelText() const;
 
 signals:
-    void labelEdited(const QString &choiceId, const QString &text);
+    void labelEdited(const ObjectId &choiceId, const QString &text);
 
 private:
     void updateLabelPosition();
 
     NodeItem *m_source{nullptr};
     NodeItem *m_target{nullptr};
-    QString   m_choiceId;
+    ObjectId  m_choiceId;
 
     QPainterPath m_path;
     QRectF       m_boundingRect;
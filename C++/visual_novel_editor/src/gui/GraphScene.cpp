@@ -7,8 +7,10 @@
 #include <QHash>
 #include <QMenu>
 #include <QPair>
-#include <QStringList>
 #include <QSet>
+#include <QTimer>
+
+#include <utility>
 
 #include "EdgeItem.h"
 #include "NodeItem.h"
@@ -18,23 +20,42 @@
 
 namespace {
 constexpr QPointF kDuplicateOffset(60.0, 40.0);
+constexpr int kGeometryFlushIntervalMs = 16;
 }
 
 GraphScene::GraphScene(QObject *parent)
     : QGraphicsScene(parent)
+    , m_geometryTimer(new QTimer(this))
 {
     setSceneRect(-500, -500, 1000, 1000);
+
+    m_geometryTimer->setSingleShot(true);
+    m_geometryTimer->setTimerType(Qt::PreciseTimer);
+    m_geometryTimer->setInterval(kGeometryFlushIntervalMs);
+    connect(m_geometryTimer, &QTimer::timeout, this, &GraphScene::flushGeometryUpdates);
 }
 
 void GraphScene::setProject(Project *project)
 {
+    if (m_project) {
+        disconnect(m_project, nullptr, this, nullptr);
+    }
     m_project = project;
+    if (m_project) {
+        connect(m_project, &Project::nodeAdded, this, &GraphScene::onNodeAdded);
+        connect(m_project, &Project::nodeRemoved, this, &GraphScene::onNodeRemoved);
+        connect(m_project, &Project::nodeChanged, this, &GraphScene::refreshNode);
+        connect(m_project, &Project::choiceAdded, this, &GraphScene::onChoiceAdded);
+        connect(m_project, &Project::choiceRemoved, this, &GraphScene::onChoiceRemoved);
+        connect(m_project, &Project::choiceChanged, this, &GraphScene::onChoiceChanged);
+        connect(m_project, &Project::projectReset, this, &GraphScene::rebuild);
+    }
     rebuild();
 }
 
-QStringList GraphScene::selectedNodeIds() const
+QList<ObjectId> GraphScene::selectedNodeIds() const
 {
-    QStringList ids;
+    QList<ObjectId> ids;
     const QList<QGraphicsItem *> selection = selectedItems();
     ids.reserve(selection.size());
     for (QGraphicsItem *item : selection) {
@@ -47,32 +68,30 @@ QStringList GraphScene::selectedNodeIds() const
     return ids;
 }
 
-QString GraphScene::createNode(const QPointF &pos)
+ObjectId GraphScene::createNode(const QPointF &pos)
 {
     if (!m_project) {
         return {};
     }
-    StoryNode *node = m_project->addNode(StoryNode::Type::Dialogue);
-    node->setPosition(pos);
-    rebuild();
-    return node->id();
+    ObjectId nodeId;
+    {
+        ProjectBatch batch(m_project);
+        StoryNode *node = m_project->addNode(StoryNode::Type::Dialogue);
+        node->setPosition(pos);
+        nodeId = node->id();
+    }
+    return nodeId;
 }
 
-void GraphScene::createEdge(const QString &sourceId, const QString &targetId)
+void GraphScene::createEdge(const ObjectId &sourceId, const ObjectId &targetId)
 {
     if (!m_project) {
         return;
     }
-    StoryNode *source = m_project->getNode(sourceId);
-    if (!source) {
-        return;
-    }
     Choice choice;
-    choice.id = m_project->generateId();
     choice.text = QStringLiteral("Choice");
     choice.targetNodeId = targetId;
-    source->choices().append(choice);
-    rebuildEdges();
+    m_project->addChoice(sourceId, choice);
 }
 
 void GraphScene::mousePressEvent(QGraphicsSceneMouseEvent *event)
@@ -95,6 +114,21 @@ void GraphScene::mousePressEvent(QGraphicsSceneMouseEvent *event)
     }
 }
 
+void GraphScene::mouseReleaseEvent(QGraphicsSceneMouseEvent *event)
+{
+    QGraphicsScene::mouseReleaseEvent(event);
+
+    // Items write their position into the model while dragging; the model is
+    // told once the drag ends.
+    if (m_project && !m_draggedNodeIds.isEmpty()) {
+        const QSet<ObjectId> moved = std::exchange(m_draggedNodeIds, {});
+        ProjectBatch batch(m_project);
+        for (const ObjectId &nodeId : moved) {
+            m_project->notifyNodeChanged(nodeId);
+        }
+    }
+}
+
 void GraphScene::contextMenuEvent(QGraphicsSceneContextMenuEvent *event)
 {
     const QPointF scenePos = event->scenePos();
@@ -153,8 +187,8 @@ void GraphScene::contextMenuEvent(QGraphicsSceneContextMenuEvent *event)
     }
 
     if (chosen == addNodeAction) {
-        const QString newId = createNode(scenePos);
-        if (!newId.isEmpty()) {
+        const ObjectId newId = createNode(scenePos);
+        if (!newId.isNull()) {
             if (NodeItem *created = m_nodeItems.value(newId).data()) {
                 clearSelection();
                 created->setSelected(true);
@@ -185,11 +219,8 @@ void GraphScene::rebuild()
         return;
     }
 
-    for (auto it = m_project->nodes().cbegin(); it != m_project->nodes().cend(); ++it) {
-        StoryNode *node = it.value().get();
-        if (!node) {
-            continue;
-        }
+    for (const StoryNode &stored : m_project->nodes()) {
+        StoryNode *node = m_project->getNode(stored.id());
         NodeItem *item = createNodeItem(node);
         addItem(item);
         item->setPos(node->position());
@@ -199,9 +230,12 @@ void GraphScene::rebuild()
     rebuildEdges();
 }
 
-void GraphScene::refreshNode(const QString &nodeId)
+void GraphScene::refreshNode(const ObjectId &nodeId)
 {
     if (NodeItem *item = m_nodeItems.value(nodeId).data()) {
+        if (const StoryNode *node = item->storyNode(); node && item->pos() != node->position()) {
+            item->setPos(node->position());
+        }
         item->update();
         updateEdgesForNode(item);
     }
@@ -220,18 +254,51 @@ void GraphScene::connectNodeItem(NodeItem *item)
     if (!item) {
         return;
     }
-    connect(item, &NodeItem::positionChanged, this, [this](const QString &id, const QPointF &) {
-        if (NodeItem *sourceItem = m_nodeItems.value(id).data()) {
-            updateEdgesForNode(sourceItem);
+    connect(item, &NodeItem::positionChanged, this, [this](const ObjectId &id, const QPointF &) {
+        scheduleGeometryUpdate(id);
+        if (mouseGrabberItem()) {
+            m_draggedNodeIds.insert(id);
         }
     });
-    connect(item, &NodeItem::doubleClicked, this, [this](const QString &id) {
-        if (!id.isEmpty()) {
+    connect(item, &NodeItem::doubleClicked, this, [this](const ObjectId &id) {
+        if (!id.isNull()) {
             emit nodeDoubleClicked(id);
         }
     });
 }
 
+EdgeItem *GraphScene::createEdgeItem(NodeItem *sourceItem, const Choice &choice)
+{
+    NodeItem *targetItem = m_nodeItems.value(choice.targetNodeId).data();
+    if (!sourceItem || !targetItem) {
+        return nullptr;
+    }
+    auto *edge = new EdgeItem(sourceItem, targetItem, choice.id);
+    edge->setParent(this);
+    addItem(edge);
+    edge->setLabelText(choice.text);
+    connect(edge, &EdgeItem::labelEdited, this, &GraphScene::updateChoiceText);
+    m_edgeItems.insert(choice.id, edge);
+    sourceItem->addEdge(edge);
+    targetItem->addEdge(edge);
+    return edge;
+}
+
+void GraphScene::destroyEdgeItem(EdgeItem *edge)
+{
+    if (!edge) {
+        return;
+    }
+    if (NodeItem *source = edge->sourceItem()) {
+        source->removeEdge(edge);
+    }
+    if (NodeItem *target = edge->targetItem()) {
+        target->removeEdge(edge);
+    }
+    removeItem(edge);
+    edge->deleteLater();
+}
+
 void GraphScene::rebuildEdges()
 {
     clearEdges();
@@ -241,27 +308,15 @@ void GraphScene::rebuildEdges()
 
     QHash<QPair<NodeItem *, NodeItem *>, QList<EdgeItem *>> groupedEdges;
 
-    for (auto it = m_project->nodes().cbegin(); it != m_project->nodes().cend(); ++it) {
-        StoryNode *node = it.value().get();
-        if (!node) {
-            continue;
-        }
-        NodeItem *sourceItem = m_nodeItems.value(node->id()).data();
+    for (const StoryNode &node : m_project->nodes()) {
+        NodeItem *sourceItem = m_nodeItems.value(node.id()).data();
         if (!sourceItem) {
             continue;
         }
-        for (const Choice &choice : node->choices()) {
-            NodeItem *targetItem = m_nodeItems.value(choice.targetNodeId).data();
-            if (!targetItem) {
-                continue;
+        for (const Choice &choice : node.choices()) {
+            if (EdgeItem *edge = createEdgeItem(sourceItem, choice)) {
+                groupedEdges[qMakePair(sourceItem, edge->targetItem())].append(edge);
             }
-            auto *edge = new EdgeItem(sourceItem, targetItem, choice.id);
-            edge->setParent(this);
-            addItem(edge);
-            edge->setLabelText(choice.text);
-            connect(edge, &EdgeItem::labelEdited, this, &GraphScene::updateChoiceText);
-            m_edgeItems.append(edge);
-            groupedEdges[qMakePair(sourceItem, targetItem)].append(edge);
         }
     }
 
@@ -274,29 +329,67 @@ void GraphScene::rebuildEdges()
             }
         }
     }
-
-    updateBoundingForAllEdges();
 }
 
 void GraphScene::updateEdgesForNode(NodeItem *item)
 {
-    for (const QPointer<EdgeItem> &edgePtr : m_edgeItems) {
-        if (EdgeItem *edge = edgePtr.data()) {
-            if (edge->sourceItem() == item || edge->targetItem() == item) {
-                edge->updatePosition();
+    if (!item) {
+        return;
+    }
+    for (EdgeItem *edge : item->edges()) {
+        edge->updatePosition();
+    }
+}
+
+void GraphScene::scheduleGeometryUpdate(const ObjectId &nodeId)
+{
+    m_dirtyNodeIds.insert(nodeId);
+    if (!m_geometryTimer->isActive()) {
+        m_geometryTimer->start();
+    }
+}
+
+void GraphScene::flushGeometryUpdates()
+{
+    QSet<EdgeItem *> edges;
+    for (const ObjectId &nodeId : std::as_const(m_dirtyNodeIds)) {
+        if (NodeItem *item = m_nodeItems.value(nodeId).data()) {
+            for (EdgeItem *edge : item->edges()) {
+                edges.insert(edge);
             }
         }
     }
-    updateBoundingForAllEdges();
+    m_dirtyNodeIds.clear();
+
+    for (EdgeItem *edge : std::as_const(edges)) {
+        edge->updatePosition();
+    }
+}
+
+void GraphScene::updateParallelEdges(const ObjectId &sourceId, const ObjectId &targetId)
+{
+    const StoryNode *source = m_project ? m_project->getNode(sourceId) : nullptr;
+    if (!source) {
+        return;
+    }
+    QList<EdgeItem *> edges;
+    for (const Choice &choice : source->choices()) {
+        if (choice.targetNodeId != targetId) {
+            continue;
+        }
+        if (EdgeItem *edge = m_edgeItems.value(choice.id).data()) {
+            edges.append(edge);
+        }
+    }
+    for (int index = 0; index < edges.size(); ++index) {
+        edges.at(index)->setParallelInfo(index, edges.size());
+    }
 }
 
 void GraphScene::clearEdges()
 {
     for (const QPointer<EdgeItem> &edgePtr : m_edgeItems) {
-        if (EdgeItem *edge = edgePtr.data()) {
-            removeItem(edge);
-            edge->deleteLater();
-        }
+        destroyEdgeItem(edgePtr.data());
     }
     m_edgeItems.clear();
 }
@@ -319,12 +412,9 @@ void GraphScene::finalizeBranch(NodeItem *target)
     }
 
     Choice choice;
-    choice.id = m_project->generateId();
     choice.text = QStringLiteral("Choice");
     choice.targetNodeId = targetNode->id();
-    sourceNode->choices().append(choice);
-
-    rebuildEdges();
+    m_project->addChoice(sourceNode->id(), choice);
 }
 
 void GraphScene::copySelection()
@@ -344,7 +434,8 @@ void GraphScene::copySelection()
         return;
     }
 
-    QHash<QString, StoryNode *> clonedNodes;
+    ProjectBatch batch(m_project);
+    QHash<ObjectId, StoryNode *> clonedNodes;
     for (NodeItem *nodeItem : selectedNodes) {
         if (!nodeItem->storyNode()) {
             continue;
@@ -368,15 +459,12 @@ void GraphScene::copySelection()
                 continue;
             }
             Choice newChoice;
-            newChoice.id = m_project->generateId();
             newChoice.text = choice.text;
             newChoice.targetNodeId = clonedNodes.value(choice.targetNodeId)->id();
             newChoice.condition = choice.condition;
-            clone->choices().append(newChoice);
+            m_project->addChoice(clone->id(), newChoice);
         }
     }
-
-    rebuild();
 }
 
 void GraphScene::deleteSelectionItems()
@@ -391,30 +479,23 @@ void GraphScene::deleteSelectionItems()
         }
     }
 
+    ProjectBatch batch(m_project);
     if (!edges.isEmpty()) {
         deleteEdges(edges);
     }
     if (!nodes.isEmpty()) {
         deleteNodes(nodes);
     }
-    rebuild();
 }
 
 void GraphScene::deleteEdges(const QList<EdgeItem *> &edges)
 {
+    if (!m_project) {
+        return;
+    }
     for (EdgeItem *edge : edges) {
-        if (!edge) {
-            continue;
-        }
-        StoryNode *node = nodeForEdge(edge);
-        if (!node) {
-            continue;
-        }
-        auto &choices = node->choices();
-        for (int i = choices.size() - 1; i >= 0; --i) {
-            if (choices[i].id == edge->choiceId()) {
-                choices.removeAt(i);
-            }
+        if (edge) {
+            m_project->removeChoice(m_project->choiceSource(edge->choiceId()), edge->choiceId());
         }
     }
 }
@@ -425,78 +506,105 @@ void GraphScene::deleteNodes(const QList<NodeItem *> &nodes)
         return;
     }
 
-    QStringList ids;
+    QSet<ObjectId> ids;
     ids.reserve(nodes.size());
     for (NodeItem *item : nodes) {
         if (item && item->storyNode()) {
-            ids.append(item->storyNode()->id());
+            ids.insert(item->storyNode()->id());
         }
     }
 
-    const QSet<QString> idSet(ids.cbegin(), ids.cend());
+    m_project->removeNodes(ids);
+}
 
-    for (auto it = m_project->nodes().cbegin(); it != m_project->nodes().cend(); ++it) {
-        StoryNode *node = it.value().get();
-        if (!node) {
-            continue;
-        }
-        auto &choices = node->choices();
-        for (int i = choices.size() - 1; i >= 0; --i) {
-            if (idSet.contains(choices[i].targetNodeId)) {
-                choices.removeAt(i);
-            }
-        }
+// Runs on every keystroke in an edge label.
+void GraphScene::updateChoiceText(const ObjectId &choiceId, const QString &text)
+{
+    const Choice *existing = m_project ? m_project->findChoice(choiceId) : nullptr;
+    if (!existing || existing->text == text) {
+        return;
     }
+    Choice updated = *existing;
+    updated.text = text;
+    m_project->updateChoice(m_project->choiceSource(choiceId), updated);
+}
 
-    for (const QString &id : ids) {
-        m_project->removeNode(id);
+void GraphScene::onNodeAdded(const ObjectId &nodeId)
+{
+    if (!m_project || m_nodeItems.contains(nodeId)) {
+        return;
+    }
+    StoryNode *node = m_project->getNode(nodeId);
+    if (!node) {
+        return;
     }
+    NodeItem *item = createNodeItem(node);
+    addItem(item);
+    item->setPos(node->position());
+    m_nodeItems.insert(nodeId, item);
 }
 
-Choice *GraphScene::findChoice(const QString &choiceId)
+void GraphScene::onNodeRemoved(const ObjectId &nodeId)
 {
-    if (!m_project) {
-        return nullptr;
+    NodeItem *item = m_nodeItems.take(nodeId).data();
+    if (!item) {
+        return;
     }
-    for (auto it = m_project->nodes().cbegin(); it != m_project->nodes().cend(); ++it) {
-        StoryNode *node = it.value().get();
-        if (!node) {
-            continue;
-        }
-        auto &choices = node->choices();
-        for (Choice &choice : choices) {
-            if (choice.id == choiceId) {
-                return &choice;
-            }
-        }
+
+    // Choices are reported before their nodes; this only catches strays.
+    const QList<EdgeItem *> edges = item->edges();
+    for (EdgeItem *edge : edges) {
+        m_edgeItems.remove(edge->choiceId());
+        destroyEdgeItem(edge);
     }
-    return nullptr;
+
+    if (m_pendingBranchSource == item) {
+        m_pendingBranchSource = nullptr;
+    }
+    removeItem(item);
+    item->deleteLater();
 }
 
-StoryNode *GraphScene::nodeForEdge(const EdgeItem *edge) const
+void GraphScene::onChoiceAdded(const ObjectId &sourceId, const ObjectId &choiceId)
 {
-    if (!edge || !m_project) {
-        return nullptr;
+    if (!m_project || m_edgeItems.contains(choiceId)) {
+        return;
     }
-    NodeItem *sourceItem = edge->sourceItem();
-    if (!sourceItem) {
-        return nullptr;
+    const StoryNode *source = m_project->getNode(sourceId);
+    const Choice *choice = source ? source->findChoice(choiceId) : nullptr;
+    if (!choice) {
+        return;
+    }
+    if (createEdgeItem(m_nodeItems.value(sourceId).data(), *choice)) {
+        updateParallelEdges(sourceId, choice->targetNodeId);
     }
-    return sourceItem->storyNode();
 }
 
-void GraphScene::updateChoiceText(const QString &choiceId, const QString &text)
+void GraphScene::onChoiceRemoved(const ObjectId &sourceId, const ObjectId &choiceId)
 {
-    if (Choice *choice = findChoice(choiceId)) {
-        choice->text = text;
+    EdgeItem *edge = m_edgeItems.take(choiceId).data();
+    if (!edge) {
+        return;
     }
+    const ObjectId targetId = edge->targetItem() ? edge->targetItem()->nodeId() : ObjectId();
+    destroyEdgeItem(edge);
+    updateParallelEdges(sourceId, targetId);
 }
 
-void GraphScene::updateBoundingForAllEdges()
+void GraphScene::onChoiceChanged(const ObjectId &sourceId, const ObjectId &choiceId)
 {
-    for (const QPointer<EdgeItem> &edgePtr : m_edgeItems) {
-        if (EdgeItem *edge = edgePtr.data()) {
-            edge->update();
-        }
+    const StoryNode *source = m_project ? m_project->getNode(sourceId) : nullptr;
+    const Choice *choice = source ? source->findChoice(choiceId) : nullptr;
+    if (!choice) {
+        return;
+    }
+    EdgeItem *edge = m_edgeItems.value(choiceId).data();
+    if (!edge || !edge->targetItem() || edge->targetItem()->nodeId() != choice->targetNodeId) {
+        onChoiceRemoved(sourceId, choiceId);
+        onChoiceAdded(sourceId, choiceId);
+        return;
+    }
+    if (edge->labelText() != choice->text) {
+        edge->setLabelText(choice->text);
     }
 }
@@ -5,16 +5,18 @@
 #include <QList>
 #include <QPointer>
 #include <QPointF>
+#include <QSet>
 #include <QString>
-#include <QStringList>
 
+#include "model/ObjectId.h"
 #include "presenter/ViewInterfaces.h"
 
 class NodeItem;
 class StoryNode;
 class Project;
 class EdgeItem;
-class Choice;
+class QTimer;
+struct Choice;
 
 class GraphScene : public QGraphicsScene, public gui::presenter::IGraphSceneView
 {
@@ -23,25 +25,31 @@ public:
     explicit GraphScene(QObject *parent = nullptr);
 
     void setProject(Project *project) override;
-    QString createNode(const QPointF &pos);
-    void createEdge(const QString &sourceId, const QString &targetId);
-    void refreshNode(const QString &nodeId);
+    ObjectId createNode(const QPointF &pos);
+    void createEdge(const ObjectId &sourceId, const ObjectId &targetId);
+    void refreshNode(const ObjectId &nodeId);
 
-    [[nodiscard]] QStringList selectedNodeIds() const override;
+    [[nodiscard]] QList<ObjectId> selectedNodeIds() const override;
 
 signals:
-    void nodeSelected(const QString &nodeId);
-    void nodeDoubleClicked(const QString &nodeId);
+    void nodeSelected(const ObjectId &nodeId);
+    void nodeDoubleClicked(const ObjectId &nodeId);
 
 protected:
     void mousePressEvent(QGraphicsSceneMouseEvent *event) override;
+    void mouseReleaseEvent(QGraphicsSceneMouseEvent *event) override;
     void contextMenuEvent(QGraphicsSceneContextMenuEvent *event) override;
 
 private:
     NodeItem *createNodeItem(StoryNode *node);
     void connectNodeItem(NodeItem *item);
+    EdgeItem *createEdgeItem(NodeItem *sourceItem, const Choice &choice);
+    void destroyEdgeItem(EdgeItem *edge);
     void rebuildEdges();
     void updateEdgesForNode(NodeItem *item);
+    void scheduleGeometryUpdate(const ObjectId &nodeId);
+    void flushGeometryUpdates();
+    void updateParallelEdges(const ObjectId &sourceId, const ObjectId &targetId);
     void clearEdges();
     void startBranch(NodeItem *source);
     void finalizeBranch(NodeItem *target);
@@ -49,15 +57,24 @@ private:
     void deleteSelectionItems();
     void deleteEdges(const QList<EdgeItem *> &edges);
     void deleteNodes(const QList<NodeItem *> &nodes);
-    Choice *findChoice(const QString &choiceId);
-    StoryNode *nodeForEdge(const EdgeItem *edge) const;
-    void updateChoiceText(const QString &choiceId, const QString &text);
-    void updateBoundingForAllEdges();
+    void updateChoiceText(const ObjectId &choiceId, const QString &text);
+
+    void onNodeAdded(const ObjectId &nodeId);
+    void onNodeRemoved(const ObjectId &nodeId);
+    void onChoiceAdded(const ObjectId &sourceId, const ObjectId &choiceId);
+    void onChoiceRemoved(const ObjectId &sourceId, const ObjectId &choiceId);
+    void onChoiceChanged(const ObjectId &sourceId, const ObjectId &choiceId);
 
     void rebuild();
 
     Project *m_project{nullptr};
-    QHash<QString, QPointer<NodeItem>> m_nodeItems;
-    QList<QPointer<EdgeItem>> m_edgeItems;
+    QHash<ObjectId, QPointer<NodeItem>> m_nodeItems;
+    // Keyed by choice id.
+    QHash<ObjectId, QPointer<EdgeItem>> m_edgeItems;
     QPointer<NodeItem> m_pendingBranchSource;
+    // Nodes moved since the last geometry flush; their edges are recomputed
+    // once per frame no matter how many endpoints moved.
+    QSet<ObjectId> m_dirtyNodeIds;
+    QTimer *m_geometryTimer{nullptr};
+    QSet<ObjectId> m_draggedNodeIds;
 };
@@ -23,36 +23,61 @@ public:
             {makeKey("MainWindow", "&Save"), QStringLiteral("保存(&S)")},
             {makeKey("MainWindow", "E&xit"), QStringLiteral("退出(&X)")},
             {makeKey("MainWindow", "&Edit"), QStringLiteral("编辑(&E)")},
+            {makeKey("MainWindow", "&Undo"), QStringLiteral("撤销(&U)")},
+            {makeKey("MainWindow", "&Redo"), QStringLiteral("重做(&R)")},
             {makeKey("MainWindow", "Add Node"), QStringLiteral("添加节点")},
             {makeKey("MainWindow", "Delete"), QStringLiteral("删除")},
             {makeKey("MainWindow", "Edit Script"), QStringLiteral("编辑脚本")},
             {makeKey("MainWindow", "&Export"), QStringLiteral("导出(&E)")},
             {makeKey("MainWindow", "Export to Ren'Py"), QStringLiteral("导出为 Ren'Py")},
+            {makeKey("MainWindow", "Export to Ren'Py Chapters..."), QStringLiteral("按章节导出为 Ren'Py…")},
+            {makeKey("MainWindow", "Export JSON and Dialogue Sheet..."), QStringLiteral("导出 JSON 和对白表…")},
             {makeKey("MainWindow", "Tools"), QStringLiteral("工具")},
             {makeKey("MainWindow", "Export"), QStringLiteral("导出")},
             {makeKey("MainWindow", "Inspector"), QStringLiteral("检查器")},
             {makeKey("MainWindow", "Ready"), QStringLiteral("就绪")},
             {makeKey("MainWindow", "Created new project"), QStringLiteral("已创建新项目")},
             {makeKey("MainWindow", "Open Project"), QStringLiteral("打开项目")},
-            {makeKey("MainWindow", "Project (*.json)"), QStringLiteral("项目文件 (*.json)")},
+            {makeKey("MainWindow", "Project (*.json *.vnb)"), QStringLiteral("项目文件 (*.json *.vnb)")},
+            {makeKey("MainWindow", "Project (*.json);;Binary Project (*.vnb)"),
+             QStringLiteral("项目文件 (*.json);;二进制项目文件 (*.vnb)")},
+            {makeKey("MainWindow", "Loading project..."), QStringLiteral("正在加载项目…")},
             {makeKey("MainWindow", "Load Failed"), QStringLiteral("加载失败")},
             {makeKey("MainWindow", "Unable to open project file."), QStringLiteral("无法打开项目文件。")},
             {makeKey("MainWindow", "Project loaded"), QStringLiteral("项目已加载")},
+            {makeKey("MainWindow", "Legacy scripts converted; save to keep them"),
+             QStringLiteral("旧版脚本已转换，请保存以保留")},
             {makeKey("MainWindow", "Save Project"), QStringLiteral("保存项目")},
             {makeKey("MainWindow", "Save Failed"), QStringLiteral("保存失败")},
             {makeKey("MainWindow", "Unable to write project file."), QStringLiteral("无法写入项目文件。")},
             {makeKey("MainWindow", "Project saved"), QStringLiteral("项目已保存")},
+            {makeKey("MainWindow", "Edit Journal"), QStringLiteral("编辑日志")},
+            {makeKey("MainWindow", "The edit journal of this project could not be used."),
+             QStringLiteral("无法使用此项目的编辑日志。")},
+            {makeKey("MainWindow", "Recover Changes"), QStringLiteral("恢复更改")},
+            {makeKey("MainWindow", "This project has unsaved changes from a previous session. Recover them?"),
+             QStringLiteral("此项目包含上次会话中未保存的更改。是否恢复？")},
+            {makeKey("MainWindow", "Background save failed"), QStringLiteral("后台保存失败")},
+            {makeKey("MainWindow", "Edit journal unavailable"), QStringLiteral("编辑日志不可用")},
+            {makeKey("MainWindow", "Backup saved"), QStringLiteral("备份已保存")},
+            {makeKey("MainWindow", "Auto-save failed"), QStringLiteral("自动保存失败")},
+            {makeKey("MainWindow", "Auto Save..."), QStringLiteral("自动保存…")},
             {makeKey("MainWindow", "Dialogue"), QStringLiteral("对话")},
             {makeKey("MainWindow", "# dialogue script"), QStringLiteral("# 对话脚本")},
             {makeKey("MainWindow", "Node added"), QStringLiteral("节点已添加")},
             {makeKey("MainWindow", "Export Ren'Py Script"), QStringLiteral("导出 Ren'Py 脚本")},
             {makeKey("MainWindow", "Ren'Py Script (*.rpy)"), QStringLiteral("Ren'Py 脚本 (*.rpy)")},
+            {makeKey("MainWindow", "Export Ren'Py Chapters"), QStringLiteral("按章节导出 Ren'Py")},
             {makeKey("MainWindow", "Export Failed"), QStringLiteral("导出失败")},
             {makeKey("MainWindow", "Could not export Ren'Py script."), QStringLiteral("无法导出 Ren'Py 脚本。")},
             {makeKey("MainWindow", "Exported to Ren'Py"), QStringLiteral("已导出至 Ren'Py")},
             {makeKey("MainWindow", "Export canceled"), QStringLiteral("导出已取消")},
             {makeKey("MainWindow", "Exporting"), QStringLiteral("正在导出")},
             {makeKey("MainWindow", "Exporting Ren'Py script..."), QStringLiteral("正在导出 Ren'Py 脚本…")},
+            {makeKey("MainWindow", "Export JSON and Dialogue Sheet"), QStringLiteral("导出 JSON 和对白表")},
+            {makeKey("MainWindow", "Exporting JSON and dialogue sheet..."), QStringLiteral("正在导出 JSON 和对白表…")},
+            {makeKey("MainWindow", "Could not export JSON and dialogue sheet."), QStringLiteral("无法导出 JSON 和对白表。")},
+            {makeKey("MainWindow", "Exported JSON and dialogue sheet"), QStringLiteral("已导出 JSON 和对白表")},
             {makeKey("MainWindow", "Settings"), QStringLiteral("设置")},
             {makeKey("MainWindow", "Language"), QStringLiteral("语言")},
             {makeKey("MainWindow", "English"), QStringLiteral("英语")},
@@ -65,6 +90,8 @@ public:
             {makeKey("MainWindow", "Open the script editor for the selected node (%1)"), QStringLiteral("打开所选节点的脚本编辑器（%1）")},
             {makeKey("MainWindow", "Generate a Ren'Py project from the current story"), QStringLiteral("基于当前故事生成 Ren'Py 项目")},
             {makeKey("MainWindow", "Generate a Ren'Py project from the current story (%1)"), QStringLiteral("基于当前故事生成 Ren'Py 项目（%1）")},
+            {makeKey("MainWindow", "Write one Ren'Py file per chapter, rewriting only files that changed"), QStringLiteral("每个章节写入一个 Ren'Py 文件，仅重写有变化的文件")},
+            {makeKey("MainWindow", "Write the story as JSON for web players and a CSV dialogue sheet for translators"), QStringLiteral("将故事写为供网页播放器使用的 JSON，以及供译者使用的 CSV 对白表")},
             {makeKey("GraphScene", "Copy"), QStringLiteral("复制")},
             {makeKey("GraphScene", "Cut"), QStringLiteral("剪切")},
             {makeKey("GraphScene", "Delete"), QStringLiteral("删除")},
@@ -93,6 +120,13 @@ public:
             {makeKey("ScriptEditorDialog", "Script Editor"), QStringLiteral("脚本编辑器")},
             {makeKey("ScriptEditorDialog", "OK"), QStringLiteral("确定")},
             {makeKey("ScriptEditorDialog", "Cancel"), QStringLiteral("取消")},
+            {makeKey("AutoSaveSettingsDialog", "Auto Save Settings"), QStringLiteral("自动保存设置")},
+            {makeKey("AutoSaveSettingsDialog", "Enable automatic backups"), QStringLiteral("启用自动备份")},
+            {makeKey("AutoSaveSettingsDialog", "Interval"), QStringLiteral("间隔")},
+            {makeKey("AutoSaveSettingsDialog", " minutes"), QStringLiteral(" 分钟")},
+            {makeKey("AutoSaveSettingsDialog", "Backups to keep"), QStringLiteral("保留备份数")},
+            {makeKey("AutoSaveSettingsDialog", "OK"), QStringLiteral("确定")},
+            {makeKey("AutoSaveSettingsDialog", "Cancel"), QStringLiteral("取消")},
         };
 
         m_translations = translations;
@@ -2,10 +2,8 @@
 
 #include <QAction>
 #include <QActionGroup>
-#include <QCoreApplication>
 #include <QDockWidget>
 #include <QEvent>
-#include <QEventLoop>
 #include <QFileDialog>
 #include <QGraphicsItem>
 #include <QGraphicsView>
@@ -15,17 +13,25 @@
 #include <QMessageBox>
 #include <QPointer>
 #include <QProgressDialog>
+#include <QSettings>
 #include <QStatusBar>
 #include <QToolBar>
 #include <QKeySequence>
 
+#include <functional>
 #include <memory>
+#include <utility>
 
+#include "AutoSaveSettingsDialog.h"
 #include "GraphScene.h"
 #include "NodeInspectorWidget.h"
 #include "NodeItem.h"
 #include "ScriptEditorDialog.h"
+#include "export/ExportFragmentCache.h"
 #include "model/Project.h"
+#include "model/ProjectAutoSaver.h"
+#include "model/ProjectHistory.h"
+#include "model/ProjectJournal.h"
 #include "model/StoryNode.h"
 
 MainWindow::MainWindow(QWidget *parent)
@@ -53,7 +59,41 @@ MainWindow::~MainWindow() = default;
 
 void MainWindow::setProject(Project *project)
 {
+    delete m_journal;
+    m_journal = nullptr;
+    delete m_autoSaver;
+    m_autoSaver = nullptr;
+    delete m_history;
+    m_history = nullptr;
     m_project = project;
+    if (m_project) {
+        m_history = new ProjectHistory(m_project, this);
+        const QSettings settings;
+        m_history->setMemoryLimit(
+            qMax(1, settings.value(QStringLiteral("history/memory_limit_mb"), 64).toInt()) * qint64(1024 * 1024));
+        connect(m_history, &ProjectHistory::canUndoChanged, m_undoAction, &QAction::setEnabled);
+        connect(m_history, &ProjectHistory::canRedoChanged, m_redoAction, &QAction::setEnabled);
+
+        // Undo can change or remove the node shown in the inspector.
+        connect(m_project, &Project::nodeChanged, m_inspector, &NodeInspectorWidget::reloadNode);
+        connect(m_project, &Project::nodeRemoved, m_inspector, &NodeInspectorWidget::releaseNode);
+        connect(m_project, &Project::projectReset, m_inspector, [this]() { m_inspector->setNode(nullptr); });
+
+        m_autoSaver = new ProjectAutoSaver(m_project, this);
+        connect(m_autoSaver, &ProjectAutoSaver::saveFinished, this, [this](bool succeeded, const QString &) {
+            setStatusMessage(succeeded ? QStringLiteral("Backup saved") : QStringLiteral("Auto-save failed"), 3000);
+        });
+        applyAutoSaveSettings();
+
+        m_journal = new ProjectJournal(m_project, this);
+        connect(m_journal, &ProjectJournal::compactionFinished, this, [this](bool succeeded) {
+            if (!succeeded) {
+                setStatusMessage(QStringLiteral("Background save failed"), 5000);
+            }
+        });
+    }
+    m_undoAction->setEnabled(m_history && m_history->canUndo());
+    m_redoAction->setEnabled(m_history && m_history->canRedo());
     if (m_presenter) {
         m_presenter->setProject(m_project);
     } else if (m_scene) {
@@ -74,6 +114,13 @@ void MainWindow::createMenus()
     m_exitAction = m_fileMenu->addAction(QString(), this, &QWidget::close);
 
     m_editMenu = menuBar()->addMenu(QString());
+    m_undoAction = m_editMenu->addAction(QString(), this, &MainWindow::undo);
+    m_undoAction->setShortcut(QKeySequence::Undo);
+    m_undoAction->setEnabled(false);
+    m_redoAction = m_editMenu->addAction(QString(), this, &MainWindow::redo);
+    m_redoAction->setShortcut(QKeySequence::Redo);
+    m_redoAction->setEnabled(false);
+    m_editMenu->addSeparator();
     m_addNodeAction = m_editMenu->addAction(QString(), this, &MainWindow::addNode);
     m_addNodeAction->setIcon(QIcon(QStringLiteral(":/icons/add_node.svg")));
     m_addNodeAction->setShortcut(QKeySequence(Qt::CTRL | Qt::SHIFT | Qt::Key_N));
@@ -86,10 +133,14 @@ void MainWindow::createMenus()
     m_exportRenpyAction = m_exportMenu->addAction(QString(), this, &MainWindow::exportToRenpy);
     m_exportRenpyAction->setIcon(QIcon(QStringLiteral(":/icons/export.svg")));
     m_exportRenpyAction->setShortcut(QKeySequence(Qt::CTRL | Qt::SHIFT | Qt::Key_R));
+    m_exportRenpyChaptersAction = m_exportMenu->addAction(QString(), this, &MainWindow::exportToRenpyChapters);
+    m_exportJsonAndSheetAction = m_exportMenu->addAction(QString(), this, &MainWindow::exportJsonAndDialogueSheet);
 
     m_settingsMenu = menuBar()->addMenu(QString());
     m_languageMenu = m_settingsMenu->addMenu(QString());
 
+    m_autoSaveAction = m_settingsMenu->addAction(QString(), this, &MainWindow::editAutoSaveSettings);
+
     m_languageGroup = new QActionGroup(this);
     m_languageGroup->setExclusive(true);
 
@@ -133,9 +184,9 @@ void MainWindow::setupScene()
 
     m_inspectorDock = new QDockWidget(tr("Inspector"), this);
     m_inspector = new NodeInspectorWidget(m_inspectorDock);
-    connect(m_inspector, &NodeInspectorWidget::nodeUpdated, this, [this](const QString &id) {
-        if (m_scene && !id.isEmpty()) {
-            m_scene->refreshNode(id);
+    connect(m_inspector, &NodeInspectorWidget::nodeUpdated, this, [this](const ObjectId &id) {
+        if (m_project && !id.isNull()) {
+            m_project->notifyNodeChanged(id);
         }
     });
     connect(m_inspector, &NodeInspectorWidget::expandRequested, this, &MainWindow::toggleInspectorExpanded);
@@ -156,17 +207,65 @@ void MainWindow::openProject()
         return;
     }
 
-    const QString fileName = QFileDialog::getOpenFileName(this, tr("Open Project"), QString(), tr("Project (*.json)"));
+    const QString fileName = QFileDialog::getOpenFileName(this, tr("Open Project"), QString(),
+                                                          tr("Project (*.json *.vnb)"));
     if (fileName.isEmpty()) {
         return;
     }
 
-    if (!m_project->loadFromFile(fileName)) {
-        QMessageBox::warning(this, tr("Load Failed"), tr("Unable to open project file."));
+    // Closing may fold saved edits into the current project file, which may
+    // be the one about to be read.
+    if (m_journal) {
+        m_journal->close();
+    }
+
+    QProgressDialog progressDialog(tr("Loading project..."), tr("Cancel"), 0, 1000, this);
+    progressDialog.setWindowTitle(tr("Open Project"));
+    progressDialog.setWindowModality(Qt::ApplicationModal);
+    progressDialog.setMinimumDuration(500);
+    const bool loaded = m_project->loadFromFile(fileName, [&progressDialog](qint64 bytesRead, qint64 totalBytes) {
+        if (totalBytes > 0) {
+            progressDialog.setValue(static_cast<int>(bytesRead * 1000 / totalBytes));
+        }
+        return !progressDialog.wasCanceled();
+    });
+    const bool canceled = progressDialog.wasCanceled();
+    progressDialog.reset();
+
+    if (!loaded) {
+        // The project stays open; its unsaved edits are still in the model
+        // and come back as the journal's uncommitted records.
+        if (m_journal && !m_currentProjectFile.isEmpty() && !m_journal->open(m_currentProjectFile)) {
+            setStatusMessage(QStringLiteral("Edit journal unavailable"), 5000);
+        }
+        if (!canceled) {
+            QMessageBox::warning(this, tr("Load Failed"),
+                                 tr("Unable to open project file.") + QLatin1Char('\n') + m_project->errorString());
+        }
         return;
     }
     m_currentProjectFile = fileName;
-    m_scene->setProject(m_project);
+    attachJournal(fileName);
+    if (m_autoSaver) {
+        m_autoSaver->setProjectFileName(fileName);
+    }
+    updateExportCacheFile();
+    if (!m_project->convertedScriptNodeIds().isEmpty()) {
+        // Reported as an edit, so the journal and auto-save pick up the
+        // converted scripts and the file loses its HTML on the next save.
+        // There is nothing to undo.
+        {
+            ProjectBatch batch(m_project);
+            for (const ObjectId &nodeId : m_project->convertedScriptNodeIds()) {
+                m_project->notifyNodeChanged(nodeId);
+            }
+        }
+        if (m_history) {
+            m_history->clear();
+        }
+        setStatusMessage(QStringLiteral("Legacy scripts converted; save to keep them"), 5000);
+        return;
+    }
     setStatusMessage(QStringLiteral("Project loaded"), 2000);
 }
 
@@ -178,20 +277,117 @@ void MainWindow::saveProject()
 
     QString fileName = m_currentProjectFile;
     if (fileName.isEmpty()) {
-        fileName = QFileDialog::getSaveFileName(this, tr("Save Project"), QString(), tr("Project (*.json)"));
+        fileName = QFileDialog::getSaveFileName(this, tr("Save Project"), QString(),
+                                                tr("Project (*.json);;Binary Project (*.vnb)"));
     }
     if (fileName.isEmpty()) {
         return;
     }
 
+    // The journal would take a damaged script as it is, so stop here rather
+    // than on the next compaction.
+    const QList<ObjectId> damagedIds = m_project->damagedScriptNodeIds();
+    if (!damagedIds.isEmpty()) {
+        QMessageBox::warning(this, tr("Save Failed"),
+                             tr("The scripts of %n node(s) were damaged in the project file. Set them again "
+                                "before saving.", nullptr, int(damagedIds.size())));
+        return;
+    }
+
+    // Saving the open project only marks the journaled edits as saved. The
+    // project file catches up when the journal is compacted in the
+    // background; until then, tools that read the file without its journal
+    // see the state of the last compaction.
+    if (m_journal && m_journal->isOpen() && m_journal->projectFileName() == fileName && m_journal->commit()) {
+        if (m_autoSaver) {
+            m_autoSaver->markSaved();
+        }
+        setStatusMessage(QStringLiteral("Project saved"), 2000);
+        return;
+    }
+
+    if (m_journal) {
+        m_journal->waitForCompaction();
+    }
     if (!m_project->saveToFile(fileName)) {
-        QMessageBox::warning(this, tr("Save Failed"), tr("Unable to write project file."));
+        QMessageBox::warning(this, tr("Save Failed"),
+                             tr("Unable to write project file.") + QLatin1Char('\n') + m_project->errorString());
         return;
     }
     m_currentProjectFile = fileName;
+    if (m_journal) {
+        m_journal->create(fileName);
+    }
+    if (m_autoSaver) {
+        m_autoSaver->setProjectFileName(fileName);
+    }
+    updateExportCacheFile();
     setStatusMessage(QStringLiteral("Project saved"), 2000);
 }
 
+void MainWindow::editAutoSaveSettings()
+{
+    QSettings settings;
+    AutoSaveSettingsDialog dialog(settings.value(QStringLiteral("autosave/enabled"), true).toBool(),
+                                  settings.value(QStringLiteral("autosave/interval_minutes"), 2).toInt(),
+                                  settings.value(QStringLiteral("autosave/backups"), 3).toInt(), this);
+    if (dialog.exec() != QDialog::Accepted) {
+        return;
+    }
+    settings.setValue(QStringLiteral("autosave/enabled"), dialog.isAutoSaveEnabled());
+    settings.setValue(QStringLiteral("autosave/interval_minutes"), dialog.intervalMinutes());
+    settings.setValue(QStringLiteral("autosave/backups"), dialog.backupCount());
+    applyAutoSaveSettings();
+}
+
+void MainWindow::applyAutoSaveSettings()
+{
+    if (!m_autoSaver) {
+        return;
+    }
+    const QSettings settings;
+    const int minutes = qMax(1, settings.value(QStringLiteral("autosave/interval_minutes"), 2).toInt());
+    m_autoSaver->setInterval(minutes * 60 * 1000);
+    m_autoSaver->setBackupCount(settings.value(QStringLiteral("autosave/backups"), 3).toInt());
+    m_autoSaver->setEnabled(settings.value(QStringLiteral("autosave/enabled"), true).toBool());
+}
+
+void MainWindow::updateExportCacheFile()
+{
+    if (!m_presenter) {
+        return;
+    }
+    const QSettings settings;
+    const bool onDisk = settings.value(QStringLiteral("export/cache_on_disk"), true).toBool();
+    m_presenter->setExportCacheFileName(onDisk && !m_currentProjectFile.isEmpty()
+                                            ? ExportFragmentCache::cacheFileName(m_currentProjectFile)
+                                            : QString());
+}
+
+void MainWindow::attachJournal(const QString &projectFileName)
+{
+    if (!m_journal) {
+        return;
+    }
+    if (!m_journal->open(projectFileName)) {
+        QMessageBox::warning(this, tr("Edit Journal"),
+                             tr("The edit journal of this project could not be used.") + QLatin1Char('\n')
+                                 + m_journal->errorString());
+        if (!m_journal->create(projectFileName)) {
+            return;
+        }
+    }
+    if (m_journal->hasUncommittedRecords()) {
+        const auto answer = QMessageBox::question(
+            this, tr("Recover Changes"), tr("This project has unsaved changes from a previous session. Recover them?"));
+        if (answer == QMessageBox::Yes) {
+            m_journal->recoverUncommitted();
+        } else {
+            m_journal->discardUncommitted();
+        }
+    }
+}
+
 void MainWindow::addNode()
 {
     if (m_presenter) {
@@ -199,6 +395,20 @@ void MainWindow::addNode()
     }
 }
 
+void MainWindow::undo()
+{
+    if (m_history) {
+        m_history->undo();
+    }
+}
+
+void MainWindow::redo()
+{
+    if (m_history) {
+        m_history->redo();
+    }
+}
+
 void MainWindow::deleteSelection()
 {
     if (m_presenter) {
@@ -232,7 +442,21 @@ void MainWindow::exportToRenpy()
     }
 }
 
-void MainWindow::onNodeSelected(const QString &nodeId)
+void MainWindow::exportToRenpyChapters()
+{
+    if (m_presenter) {
+        m_presenter->exportToRenpyChapters();
+    }
+}
+
+void MainWindow::exportJsonAndDialogueSheet()
+{
+    if (m_presenter) {
+        m_presenter->exportJsonAndDialogueSheet();
+    }
+}
+
+void MainWindow::onNodeSelected(const ObjectId &nodeId)
 {
     if (!m_project) {
         return;
@@ -323,6 +547,12 @@ void MainWindow::retranslateUi()
     if (m_editMenu) {
         m_editMenu->setTitle(tr("&Edit"));
     }
+    if (m_undoAction) {
+        m_undoAction->setText(tr("&Undo"));
+    }
+    if (m_redoAction) {
+        m_redoAction->setText(tr("&Redo"));
+    }
     if (m_addNodeAction) {
         m_addNodeAction->setText(tr("Add Node"));
         const QString shortcutText = m_addNodeAction->shortcut().toString(QKeySequence::NativeText);
@@ -355,12 +585,29 @@ void MainWindow::retranslateUi()
         m_exportRenpyAction->setStatusTip(tip);
     }
 
+    if (m_exportRenpyChaptersAction) {
+        m_exportRenpyChaptersAction->setText(tr("Export to Ren'Py Chapters..."));
+        const QString tip = tr("Write one Ren'Py file per chapter, rewriting only files that changed");
+        m_exportRenpyChaptersAction->setToolTip(tip);
+        m_exportRenpyChaptersAction->setStatusTip(tip);
+    }
+
+    if (m_exportJsonAndSheetAction) {
+        m_exportJsonAndSheetAction->setText(tr("Export JSON and Dialogue Sheet..."));
+        const QString tip = tr("Write the story as JSON for web players and a CSV dialogue sheet for translators");
+        m_exportJsonAndSheetAction->setToolTip(tip);
+        m_exportJsonAndSheetAction->setStatusTip(tip);
+    }
+
     if (m_settingsMenu) {
         m_settingsMenu->setTitle(tr("Settings"));
     }
     if (m_languageMenu) {
         m_languageMenu->setTitle(tr("Language"));
     }
+    if (m_autoSaveAction) {
+        m_autoSaveAction->setText(tr("Auto Save..."));
+    }
     if (m_languageEnglishAction) {
         m_languageEnglishAction->setText(tr("English"));
     }
@@ -397,8 +644,8 @@ void MainWindow::openScriptEditorForNode(StoryNode *node)
     const int result = dialog.exec();
     Q_UNUSED(result);
 
-    if (m_scene) {
-        m_scene->refreshNode(node->id());
+    if (m_project) {
+        m_project->notifyNodeChanged(node->id());
     }
     if (m_inspector && m_project) {
         if (StoryNode *updated = m_project->getNode(node->id())) {
@@ -407,7 +654,7 @@ void MainWindow::openScriptEditorForNode(StoryNode *node)
     }
 }
 
-void MainWindow::onNodeDoubleClicked(const QString &nodeId)
+void MainWindow::onNodeDoubleClicked(const ObjectId &nodeId)
 {
     if (!m_project) {
         return;
@@ -435,6 +682,12 @@ QString MainWindow::promptSaveFile(const QString &titleKey, const QString &filte
     return QFileDialog::getSaveFileName(this, tr(titleUtf8.constData()), QString(), tr(filterUtf8.constData()));
 }
 
+QString MainWindow::promptDirectory(const QString &titleKey)
+{
+    const QByteArray titleUtf8 = titleKey.toUtf8();
+    return QFileDialog::getExistingDirectory(this, tr(titleUtf8.constData()));
+}
+
 void MainWindow::showWarningMessage(const QString &titleKey, const QString &messageKey)
 {
     const QByteArray titleUtf8 = titleKey.toUtf8();
@@ -450,6 +703,10 @@ void MainWindow::displayStatusMessage(const QString &key, int timeoutMs)
 void MainWindow::resetProjectFilePath()
 {
     m_currentProjectFile.clear();
+    if (m_autoSaver) {
+        m_autoSaver->setProjectFileName({});
+    }
+    updateExportCacheFile();
 }
 
 namespace {
@@ -461,16 +718,22 @@ public:
     {
     }
 
-    bool update(int current, int total) override
+    void update(int current, int total) override
     {
         if (!m_dialog) {
-            return false;
+            return;
         }
         if (total > 0) {
             m_dialog->setMaximum(total);
         }
         m_dialog->setValue(current);
-        return !m_dialog->wasCanceled();
+    }
+
+    void setCancelHandler(std::function<void()> handler) override
+    {
+        if (m_dialog) {
+            QObject::connect(m_dialog, &QProgressDialog::canceled, m_dialog, std::move(handler));
+        }
     }
 
     void close() override
@@ -506,8 +769,3 @@ std::unique_ptr<gui::presenter::IExportProgressView> MainWindow::createExportPro
 
     return std::make_unique<ProgressDialogHandle>(dialog);
 }
-
-void MainWindow::processEvents()
-{
-    QCoreApplication::processEvents(QEventLoop::AllEvents);
-}
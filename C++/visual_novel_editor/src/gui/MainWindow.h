@@ -12,6 +12,9 @@
 class GraphScene;
 class NodeInspectorWidget;
 class Project;
+class ProjectAutoSaver;
+class ProjectHistory;
+class ProjectJournal;
 class QGraphicsView;
 class QDockWidget;
 class StoryNode;
@@ -36,13 +39,18 @@ private slots:
     void newProject();
     void openProject();
     void saveProject();
+    void undo();
+    void redo();
     void addNode();
     void deleteSelection();
     void editScript();
     void exportToRenpy();
-    void onNodeSelected(const QString &nodeId);
+    void exportToRenpyChapters();
+    void exportJsonAndDialogueSheet();
+    void onNodeSelected(const ObjectId &nodeId);
     void toggleInspectorExpanded(bool expanded);
-    void onNodeDoubleClicked(const QString &nodeId);
+    void onNodeDoubleClicked(const ObjectId &nodeId);
+    void editAutoSaveSettings();
 
 private:
     void createMenus();
@@ -51,17 +59,20 @@ private:
     void retranslateUi();
     void updateLanguageMenuState();
     void openScriptEditorForNode(StoryNode *node);
+    void attachJournal(const QString &projectFileName);
+    void applyAutoSaveSettings();
+    void updateExportCacheFile();
     void setStatusMessage(const QString &key, int timeoutMs = 0);
 
     // gui::presenter::IMainWindowView overrides
     QString promptSaveFile(const QString &titleKey, const QString &filterKey) override;
+    QString promptDirectory(const QString &titleKey) override;
     void showWarningMessage(const QString &titleKey, const QString &messageKey) override;
     void displayStatusMessage(const QString &key, int timeoutMs) override;
     void resetProjectFilePath() override;
     std::unique_ptr<gui::presenter::IExportProgressView> createExportProgressDialog(const QString &titleKey,
                                                                                     const QString &labelKey,
                                                                                     const QString &cancelKey) override;
-    void processEvents() override;
 
     GraphScene *m_scene{nullptr};
     QGraphicsView *m_view{nullptr};
@@ -69,6 +80,9 @@ private:
     QDockWidget *m_inspectorDock{nullptr};
     QWidget *m_previousCentralWidget{nullptr};
     Project *m_project{nullptr};
+    ProjectJournal *m_journal{nullptr};
+    ProjectAutoSaver *m_autoSaver{nullptr};
+    ProjectHistory *m_history{nullptr};
     QString m_currentProjectFile;
     bool m_isInspectorExpanded{false};
 
@@ -83,10 +97,15 @@ private:
     QAction *m_openAction{nullptr};
     QAction *m_saveAction{nullptr};
     QAction *m_exitAction{nullptr};
+    QAction *m_undoAction{nullptr};
+    QAction *m_redoAction{nullptr};
     QAction *m_addNodeAction{nullptr};
     QAction *m_deleteAction{nullptr};
     QAction *m_editScriptAction{nullptr};
     QAction *m_exportRenpyAction{nullptr};
+    QAction *m_exportRenpyChaptersAction{nullptr};
+    QAction *m_exportJsonAndSheetAction{nullptr};
+    QAction *m_autoSaveAction{nullptr};
 
     QActionGroup *m_languageGroup{nullptr};
     QAction *m_languageEnglishAction{nullptr};
@@ -15,10 +15,12 @@
 #include <QKeySequence>
 #include <QLabel>
 #include <QLineEdit>
+#include <QScopedValueRollback>
 #include <QSignalBlocker>
 #include <QSize>
 #include <QTextCharFormat>
 #include <QTextCursor>
+#include <QTextDocument>
 #include <QTextEdit>
 #include <QStyle>
 #include <QToolBar>
@@ -26,6 +28,7 @@
 #include <QVBoxLayout>
 #include <Qt>
 
+#include "model/RichText.h"
 #include "model/StoryNode.h"
 
 NodeInspectorWidget::NodeInspectorWidget(QWidget *parent)
@@ -143,12 +146,27 @@ void NodeInspectorWidget::setExpanded(bool expanded)
     updateExpandButtonAppearance();
 }
 
+void NodeInspectorWidget::reloadNode(const ObjectId &nodeId)
+{
+    if (m_node && !m_isEmittingUpdate && m_node->id() == nodeId) {
+        refresh();
+    }
+}
+
+void NodeInspectorWidget::releaseNode(const ObjectId &nodeId)
+{
+    if (m_node && m_node->id() == nodeId) {
+        setNode(nullptr);
+    }
+}
+
 void NodeInspectorWidget::onTitleEdited(const QString &text)
 {
     if (!m_node) {
         return;
     }
     m_node->setTitle(text);
+    const QScopedValueRollback<bool> guard(m_isEmittingUpdate, true);
     emit nodeUpdated(m_node->id());
 }
 
@@ -157,7 +175,8 @@ void NodeInspectorWidget::onScriptEdited()
     if (!m_node) {
         return;
     }
-    m_node->setScript(m_scriptEdit->toHtml());
+    m_node->setScript(RichText::fromDocument(*m_scriptEdit->document()).toScript());
+    const QScopedValueRollback<bool> guard(m_isEmittingUpdate, true);
     emit nodeUpdated(m_node->id());
 }
 
@@ -243,12 +262,7 @@ void NodeInspectorWidget::refresh()
     const QSignalBlocker blocker2(m_scriptEdit);
     if (m_node) {
         m_titleEdit->setText(m_node->title());
-        const QString script = m_node->script();
-        if (Qt::mightBeRichText(script)) {
-            m_scriptEdit->setHtml(script);
-        } else {
-            m_scriptEdit->setPlainText(script);
-        }
+        RichText::fromScript(m_node->script()).toDocument(m_scriptEdit->document());
     } else {
         m_titleEdit->clear();
         m_scriptEdit->clear();
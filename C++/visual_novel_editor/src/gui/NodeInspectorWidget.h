@@ -25,8 +25,13 @@ public:
     void setNode(StoryNode *node) override;
     void setExpanded(bool expanded) override;
 
+public slots:
+    // Refreshes the fields when the shown node changed elsewhere, e.g. by undo.
+    void reloadNode(const ObjectId &nodeId);
+    void releaseNode(const ObjectId &nodeId);
+
 signals:
-    void nodeUpdated(const QString &nodeId);
+    void nodeUpdated(const ObjectId &nodeId);
     void expandRequested(bool expanded);
 
 private slots:
@@ -64,4 +69,5 @@ private:
     QLabel *m_titleLabel{nullptr};
     bool m_isExpanded{false};
     bool m_blockFormatSignals{false};
+    bool m_isEmittingUpdate{false};
 };
@@ -15,6 +15,7 @@ constexpr qreal kNodeHeight = 80.0;
 NodeItem::NodeItem(StoryNode *node, QGraphicsItem *parent)
     : QGraphicsObject(parent)
     , m_node(node)
+    , m_nodeId(node ? node->id() : ObjectId())
 {
     setFlag(ItemIsMovable, true);
     setFlag(ItemIsSelectable, true);
@@ -43,6 +44,18 @@ void NodeItem::paint(QPainter *painter, const QStyleOptionGraphicsItem *, QWidge
     }
 }
 
+void NodeItem::addEdge(EdgeItem *edge)
+{
+    if (edge && !m_edges.contains(edge)) {
+        m_edges.append(edge);
+    }
+}
+
+void NodeItem::removeEdge(EdgeItem *edge)
+{
+    m_edges.removeOne(edge);
+}
+
 QVariant NodeItem::itemChange(GraphicsItemChange change, const QVariant &value)
 {
     if (change == ItemPositionHasChanged && m_node) {
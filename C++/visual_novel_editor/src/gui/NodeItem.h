@@ -1,9 +1,13 @@
 #pragma once
 
 #include <QGraphicsObject>
+#include <QList>
 #include <QPointF>
 #include <QString>
 
+#include "model/ObjectId.h"
+
+class EdgeItem;
 class StoryNode;
 
 class NodeItem : public QGraphicsObject
@@ -17,10 +21,16 @@ public:
     void paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget = nullptr) override;
 
     StoryNode *storyNode() const { return m_node; }
+    ObjectId nodeId() const { return m_nodeId; }
+
+    // Edges starting or ending at this node; a self-loop is listed once.
+    const QList<EdgeItem *> &edges() const { return m_edges; }
+    void addEdge(EdgeItem *edge);
+    void removeEdge(EdgeItem *edge);
 
 signals:
-    void positionChanged(const QString &nodeId, const QPointF &newPos);
-    void doubleClicked(const QString &nodeId);
+    void positionChanged(const ObjectId &nodeId, const QPointF &newPos);
+    void doubleClicked(const ObjectId &nodeId);
 
 protected:
     QVariant itemChange(GraphicsItemChange change, const QVariant &value) override;
@@ -28,4 +38,6 @@ protected:
 
 private:
     StoryNode *m_node{nullptr};
+    ObjectId m_nodeId;
+    QList<EdgeItem *> m_edges;
 };
@@ -3,10 +3,12 @@
 #include <QDialogButtonBox>
 #include <QEvent>
 #include <QPushButton>
+#include <QTextDocument>
 #include <QTextEdit>
 #include <QVBoxLayout>
 #include <Qt>
 
+#include "model/RichText.h"
 #include "model/StoryNode.h"
 
 ScriptEditorDialog::ScriptEditorDialog(StoryNode *node, QWidget *parent)
@@ -24,12 +26,7 @@ ScriptEditorDialog::ScriptEditorDialog(StoryNode *node, QWidget *parent)
     connect(m_buttonBox, &QDialogButtonBox::rejected, this, &ScriptEditorDialog::reject);
 
     if (m_node) {
-        const QString script = m_node->script();
-        if (Qt::mightBeRichText(script)) {
-            m_editor->setHtml(script);
-        } else {
-            m_editor->setPlainText(script);
-        }
+        RichText::fromScript(m_node->script()).toDocument(m_editor->document());
     }
 
     retranslateUi();
@@ -38,7 +35,7 @@ ScriptEditorDialog::ScriptEditorDialog(StoryNode *node, QWidget *parent)
 void ScriptEditorDialog::accept()
 {
     if (m_node) {
-        m_node->setScript(m_editor->toHtml());
+        m_node->setScript(RichText::fromDocument(*m_editor->document()).toScript());
     }
     QDialog::accept();
 }
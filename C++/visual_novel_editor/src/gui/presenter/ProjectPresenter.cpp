@@ -1,27 +1,62 @@
 #include "ProjectPresenter.h"
 
+#include <QDir>
 #include <QObject>
-#include <QStringList>
+#include <QPromise>
+#include <QSet>
+#include <QtConcurrentRun>
 
+#include <utility>
+
+#include "export/CsvBackend.h"
+#include "export/ExportFragmentCache.h"
+#include "export/ExportIr.h"
 #include "export/ExporterRenpy.h"
+#include "export/JsonBackend.h"
 #include "model/Project.h"
 #include "model/StoryNode.h"
 
 namespace gui::presenter {
 
+namespace {
+// Keeps a chapter file small enough that Ren'Py recompiles it quickly.
+constexpr int kLabelsPerChapterFile = 500;
+constexpr char kJsonFileName[] = "story.json";
+constexpr char kDialogueSheetFileName[] = "dialogue.csv";
+}
+
 ProjectPresenter::ProjectPresenter(IMainWindowView &mainWindowView,
                                    IGraphSceneView &graphSceneView,
                                    INodeInspectorView &inspectorView)
     : m_mainWindowView(mainWindowView)
     , m_graphSceneView(graphSceneView)
     , m_inspectorView(inspectorView)
+    , m_exportCache(std::make_shared<ExportFragmentCache>())
 {
 }
 
+ProjectPresenter::~ProjectPresenter()
+{
+    if (m_exportWatcher) {
+        m_exportWatcher->cancel();
+        m_exportWatcher->waitForFinished();
+    }
+}
+
 void ProjectPresenter::setProject(Project *project)
 {
     m_project = project;
     m_graphSceneView.setProject(m_project);
+    m_exportCache = std::make_shared<ExportFragmentCache>();
+}
+
+void ProjectPresenter::setExportCacheFileName(const QString &fileName)
+{
+    if (fileName == m_exportCacheFileName) {
+        return;
+    }
+    m_exportCacheFileName = fileName;
+    m_exportCache = std::make_shared<ExportFragmentCache>();
 }
 
 void ProjectPresenter::newProject()
@@ -31,7 +66,7 @@ void ProjectPresenter::newProject()
     }
 
     m_project->clear();
-    m_graphSceneView.setProject(m_project);
+    m_exportCache = std::make_shared<ExportFragmentCache>();
     m_mainWindowView.resetProjectFilePath();
     m_mainWindowView.displayStatusMessage(QStringLiteral("Created new project"), 2000);
 }
@@ -42,12 +77,14 @@ void ProjectPresenter::addNode()
         return;
     }
 
-    StoryNode *node = m_project->addNode(StoryNode::Type::Dialogue);
-    if (node) {
-        node->setTitle(QObject::tr("Dialogue"));
-        node->setScript(QObject::tr("# dialogue script"));
+    {
+        ProjectBatch batch(m_project);
+        StoryNode *node = m_project->addNode(StoryNode::Type::Dialogue);
+        if (node) {
+            node->setTitle(QObject::tr("Dialogue"));
+            node->setScript(QObject::tr("# dialogue script"));
+        }
     }
-    m_graphSceneView.setProject(m_project);
     m_mainWindowView.displayStatusMessage(QStringLiteral("Node added"), 1500);
 }
 
@@ -57,21 +94,17 @@ void ProjectPresenter::deleteSelection()
         return;
     }
 
-    const QStringList selectedIds = m_graphSceneView.selectedNodeIds();
+    const QList<ObjectId> selectedIds = m_graphSceneView.selectedNodeIds();
     if (selectedIds.isEmpty()) {
         return;
     }
 
-    for (const QString &id : selectedIds) {
-        m_project->removeNode(id);
-    }
-
-    m_graphSceneView.setProject(m_project);
+    m_project->removeNodes(QSet<ObjectId>(selectedIds.cbegin(), selectedIds.cend()));
 }
 
 void ProjectPresenter::exportToRenpy()
 {
-    if (!m_project) {
+    if (!m_project || isExporting()) {
         return;
     }
 
@@ -82,45 +115,156 @@ void ProjectPresenter::exportToRenpy()
         return;
     }
 
-    auto progressDialog = m_mainWindowView.createExportProgressDialog(
-        QStringLiteral("Exporting"),
-        QStringLiteral("Exporting Ren'Py script..."),
-        QStringLiteral("Cancel"));
+    startExport([fileName](ExporterRenpy &exporter) { return exporter.exportToFile(fileName); });
+}
+
+void ProjectPresenter::exportToRenpyChapters()
+{
+    if (!m_project || isExporting()) {
+        return;
+    }
+
+    const QString directory = m_mainWindowView.promptDirectory(QStringLiteral("Export Ren'Py Chapters"));
+    if (directory.isEmpty()) {
+        return;
+    }
 
-    ExporterRenpy exporter(m_project);
-    const QStringList selectedNodeIds = m_graphSceneView.selectedNodeIds();
+    startExport([directory](ExporterRenpy &exporter) {
+        exporter.setMaxLabelsPerFile(kLabelsPerChapterFile);
+        return exporter.exportToDirectory(directory);
+    });
+}
+
+void ProjectPresenter::exportJsonAndDialogueSheet()
+{
+    if (!m_project || isExporting()) {
+        return;
+    }
+
+    const QString directory = m_mainWindowView.promptDirectory(QStringLiteral("Export JSON and Dialogue Sheet"));
+    if (directory.isEmpty()) {
+        return;
+    }
+
+    const QFuture<bool> future = QtConcurrent::run(
+        [snapshot = m_project->snapshot(), selectedNodeIds = m_graphSceneView.selectedNodeIds(),
+         directory](QPromise<bool> &promise) {
+            // Built once; both backends read it at the same time.
+            const ExportIr ir = ExportIr::build(snapshot, selectedNodeIds);
+            if (promise.isCanceled()) {
+                return;
+            }
+            const JsonBackend json;
+            const CsvBackend csv;
+            const QDir dir(directory);
+            promise.addResult(ExportBackend::writeAll(
+                ir, {{&json, dir.filePath(QLatin1String(kJsonFileName))},
+                     {&csv, dir.filePath(QLatin1String(kDialogueSheetFileName))}}));
+        });
+    watchExport(future, QStringLiteral("Exporting JSON and dialogue sheet..."),
+                QStringLiteral("Could not export JSON and dialogue sheet."),
+                QStringLiteral("Exported JSON and dialogue sheet"));
+}
+
+void ProjectPresenter::startExport(std::function<bool(ExporterRenpy &)> run)
+{
+    ExporterRenpy exporter(m_project->snapshot());
+    const QList<ObjectId> selectedNodeIds = m_graphSceneView.selectedNodeIds();
     if (!selectedNodeIds.isEmpty()) {
         exporter.setSelectedNodeIds(selectedNodeIds);
     }
 
-    exporter.setProgressCallback([&](int current, int total) {
-        if (progressDialog) {
-            if (!progressDialog->update(current, total)) {
-                return false;
+    const QFuture<bool> future = QtConcurrent::run(
+        [exporter = std::move(exporter), run = std::move(run), cache = m_exportCache,
+         cacheFileName = m_exportCacheFileName](QPromise<bool> &promise) mutable {
+            // Read lazily, so opening a project never waits for its cache.
+            if (cache->size() == 0 && !cacheFileName.isEmpty()) {
+                cache->load(cacheFileName);
+            }
+            exporter.setFragmentCache(cache.get());
+            int total = -1;
+            exporter.setProgressCallback([&promise, &total](int current, int newTotal) {
+                if (newTotal != total) {
+                    total = newTotal;
+                    promise.setProgressRange(0, total);
+                }
+                promise.setProgressValue(current);
+                return !promise.isCanceled();
+            });
+            const bool exported = run(exporter);
+            if (exported && !cacheFileName.isEmpty()) {
+                // A stale or missing cache file only costs the next session
+                // a full export.
+                cache->save(cacheFileName);
             }
+            promise.addResult(exported);
+        });
+    watchExport(future, QStringLiteral("Exporting Ren'Py script..."), QStringLiteral("Could not export Ren'Py script."),
+                QStringLiteral("Exported to Ren'Py"));
+}
+
+void ProjectPresenter::watchExport(const QFuture<bool> &future, const QString &labelKey, const QString &failedKey,
+                                   const QString &exportedKey)
+{
+    m_exportFailedKey = failedKey;
+    m_exportedKey = exportedKey;
+    m_exportProgress =
+        m_mainWindowView.createExportProgressDialog(QStringLiteral("Exporting"), labelKey, QStringLiteral("Cancel"));
+
+    m_exportWatcher = std::make_unique<QFutureWatcher<bool>>();
+    QFutureWatcher<bool> *watcher = m_exportWatcher.get();
+    if (m_exportProgress) {
+        m_exportProgress->setCancelHandler([watcher]() { watcher->cancel(); });
+    }
+    // QFuture limits progress signals to a few dozen per second however
+    // often the exporter reports.
+    QObject::connect(watcher, &QFutureWatcherBase::progressValueChanged, watcher, [this, watcher](int value) {
+        if (m_exportProgress) {
+            m_exportProgress->update(value, watcher->progressMaximum());
         }
-        m_mainWindowView.processEvents();
-        return true;
     });
+    QObject::connect(watcher, &QFutureWatcherBase::finished, watcher, [this]() { finishExport(); });
+    watcher->setFuture(future);
+}
 
-    const bool exportResult = exporter.exportToFile(fileName);
+void ProjectPresenter::waitForExport()
+{
+    if (m_exportWatcher) {
+        m_exportWatcher->waitForFinished();
+        finishExport();
+    }
+}
+
+void ProjectPresenter::finishExport()
+{
+    if (!m_exportWatcher) {
+        return;
+    }
+    // This may run from the watcher's own finished signal.
+    QFutureWatcher<bool> *watcher = m_exportWatcher.release();
+    QObject::disconnect(watcher, nullptr, nullptr, nullptr);
+    watcher->deleteLater();
+    // Read before closing the progress view, which may report a cancel.
+    const QFuture<bool> future = watcher->future();
+    const bool wasCanceled = future.isCanceled();
+    const bool succeeded = !wasCanceled && future.resultCount() > 0 && future.result();
 
-    if (progressDialog) {
-        progressDialog->close();
+    if (m_exportProgress) {
+        m_exportProgress->close();
+        m_exportProgress.reset();
     }
 
-    if (exporter.wasCanceled()) {
+    if (wasCanceled) {
         m_mainWindowView.displayStatusMessage(QStringLiteral("Export canceled"), 2000);
         return;
     }
 
-    if (!exportResult) {
-        m_mainWindowView.showWarningMessage(QStringLiteral("Export Failed"),
-                                            QStringLiteral("Could not export Ren'Py script."));
+    if (!succeeded) {
+        m_mainWindowView.showWarningMessage(QStringLiteral("Export Failed"), m_exportFailedKey);
         return;
     }
 
-    m_mainWindowView.displayStatusMessage(QStringLiteral("Exported to Ren'Py"), 2000);
+    m_mainWindowView.displayStatusMessage(m_exportedKey, 2000);
 }
 
 } // namespace gui::presenter
@@ -1,7 +1,16 @@
 #pragma once
 
+#include <QFuture>
+#include <QFutureWatcher>
+#include <QString>
+
+#include <functional>
+#include <memory>
+
 #include "ViewInterfaces.h"
 
+class ExportFragmentCache;
+class ExporterRenpy;
 class Project;
 
 namespace gui::presenter {
@@ -12,19 +21,47 @@ public:
     ProjectPresenter(IMainWindowView &mainWindowView,
                      IGraphSceneView &graphSceneView,
                      INodeInspectorView &inspectorView);
+    ~ProjectPresenter();
 
     void setProject(Project *project);
+    // Where exports keep their fragment cache between sessions; empty keeps
+    // it in memory only. A different file starts a new cache.
+    void setExportCacheFileName(const QString &fileName);
 
     void newProject();
     void addNode();
     void deleteSelection();
+    // Exports a snapshot of the project on a worker thread and returns at
+    // once; the outcome is reported when the export finishes.
     void exportToRenpy();
+    // The same, into one file per chapter of a chosen directory.
+    void exportToRenpyChapters();
+    // Writes story.json for web players and dialogue.csv for translators
+    // into a chosen directory, both from one ExportIr.
+    void exportJsonAndDialogueSheet();
+    [[nodiscard]] bool isExporting() const { return m_exportWatcher != nullptr; }
+    // Blocks until a running export finished and reports its outcome.
+    void waitForExport();
 
 private:
+    void startExport(std::function<bool(ExporterRenpy &)> run);
+    void watchExport(const QFuture<bool> &future, const QString &labelKey, const QString &failedKey,
+                     const QString &exportedKey);
+    void finishExport();
+
     Project *m_project{nullptr};
     IMainWindowView &m_mainWindowView;
     IGraphSceneView &m_graphSceneView;
     INodeInspectorView &m_inspectorView;
+    std::unique_ptr<QFutureWatcher<bool>> m_exportWatcher;
+    std::unique_ptr<IExportProgressView> m_exportProgress;
+    // Message keys reported when the running export finishes.
+    QString m_exportFailedKey;
+    QString m_exportedKey;
+    // Shared with the running export, so replacing it never pulls the cache
+    // from under the worker thread.
+    std::shared_ptr<ExportFragmentCache> m_exportCache;
+    QString m_exportCacheFileName;
 };
 
 } // namespace gui::presenter
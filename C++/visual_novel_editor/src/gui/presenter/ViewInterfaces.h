@@ -1,9 +1,12 @@
 #pragma once
 
+#include <functional>
 #include <memory>
 
+#include <QList>
 #include <QString>
-#include <QStringList>
+
+#include "model/ObjectId.h"
 
 class Project;
 class StoryNode;
@@ -14,7 +17,9 @@ class IExportProgressView
 {
 public:
     virtual ~IExportProgressView() = default;
-    virtual bool update(int current, int total) = 0;
+    virtual void update(int current, int total) = 0;
+    // Called on the GUI thread when the user asks to cancel.
+    virtual void setCancelHandler(std::function<void()> handler) = 0;
     virtual void close() = 0;
 };
 
@@ -23,13 +28,13 @@ class IMainWindowView
 public:
     virtual ~IMainWindowView() = default;
     virtual QString promptSaveFile(const QString &titleKey, const QString &filterKey) = 0;
+    virtual QString promptDirectory(const QString &titleKey) = 0;
     virtual void showWarningMessage(const QString &titleKey, const QString &messageKey) = 0;
     virtual void displayStatusMessage(const QString &key, int timeoutMs) = 0;
     virtual void resetProjectFilePath() = 0;
     virtual std::unique_ptr<IExportProgressView> createExportProgressDialog(const QString &titleKey,
                                                                             const QString &labelKey,
                                                                             const QString &cancelKey) = 0;
-    virtual void processEvents() = 0;
 };
 
 class IGraphSceneView
@@ -37,7 +42,7 @@ class IGraphSceneView
 public:
     virtual ~IGraphSceneView() = default;
     virtual void setProject(Project *project) = 0;
-    virtual QStringList selectedNodeIds() const = 0;
+    virtual QList<ObjectId> selectedNodeIds() const = 0;
 };
 
 class INodeInspectorView
@@ -7,6 +7,8 @@
 int main(int argc, char *argv[])
 {
     QApplication app(argc, argv);
+    QCoreApplication::setOrganizationName(QStringLiteral("VisualNovelEditor"));
+    QCoreApplication::setApplicationName(QStringLiteral("visual_novel_editor"));
 
     LanguageManager::instance().initialize(&app);
 
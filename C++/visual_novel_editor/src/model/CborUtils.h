@@ -0,0 +1,82 @@
+#pragma once
+
+#include <QByteArray>
+#include <QCborStreamReader>
+#include <QString>
+
+#include "ObjectId.h"
+
+// Small readers for the CBOR records of .vnb files and journals. Each one
+// consumes the current item and returns false when it has a different type.
+
+inline bool readCborUnsigned(QCborStreamReader &cbor, quint64 &value)
+{
+    if (!cbor.isUnsignedInteger()) {
+        return false;
+    }
+    value = cbor.toUnsignedInteger();
+    return cbor.next();
+}
+
+inline bool readCborDouble(QCborStreamReader &cbor, double &value)
+{
+    if (!cbor.isDouble()) {
+        return false;
+    }
+    value = cbor.toDouble();
+    return cbor.next();
+}
+
+inline bool readCborText(QCborStreamReader &cbor, QString &value)
+{
+    if (!cbor.isString()) {
+        return false;
+    }
+    value.clear();
+    auto chunk = cbor.readString();
+    while (chunk.status == QCborStreamReader::Ok) {
+        value += chunk.data;
+        chunk = cbor.readString();
+    }
+    return chunk.status == QCborStreamReader::EndOfString;
+}
+
+inline bool readCborBytes(QCborStreamReader &cbor, QByteArray &value)
+{
+    if (!cbor.isByteArray()) {
+        return false;
+    }
+    value.clear();
+    auto chunk = cbor.readByteArray();
+    while (chunk.status == QCborStreamReader::Ok) {
+        value += chunk.data;
+        chunk = cbor.readByteArray();
+    }
+    return chunk.status == QCborStreamReader::EndOfString;
+}
+
+inline bool readCborId(QCborStreamReader &cbor, ObjectId &value)
+{
+    QString text;
+    if (!readCborText(cbor, text)) {
+        return false;
+    }
+    value = ObjectId::fromString(text);
+    return true;
+}
+
+inline bool enterCborArray(QCborStreamReader &cbor)
+{
+    return cbor.isArray() && cbor.enterContainer();
+}
+
+// Skips fields appended by newer writers.
+inline bool leaveCborArray(QCborStreamReader &cbor)
+{
+    while (cbor.hasNext()) {
+        if (!cbor.next()) {
+            return false;
+        }
+    }
+    return cbor.leaveContainer();
+}
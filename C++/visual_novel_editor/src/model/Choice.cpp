@@ -3,9 +3,9 @@
 QJsonObject Choice::toJson() const
 {
     QJsonObject obj;
-    obj[QStringLiteral("id")] = id;
+    obj[QStringLiteral("id")] = id.toString();
     obj[QStringLiteral("text")] = text;
-    obj[QStringLiteral("target")] = targetNodeId;
+    obj[QStringLiteral("target")] = targetNodeId.toString();
     if (condition.has_value()) {
         obj[QStringLiteral("condition")] = *condition;
     }
@@ -15,9 +15,9 @@ QJsonObject Choice::toJson() const
 Choice Choice::fromJson(const QJsonObject &obj)
 {
     Choice choice;
-    choice.id = obj.value(QStringLiteral("id")).toString();
+    choice.id = ObjectId::fromString(obj.value(QStringLiteral("id")).toString());
     choice.text = obj.value(QStringLiteral("text")).toString();
-    choice.targetNodeId = obj.value(QStringLiteral("target")).toString();
+    choice.targetNodeId = ObjectId::fromString(obj.value(QStringLiteral("target")).toString());
     if (obj.contains(QStringLiteral("condition"))) {
         choice.condition = obj.value(QStringLiteral("condition")).toString();
     }
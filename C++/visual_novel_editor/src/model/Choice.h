@@ -4,12 +4,20 @@
 #include <QString>
 #include <optional>
 
+#include "ObjectId.h"
+
 struct Choice {
-    QString id;
+    ObjectId id;
     QString text;
-    QString targetNodeId;
+    ObjectId targetNodeId;
     std::optional<QString> condition;
 
     [[nodiscard]] QJsonObject toJson() const;
     static Choice fromJson(const QJsonObject &obj);
+
+    friend bool operator==(const Choice &a, const Choice &b)
+    {
+        return a.id == b.id && a.text == b.text && a.targetNodeId == b.targetNodeId && a.condition == b.condition;
+    }
+    friend bool operator!=(const Choice &a, const Choice &b) { return !(a == b); }
 };
@@ -0,0 +1,31 @@
+#include "Crc32.h"
+
+#include <array>
+
+namespace {
+constexpr quint32 kPolynomial = 0xEDB88320u;
+
+constexpr std::array<quint32, 256> makeTable()
+{
+    std::array<quint32, 256> table{};
+    for (quint32 i = 0; i < 256; ++i) {
+        quint32 value = i;
+        for (int bit = 0; bit < 8; ++bit) {
+            value = (value & 1u) ? (value >> 1) ^ kPolynomial : value >> 1;
+        }
+        table[i] = value;
+    }
+    return table;
+}
+
+constexpr std::array<quint32, 256> kTable = makeTable();
+}
+
+quint32 crc32(QByteArrayView data, quint32 crc)
+{
+    crc = ~crc;
+    for (const char byte : data) {
+        crc = kTable[(crc ^ static_cast<uchar>(byte)) & 0xFFu] ^ (crc >> 8);
+    }
+    return ~crc;
+}
@@ -0,0 +1,7 @@
+#pragma once
+
+#include <QByteArrayView>
+#include <QtGlobal>
+
+// CRC-32 (IEEE 802.3, as used by zlib and PNG).
+[[nodiscard]] quint32 crc32(QByteArrayView data, quint32 crc = 0);
@@ -0,0 +1,388 @@
+#include "JsonStreamReader.h"
+
+#include <QIODevice>
+
+namespace {
+constexpr qint64 kChunkSize = 64 * 1024;
+
+void appendUtf8(QByteArray &out, char32_t codePoint)
+{
+    if (codePoint < 0x80) {
+        out.append(static_cast<char>(codePoint));
+    } else if (codePoint < 0x800) {
+        out.append(static_cast<char>(0xC0 | (codePoint >> 6)));
+        out.append(static_cast<char>(0x80 | (codePoint & 0x3F)));
+    } else if (codePoint < 0x10000) {
+        out.append(static_cast<char>(0xE0 | (codePoint >> 12)));
+        out.append(static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F)));
+        out.append(static_cast<char>(0x80 | (codePoint & 0x3F)));
+    } else {
+        out.append(static_cast<char>(0xF0 | (codePoint >> 18)));
+        out.append(static_cast<char>(0x80 | ((codePoint >> 12) & 0x3F)));
+        out.append(static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F)));
+        out.append(static_cast<char>(0x80 | (codePoint & 0x3F)));
+    }
+}
+} // namespace
+
+JsonStreamReader::JsonStreamReader(QIODevice *device)
+    : m_device(device)
+{
+}
+
+JsonStreamReader::Token JsonStreamReader::readNext()
+{
+    if (hasError()) {
+        return Token::Invalid;
+    }
+
+    if (m_token == Token::None) {
+        skipByteOrderMark();
+    }
+    skipWhitespace();
+
+    if (m_stack.isEmpty()) {
+        if (!m_done) {
+            m_token = readValue();
+            return m_token;
+        }
+        if (peekChar() >= 0) {
+            return fail(QStringLiteral("Unexpected data after the end of the document"));
+        }
+        m_token = Token::EndDocument;
+        return m_token;
+    }
+
+    Frame &frame = m_stack.last();
+    if (frame.isObject && m_afterName) {
+        m_afterName = false;
+        m_token = readValue();
+        return m_token;
+    }
+
+    const bool isObject = frame.isObject;
+    if (peekChar() == (isObject ? '}' : ']')) {
+        takeChar();
+        m_stack.removeLast();
+        m_done = m_stack.isEmpty();
+        m_token = isObject ? Token::EndObject : Token::EndArray;
+        return m_token;
+    }
+    if (!frame.first) {
+        if (!expectChar(',')) {
+            return Token::Invalid;
+        }
+        skipWhitespace();
+    }
+    frame.first = false;
+
+    if (!isObject) {
+        m_token = readValue();
+        return m_token;
+    }
+
+    if (peekChar() != '"') {
+        return fail(QStringLiteral("Expected an object member name"));
+    }
+    if (!readString()) {
+        return Token::Invalid;
+    }
+    skipWhitespace();
+    if (!expectChar(':')) {
+        return Token::Invalid;
+    }
+    m_afterName = true;
+    m_token = Token::Name;
+    return m_token;
+}
+
+bool JsonStreamReader::skipCurrent()
+{
+    int depth = 0;
+    Token token = m_token;
+    while (true) {
+        switch (token) {
+        case Token::BeginObject:
+        case Token::BeginArray:
+            ++depth;
+            break;
+        case Token::EndObject:
+        case Token::EndArray:
+            --depth;
+            break;
+        case Token::Invalid:
+        case Token::EndDocument:
+            return false;
+        default:
+            break;
+        }
+        if (depth <= 0) {
+            return true;
+        }
+        token = readNext();
+    }
+}
+
+bool JsonStreamReader::skipValue()
+{
+    readNext();
+    return skipCurrent();
+}
+
+int JsonStreamReader::peekChar()
+{
+    if (m_pos >= m_buffer.size() && !fillBuffer()) {
+        return -1;
+    }
+    return static_cast<unsigned char>(m_buffer.at(m_pos));
+}
+
+int JsonStreamReader::takeChar()
+{
+    const int c = peekChar();
+    if (c >= 0) {
+        ++m_pos;
+    }
+    return c;
+}
+
+bool JsonStreamReader::fillBuffer()
+{
+    if (!m_device) {
+        return false;
+    }
+    m_bufferOffset += m_buffer.size();
+    m_buffer = m_device->read(kChunkSize);
+    m_pos = 0;
+    return !m_buffer.isEmpty();
+}
+
+void JsonStreamReader::skipByteOrderMark()
+{
+    // QJsonDocument accepts a UTF-8 BOM, and some Windows editors add one.
+    for (const unsigned char expected : {0xEF, 0xBB, 0xBF}) {
+        if (peekChar() != expected) {
+            return;
+        }
+        ++m_pos;
+    }
+}
+
+void JsonStreamReader::skipWhitespace()
+{
+    while (true) {
+        const int c = peekChar();
+        if (c != ' ' && c != '\n' && c != '\r' && c != '\t') {
+            return;
+        }
+        ++m_pos;
+    }
+}
+
+bool JsonStreamReader::expectChar(char expected)
+{
+    const int c = takeChar();
+    if (c != static_cast<unsigned char>(expected)) {
+        fail(c < 0 ? QStringLiteral("Unexpected end of file")
+                   : QStringLiteral("Expected '%1'").arg(QLatin1Char(expected)));
+        return false;
+    }
+    return true;
+}
+
+JsonStreamReader::Token JsonStreamReader::readValue()
+{
+    const int c = peekChar();
+    switch (c) {
+    case '{':
+        takeChar();
+        m_stack.append(Frame{true, true});
+        return Token::BeginObject;
+    case '[':
+        takeChar();
+        m_stack.append(Frame{false, true});
+        return Token::BeginArray;
+    case '"':
+        if (!readString()) {
+            return Token::Invalid;
+        }
+        m_done = m_stack.isEmpty();
+        return Token::String;
+    case 't':
+        return readLiteral("true", Token::Bool, true);
+    case 'f':
+        return readLiteral("false", Token::Bool, false);
+    case 'n':
+        return readLiteral("null", Token::Null, false);
+    case -1:
+        return fail(QStringLiteral("Unexpected end of file"));
+    default:
+        if (c == '-' || (c >= '0' && c <= '9')) {
+            return readNumber();
+        }
+        return fail(QStringLiteral("Unexpected character '%1'").arg(QChar(c)));
+    }
+}
+
+JsonStreamReader::Token JsonStreamReader::readLiteral(const char *literal, Token token, bool value)
+{
+    for (const char *p = literal; *p; ++p) {
+        if (takeChar() != static_cast<unsigned char>(*p)) {
+            return fail(QStringLiteral("Invalid literal"));
+        }
+    }
+    m_bool = value;
+    m_done = m_stack.isEmpty();
+    return token;
+}
+
+JsonStreamReader::Token JsonStreamReader::readNumber()
+{
+    QByteArray text;
+    while (true) {
+        const int c = peekChar();
+        if ((c >= '0' && c <= '9') || c == '-' || c == '+' || c == '.' || c == 'e' || c == 'E') {
+            text.append(static_cast<char>(c));
+            ++m_pos;
+        } else {
+            break;
+        }
+    }
+    bool ok = false;
+    m_number = text.toDouble(&ok);
+    if (!ok) {
+        return fail(QStringLiteral("Invalid number"));
+    }
+    m_done = m_stack.isEmpty();
+    return Token::Number;
+}
+
+bool JsonStreamReader::readString()
+{
+    takeChar(); // opening quote
+    QByteArray utf8;
+    while (true) {
+        if (m_pos >= m_buffer.size() && !fillBuffer()) {
+            fail(QStringLiteral("Unterminated string"));
+            return false;
+        }
+        // Copy the longest run of plain characters in one go.
+        const char *data = m_buffer.constData();
+        const qsizetype size = m_buffer.size();
+        qsizetype end = m_pos;
+        while (end < size) {
+            const unsigned char c = static_cast<unsigned char>(data[end]);
+            if (c == '"' || c == '\\' || c < 0x20) {
+                break;
+            }
+            ++end;
+        }
+        utf8.append(data + m_pos, end - m_pos);
+        m_pos = end;
+        if (m_pos >= size) {
+            continue;
+        }
+
+        const unsigned char c = static_cast<unsigned char>(data[m_pos++]);
+        if (c == '"') {
+            break;
+        }
+        if (c < 0x20) {
+            fail(QStringLiteral("Control character in string"));
+            return false;
+        }
+        if (!appendEscape(utf8, takeChar())) {
+            return false;
+        }
+    }
+    m_string = QString::fromUtf8(utf8);
+    return true;
+}
+
+bool JsonStreamReader::appendEscape(QByteArray &utf8, int c)
+{
+    switch (c) {
+    case '"':
+    case '\\':
+    case '/':
+        utf8.append(static_cast<char>(c));
+        return true;
+    case 'b':
+        utf8.append('\b');
+        return true;
+    case 'f':
+        utf8.append('\f');
+        return true;
+    case 'n':
+        utf8.append('\n');
+        return true;
+    case 'r':
+        utf8.append('\r');
+        return true;
+    case 't':
+        utf8.append('\t');
+        return true;
+    case 'u': {
+        char32_t codePoint = 0;
+        if (!readHex4(codePoint)) {
+            return false;
+        }
+        if (codePoint >= 0xD800 && codePoint <= 0xDBFF && peekChar() == '\\') {
+            takeChar();
+            const int next = takeChar();
+            if (next != 'u') {
+                // Lone high surrogate followed by an ordinary escape.
+                appendUtf8(utf8, 0xFFFD);
+                return appendEscape(utf8, next);
+            }
+            char32_t low = 0;
+            if (!readHex4(low)) {
+                return false;
+            }
+            if (low >= 0xDC00 && low <= 0xDFFF) {
+                appendUtf8(utf8, 0x10000 + ((codePoint - 0xD800) << 10) + (low - 0xDC00));
+                return true;
+            }
+            appendUtf8(utf8, 0xFFFD);
+            codePoint = low;
+        }
+        if (codePoint >= 0xD800 && codePoint <= 0xDFFF) {
+            codePoint = 0xFFFD;
+        }
+        appendUtf8(utf8, codePoint);
+        return true;
+    }
+    default:
+        fail(QStringLiteral("Invalid escape sequence"));
+        return false;
+    }
+}
+
+bool JsonStreamReader::readHex4(char32_t &value)
+{
+    value = 0;
+    for (int i = 0; i < 4; ++i) {
+        const int c = takeChar();
+        value <<= 4;
+        if (c >= '0' && c <= '9') {
+            value |= static_cast<char32_t>(c - '0');
+        } else if (c >= 'a' && c <= 'f') {
+            value |= static_cast<char32_t>(c - 'a' + 10);
+        } else if (c >= 'A' && c <= 'F') {
+            value |= static_cast<char32_t>(c - 'A' + 10);
+        } else {
+            fail(QStringLiteral("Invalid unicode escape"));
+            return false;
+        }
+    }
+    return true;
+}
+
+JsonStreamReader::Token JsonStreamReader::fail(const QString &message)
+{
+    if (m_errorString.isEmpty()) {
+        m_errorString = QStringLiteral("%1 at offset %2").arg(message).arg(bytesRead());
+    }
+    m_token = Token::Invalid;
+    return m_token;
+}
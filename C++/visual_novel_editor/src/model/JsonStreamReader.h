@@ -0,0 +1,67 @@
+#pragma once
+
+#include <QByteArray>
+#include <QList>
+#include <QString>
+
+class QIODevice;
+
+// Incremental JSON tokenizer reading a QIODevice in fixed-size chunks, so a
+// document never has to be held in memory as a whole.
+class JsonStreamReader
+{
+public:
+    enum class Token { None, BeginObject, EndObject, BeginArray, EndArray, Name, String, Number, Bool, Null, EndDocument, Invalid };
+
+    explicit JsonStreamReader(QIODevice *device);
+
+    Token readNext();
+    // Skips the rest of the value whose first token was just read.
+    bool skipCurrent();
+    // Reads and discards the next value, including nested containers.
+    bool skipValue();
+
+    [[nodiscard]] Token tokenType() const { return m_token; }
+    [[nodiscard]] const QString &name() const { return m_string; }
+    [[nodiscard]] const QString &stringValue() const { return m_string; }
+    [[nodiscard]] double numberValue() const { return m_number; }
+    [[nodiscard]] bool boolValue() const { return m_bool; }
+
+    [[nodiscard]] bool hasError() const { return !m_errorString.isEmpty(); }
+    [[nodiscard]] QString errorString() const { return m_errorString; }
+    [[nodiscard]] qint64 bytesRead() const { return m_bufferOffset + m_pos; }
+
+private:
+    struct Frame {
+        bool isObject{false};
+        bool first{true};
+    };
+
+    int peekChar();
+    int takeChar();
+    bool fillBuffer();
+    void skipByteOrderMark();
+    void skipWhitespace();
+    bool expectChar(char expected);
+    Token readValue();
+    Token readLiteral(const char *literal, Token token, bool value);
+    Token readNumber();
+    bool readString();
+    bool appendEscape(QByteArray &utf8, int c);
+    bool readHex4(char32_t &value);
+    Token fail(const QString &message);
+
+    QIODevice *m_device{nullptr};
+    QByteArray m_buffer;
+    qsizetype m_pos{0};
+    qint64 m_bufferOffset{0};
+    QList<Frame> m_stack;
+    bool m_afterName{false};
+    bool m_done{false};
+
+    Token m_token{Token::None};
+    QString m_string;
+    double m_number{0.0};
+    bool m_bool{false};
+    QString m_errorString;
+};
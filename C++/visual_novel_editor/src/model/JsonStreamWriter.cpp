@@ -0,0 +1,210 @@
+#include "JsonStreamWriter.h"
+
+#include <QIODevice>
+#include <QLocale>
+
+#include <cmath>
+
+namespace {
+constexpr qsizetype kFlushThreshold = 64 * 1024;
+constexpr double kMaxExactInteger = 9007199254740992.0; // 2^53
+
+char hexDigit(int value)
+{
+    return static_cast<char>(value < 10 ? '0' + value : 'a' + value - 10);
+}
+} // namespace
+
+JsonStreamWriter::JsonStreamWriter(QIODevice *device, QJsonDocument::JsonFormat format)
+    : m_device(device)
+    , m_compact(format == QJsonDocument::Compact)
+{
+    m_buffer.reserve(kFlushThreshold + 4096);
+}
+
+void JsonStreamWriter::beginObject()
+{
+    beginValue();
+    m_buffer.append(m_compact ? "{" : "{\n");
+    m_stack.append(Frame{true, true});
+}
+
+void JsonStreamWriter::endObject()
+{
+    endContainer('}');
+}
+
+void JsonStreamWriter::beginArray()
+{
+    beginValue();
+    m_buffer.append(m_compact ? "[" : "[\n");
+    m_stack.append(Frame{false, true});
+}
+
+void JsonStreamWriter::endArray()
+{
+    endContainer(']');
+}
+
+void JsonStreamWriter::writeName(const QString &name)
+{
+    if (m_stack.isEmpty()) {
+        return;
+    }
+    writeSeparator(m_stack.last());
+    writeIndent(m_stack.size());
+    m_buffer.append('"');
+    writeEscaped(name);
+    m_buffer.append(m_compact ? "\":" : "\": ");
+    m_afterName = true;
+}
+
+void JsonStreamWriter::writeString(const QString &value)
+{
+    beginValue();
+    m_buffer.append('"');
+    writeEscaped(value);
+    m_buffer.append('"');
+    flushIfFull();
+}
+
+void JsonStreamWriter::writeNumber(double value)
+{
+    beginValue();
+    if (!std::isfinite(value)) {
+        m_buffer.append("null");
+    } else if (value == std::trunc(value) && std::abs(value) < kMaxExactInteger) {
+        // QJsonValue stores integral doubles as integers.
+        m_buffer.append(QByteArray::number(static_cast<qint64>(value)));
+    } else {
+        m_buffer.append(QByteArray::number(value, 'g', QLocale::FloatingPointShortest));
+    }
+}
+
+void JsonStreamWriter::writeBool(bool value)
+{
+    beginValue();
+    m_buffer.append(value ? "true" : "false");
+}
+
+void JsonStreamWriter::writeNull()
+{
+    beginValue();
+    m_buffer.append("null");
+}
+
+bool JsonStreamWriter::flush()
+{
+    if (hasError()) {
+        return false;
+    }
+    if (m_buffer.isEmpty()) {
+        return true;
+    }
+    if (!m_device || m_device->write(m_buffer) != m_buffer.size()) {
+        m_errorString = m_device ? m_device->errorString() : QStringLiteral("No output device");
+        if (m_errorString.isEmpty()) {
+            m_errorString = QStringLiteral("Short write");
+        }
+        return false;
+    }
+    m_buffer.resize(0);
+    return true;
+}
+
+void JsonStreamWriter::beginValue()
+{
+    if (m_afterName) {
+        m_afterName = false;
+        return;
+    }
+    if (m_stack.isEmpty()) {
+        return;
+    }
+    writeSeparator(m_stack.last());
+    writeIndent(m_stack.size());
+}
+
+void JsonStreamWriter::endContainer(char closing)
+{
+    if (m_stack.isEmpty()) {
+        return;
+    }
+    const Frame frame = m_stack.takeLast();
+    if (!frame.empty && !m_compact) {
+        m_buffer.append('\n');
+    }
+    writeIndent(m_stack.size());
+    m_buffer.append(closing);
+    if (m_stack.isEmpty() && !m_compact) {
+        m_buffer.append('\n');
+    }
+    flushIfFull();
+}
+
+void JsonStreamWriter::writeSeparator(Frame &frame)
+{
+    if (!frame.empty) {
+        m_buffer.append(m_compact ? "," : ",\n");
+    }
+    frame.empty = false;
+}
+
+void JsonStreamWriter::writeIndent(qsizetype level)
+{
+    if (!m_compact && level > 0) {
+        m_buffer.append(4 * level, ' ');
+    }
+}
+
+void JsonStreamWriter::writeEscaped(const QString &value)
+{
+    const QByteArray utf8 = value.toUtf8();
+    const char *data = utf8.constData();
+    const qsizetype size = utf8.size();
+    qsizetype runStart = 0;
+    for (qsizetype i = 0; i < size; ++i) {
+        const unsigned char c = static_cast<unsigned char>(data[i]);
+        if (c >= 0x20 && c != '"' && c != '\\') {
+            continue;
+        }
+        m_buffer.append(data + runStart, i - runStart);
+        runStart = i + 1;
+        switch (c) {
+        case '"':
+            m_buffer.append("\\\"");
+            break;
+        case '\\':
+            m_buffer.append("\\\\");
+            break;
+        case '\b':
+            m_buffer.append("\\b");
+            break;
+        case '\f':
+            m_buffer.append("\\f");
+            break;
+        case '\n':
+            m_buffer.append("\\n");
+            break;
+        case '\r':
+            m_buffer.append("\\r");
+            break;
+        case '\t':
+            m_buffer.append("\\t");
+            break;
+        default:
+            m_buffer.append("\\u00");
+            m_buffer.append(hexDigit(c >> 4));
+            m_buffer.append(hexDigit(c & 0xF));
+            break;
+        }
+    }
+    m_buffer.append(data + runStart, size - runStart);
+}
+
+void JsonStreamWriter::flushIfFull()
+{
+    if (m_buffer.size() >= kFlushThreshold) {
+        flush();
+    }
+}
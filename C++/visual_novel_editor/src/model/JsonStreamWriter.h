@@ -0,0 +1,50 @@
+#pragma once
+
+#include <QByteArray>
+#include <QJsonDocument>
+#include <QList>
+#include <QString>
+
+class QIODevice;
+
+// Writes JSON to a QIODevice through a bounded buffer. The output matches
+// QJsonDocument::toJson() for the same format and key order.
+class JsonStreamWriter
+{
+public:
+    explicit JsonStreamWriter(QIODevice *device, QJsonDocument::JsonFormat format = QJsonDocument::Indented);
+
+    void beginObject();
+    void endObject();
+    void beginArray();
+    void endArray();
+    void writeName(const QString &name);
+    void writeString(const QString &value);
+    void writeNumber(double value);
+    void writeBool(bool value);
+    void writeNull();
+
+    bool flush();
+    [[nodiscard]] bool hasError() const { return !m_errorString.isEmpty(); }
+    [[nodiscard]] QString errorString() const { return m_errorString; }
+
+private:
+    struct Frame {
+        bool isObject{false};
+        bool empty{true};
+    };
+
+    void beginValue();
+    void endContainer(char closing);
+    void writeSeparator(Frame &frame);
+    void writeIndent(qsizetype level);
+    void writeEscaped(const QString &value);
+    void flushIfFull();
+
+    QIODevice *m_device{nullptr};
+    bool m_compact{false};
+    QByteArray m_buffer;
+    QList<Frame> m_stack;
+    bool m_afterName{false};
+    QString m_errorString;
+};
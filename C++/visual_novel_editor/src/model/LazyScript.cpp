@@ -0,0 +1,63 @@
+#include "LazyScript.h"
+
+#include <QMutexLocker>
+
+#include <utility>
+
+#include "Crc32.h"
+
+LazyScript::LazyScript(MappedBytes utf8)
+    : m_utf8(std::move(utf8))
+{
+}
+
+QString LazyScript::text() const
+{
+    QMutexLocker locker(&m_mutex);
+    if (!m_isDecoded) {
+        verifyLocked();
+        m_text = QString::fromUtf8(m_utf8.view());
+        m_utf8 = {};
+        m_isDecoded = true;
+    }
+    return m_text;
+}
+
+QByteArray LazyScript::utf8() const
+{
+    QMutexLocker locker(&m_mutex);
+    if (m_isDecoded) {
+        return m_text.toUtf8();
+    }
+    verifyLocked();
+    return m_utf8.view().toByteArray();
+}
+
+bool LazyScript::isDecoded() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_isDecoded;
+}
+
+bool LazyScript::isDamaged() const
+{
+    QMutexLocker locker(&m_mutex);
+    if (!m_isDecoded) {
+        verifyLocked();
+    }
+    return m_isDamaged;
+}
+
+std::shared_ptr<const MappedFile> LazyScript::file() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_utf8.file;
+}
+
+void LazyScript::verifyLocked() const
+{
+    if (!m_isVerified) {
+        m_isDamaged = m_utf8.checksum && crc32(m_utf8.view()) != *m_utf8.checksum;
+        m_isVerified = true;
+    }
+}
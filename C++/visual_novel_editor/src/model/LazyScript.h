@@ -0,0 +1,38 @@
+#pragma once
+
+#include <QByteArray>
+#include <QMutex>
+#include <QString>
+
+#include <memory>
+
+#include "MappedFile.h"
+
+// Script text still held in a mapped file. It is decoded once, on first use,
+// from whichever thread asks first; copies of a node share the holder and so
+// share the decoded text. The mapping is released once decoded.
+class LazyScript
+{
+public:
+    explicit LazyScript(MappedBytes utf8);
+
+    [[nodiscard]] QString text() const;
+    // Encoded text; does not decode.
+    [[nodiscard]] QByteArray utf8() const;
+    [[nodiscard]] bool isDecoded() const;
+    // True when the bytes do not match the checksum they were written with.
+    // Checked once, before the bytes are first used.
+    [[nodiscard]] bool isDamaged() const;
+    // Null once decoded.
+    [[nodiscard]] std::shared_ptr<const MappedFile> file() const;
+
+private:
+    void verifyLocked() const;
+
+    mutable QMutex m_mutex;
+    mutable MappedBytes m_utf8;
+    mutable QString m_text;
+    mutable bool m_isDecoded{false};
+    mutable bool m_isVerified{false};
+    mutable bool m_isDamaged{false};
+};
@@ -0,0 +1,30 @@
+#include "MappedFile.h"
+
+std::shared_ptr<const MappedFile> MappedFile::open(const QString &fileName, QString *errorString)
+{
+    std::shared_ptr<MappedFile> mapped(new MappedFile);
+    mapped->m_file.setFileName(fileName);
+    if (!mapped->m_file.open(QIODevice::ReadOnly)) {
+        if (errorString) {
+            *errorString = mapped->m_file.errorString();
+        }
+        return {};
+    }
+
+    const qint64 size = mapped->m_file.size();
+    if (uchar *memory = size > 0 ? mapped->m_file.map(0, size) : nullptr) {
+        mapped->m_data = QByteArrayView(memory, size);
+        return mapped;
+    }
+
+    mapped->m_buffer = mapped->m_file.readAll();
+    if (mapped->m_buffer.size() != size) {
+        if (errorString) {
+            *errorString = mapped->m_file.errorString();
+        }
+        return {};
+    }
+    mapped->m_data = mapped->m_buffer;
+    mapped->m_file.close();
+    return mapped;
+}
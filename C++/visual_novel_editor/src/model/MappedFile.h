@@ -0,0 +1,39 @@
+#pragma once
+
+#include <QByteArray>
+#include <QByteArrayView>
+#include <QFile>
+#include <QString>
+
+#include <memory>
+#include <optional>
+
+// Read-only contents of a whole file. The file is memory-mapped where the
+// platform allows it and read into memory otherwise; either way it stays
+// valid for as long as a reference is held.
+class MappedFile
+{
+public:
+    static std::shared_ptr<const MappedFile> open(const QString &fileName, QString *errorString = nullptr);
+
+    [[nodiscard]] QString fileName() const { return m_file.fileName(); }
+    [[nodiscard]] QByteArrayView data() const { return m_data; }
+
+private:
+    MappedFile() = default;
+
+    QFile m_file;
+    QByteArray m_buffer;
+    QByteArrayView m_data;
+};
+
+// A range of a MappedFile, optionally with the CRC-32 it was written with.
+struct MappedBytes {
+    std::shared_ptr<const MappedFile> file;
+    qsizetype offset{0};
+    qsizetype size{0};
+    std::optional<quint32> checksum;
+
+    [[nodiscard]] bool isNull() const { return !file; }
+    [[nodiscard]] QByteArrayView view() const { return file ? file->data().sliced(offset, size) : QByteArrayView(); }
+};
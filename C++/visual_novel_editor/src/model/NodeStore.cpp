@@ -0,0 +1,92 @@
+#include "NodeStore.h"
+
+#include <utility>
+
+NodeHandle NodeStore::insert(StoryNode node)
+{
+    const ObjectId id = node.id();
+    if (StoryNode *existing = find(id)) {
+        *existing = std::move(node);
+        return handle(id);
+    }
+    const quint32 index = allocateSlot();
+    Slot &target = slot(index);
+    target.node.emplace(std::move(node));
+    const NodeHandle added{index, target.generation};
+    m_index.insert(id, added);
+    return added;
+}
+
+bool NodeStore::remove(const ObjectId &id)
+{
+    auto it = m_index.find(id);
+    if (it == m_index.end()) {
+        return false;
+    }
+    const quint32 index = it.value().index;
+    m_index.erase(it);
+    Slot &freed = slot(index);
+    freed.node.reset();
+    // Zero is left to null handles.
+    if (++freed.generation == 0) {
+        freed.generation = 1;
+    }
+    m_freeSlots.push_back(index);
+    return true;
+}
+
+void NodeStore::clear()
+{
+    m_blocks.clear();
+    m_slotCount = 0;
+    m_freeSlots.clear();
+    m_index.clear();
+}
+
+void NodeStore::reserve(qsizetype count)
+{
+    m_index.reserve(count);
+    const quint32 slots = quint32(qMax<qsizetype>(count, 0));
+    m_blocks.reserve((slots + kBlockSize - 1) >> kBlockShift);
+}
+
+StoryNode *NodeStore::get(NodeHandle handle)
+{
+    if (handle.isNull() || handle.index >= m_slotCount) {
+        return nullptr;
+    }
+    Slot &target = slot(handle.index);
+    return target.generation == handle.generation && target.node ? &*target.node : nullptr;
+}
+
+const StoryNode *NodeStore::get(NodeHandle handle) const
+{
+    if (handle.isNull() || handle.index >= m_slotCount) {
+        return nullptr;
+    }
+    const Slot &target = slot(handle.index);
+    return target.generation == handle.generation && target.node ? &*target.node : nullptr;
+}
+
+QList<ObjectId> NodeStore::ids() const
+{
+    QList<ObjectId> result;
+    result.reserve(size());
+    for (const StoryNode &node : *this) {
+        result.append(node.id());
+    }
+    return result;
+}
+
+quint32 NodeStore::allocateSlot()
+{
+    if (!m_freeSlots.empty()) {
+        const quint32 index = m_freeSlots.back();
+        m_freeSlots.pop_back();
+        return index;
+    }
+    if ((m_slotCount >> kBlockShift) == m_blocks.size()) {
+        m_blocks.push_back(std::make_unique<Slot[]>(kBlockSize));
+    }
+    return m_slotCount++;
+}
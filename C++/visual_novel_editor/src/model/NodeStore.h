@@ -0,0 +1,137 @@
+#pragma once
+
+#include <QHash>
+#include <QList>
+#include <QtGlobal>
+
+#include <cstddef>
+#include <iterator>
+#include <memory>
+#include <optional>
+#include <type_traits>
+#include <vector>
+
+#include "ObjectId.h"
+#include "StoryNode.h"
+
+// Refers to a slot of a NodeStore. The slot's generation changes whenever
+// its node is removed, so a handle never reaches a node that later reused
+// the slot.
+struct NodeHandle {
+    quint32 index{0};
+    quint32 generation{0};
+
+    [[nodiscard]] bool isNull() const { return generation == 0; }
+
+    friend bool operator==(const NodeHandle &a, const NodeHandle &b)
+    {
+        return a.index == b.index && a.generation == b.generation;
+    }
+    friend bool operator!=(const NodeHandle &a, const NodeHandle &b) { return !(a == b); }
+};
+
+// Generational slot map owning the nodes of a project. Slots are allocated
+// in fixed-size blocks that stay in place until clear(), so a node keeps its
+// address for as long as it exists, removing a node only returns its slot to
+// a free list, and iteration walks the blocks front to back. Ids map to
+// handles through a hash. Iteration follows slot order, not id order.
+class NodeStore
+{
+    struct Slot {
+        std::optional<StoryNode> node;
+        quint32 generation{1};
+    };
+
+    template<bool IsConst>
+    class BasicIterator
+    {
+        using Store = std::conditional_t<IsConst, const NodeStore, NodeStore>;
+
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = StoryNode;
+        using difference_type = std::ptrdiff_t;
+        using pointer = std::conditional_t<IsConst, const StoryNode *, StoryNode *>;
+        using reference = std::conditional_t<IsConst, const StoryNode &, StoryNode &>;
+
+        BasicIterator(Store *store, quint32 index)
+            : m_store(store)
+            , m_index(index)
+        {
+            skipFree();
+        }
+
+        reference operator*() const { return *m_store->slot(m_index).node; }
+        pointer operator->() const { return &**this; }
+        [[nodiscard]] NodeHandle handle() const { return {m_index, m_store->slot(m_index).generation}; }
+
+        BasicIterator &operator++()
+        {
+            ++m_index;
+            skipFree();
+            return *this;
+        }
+
+        friend bool operator==(const BasicIterator &a, const BasicIterator &b) { return a.m_index == b.m_index; }
+        friend bool operator!=(const BasicIterator &a, const BasicIterator &b) { return a.m_index != b.m_index; }
+
+    private:
+        void skipFree()
+        {
+            while (m_index < m_store->m_slotCount && !m_store->slot(m_index).node) {
+                ++m_index;
+            }
+        }
+
+        Store *m_store;
+        quint32 m_index;
+    };
+
+public:
+    using iterator = BasicIterator<false>;
+    using const_iterator = BasicIterator<true>;
+
+    NodeStore() = default;
+    NodeStore(const NodeStore &) = delete;
+    NodeStore &operator=(const NodeStore &) = delete;
+
+    // A node whose id is already stored replaces that node in place.
+    NodeHandle insert(StoryNode node);
+    bool remove(const ObjectId &id);
+    // Frees every block; handles taken before do not survive it.
+    void clear();
+    void reserve(qsizetype count);
+
+    [[nodiscard]] NodeHandle handle(const ObjectId &id) const { return m_index.value(id); }
+    [[nodiscard]] StoryNode *get(NodeHandle handle);
+    [[nodiscard]] const StoryNode *get(NodeHandle handle) const;
+    [[nodiscard]] StoryNode *find(const ObjectId &id) { return get(handle(id)); }
+    [[nodiscard]] const StoryNode *find(const ObjectId &id) const { return get(handle(id)); }
+    [[nodiscard]] bool contains(const ObjectId &id) const { return m_index.contains(id); }
+    [[nodiscard]] qsizetype size() const { return m_index.size(); }
+    [[nodiscard]] bool isEmpty() const { return m_index.isEmpty(); }
+    // In slot order.
+    [[nodiscard]] QList<ObjectId> ids() const;
+
+    iterator begin() { return {this, 0}; }
+    iterator end() { return {this, m_slotCount}; }
+    const_iterator begin() const { return {this, 0}; }
+    const_iterator end() const { return {this, m_slotCount}; }
+    const_iterator cbegin() const { return begin(); }
+    const_iterator cend() const { return end(); }
+
+private:
+    static constexpr quint32 kBlockShift = 8;
+    static constexpr quint32 kBlockSize = 1u << kBlockShift;
+
+    Slot &slot(quint32 index) { return m_blocks[index >> kBlockShift][index & (kBlockSize - 1)]; }
+    const Slot &slot(quint32 index) const { return m_blocks[index >> kBlockShift][index & (kBlockSize - 1)]; }
+    quint32 allocateSlot();
+
+    std::vector<std::unique_ptr<Slot[]>> m_blocks;
+    // Slots below this index have been handed out at least once.
+    quint32 m_slotCount{0};
+    // Most recently freed last, so reuse stays in recently touched blocks.
+    std::vector<quint32> m_freeSlots;
+    QHash<ObjectId, NodeHandle> m_index;
+};
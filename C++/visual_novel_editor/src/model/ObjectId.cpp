@@ -0,0 +1,127 @@
+#include "ObjectId.h"
+
+#include <QHash>
+#include <QList>
+#include <QReadWriteLock>
+#include <QUuid>
+
+namespace {
+constexpr qsizetype kUuidTextLength = 36;
+
+struct InternTable {
+    QReadWriteLock lock;
+    QHash<QString, quint64> indices;
+    QList<QString> texts;
+};
+
+InternTable &internTable()
+{
+    static InternTable table;
+    return table;
+}
+
+int hexValue(QChar ch)
+{
+    const char16_t c = ch.unicode();
+    if (c >= u'0' && c <= u'9') {
+        return c - u'0';
+    }
+    if (c >= u'a' && c <= u'f') {
+        return c - u'a' + 10;
+    }
+    return -1;
+}
+
+// Accepts only the form the editor writes: lowercase, dashed, no braces.
+bool parseUuid(QStringView text, quint64 &high, quint64 &low)
+{
+    if (text.size() != kUuidTextLength) {
+        return false;
+    }
+    high = 0;
+    low = 0;
+    int digits = 0;
+    for (qsizetype i = 0; i < text.size(); ++i) {
+        if (i == 8 || i == 13 || i == 18 || i == 23) {
+            if (text[i] != u'-') {
+                return false;
+            }
+            continue;
+        }
+        const int value = hexValue(text[i]);
+        if (value < 0) {
+            return false;
+        }
+        quint64 &half = digits < 16 ? high : low;
+        half = (half << 4) | quint64(value);
+        ++digits;
+    }
+    return true;
+}
+}
+
+ObjectId ObjectId::create()
+{
+    const QUuid uuid = QUuid::createUuid();
+    quint64 low = 0;
+    for (const uchar byte : uuid.data4) {
+        low = (low << 8) | byte;
+    }
+    return ObjectId((quint64(uuid.data1) << 32) | (quint64(uuid.data2) << 16) | uuid.data3, low);
+}
+
+ObjectId ObjectId::fromString(QStringView text)
+{
+    if (text.isEmpty()) {
+        return {};
+    }
+    quint64 high = 0;
+    quint64 low = 0;
+    if (parseUuid(text, high, low) && high != kInternedHigh && (high != 0 || low != 0)) {
+        return ObjectId(high, low);
+    }
+
+    InternTable &table = internTable();
+    const QString key = text.toString();
+    {
+        const QReadLocker locker(&table.lock);
+        if (auto it = table.indices.constFind(key); it != table.indices.cend()) {
+            return ObjectId(kInternedHigh, it.value());
+        }
+    }
+    const QWriteLocker locker(&table.lock);
+    if (auto it = table.indices.constFind(key); it != table.indices.cend()) {
+        return ObjectId(kInternedHigh, it.value());
+    }
+    const quint64 index = quint64(table.texts.size());
+    table.texts.append(key);
+    table.indices.insert(key, index);
+    return ObjectId(kInternedHigh, index);
+}
+
+QString ObjectId::toString() const
+{
+    if (isNull()) {
+        return {};
+    }
+    if (isInterned()) {
+        InternTable &table = internTable();
+        const QReadLocker locker(&table.lock);
+        return table.texts.value(qsizetype(m_low));
+    }
+    uchar data4[8];
+    for (int i = 0; i < 8; ++i) {
+        data4[i] = uchar(m_low >> (56 - 8 * i));
+    }
+    const QUuid uuid(uint(m_high >> 32), ushort(m_high >> 16), ushort(m_high), data4[0], data4[1], data4[2],
+                     data4[3], data4[4], data4[5], data4[6], data4[7]);
+    return uuid.toString(QUuid::WithoutBraces);
+}
+
+bool operator<(const ObjectId &a, const ObjectId &b)
+{
+    if (!a.isInterned() && !b.isInterned()) {
+        return a.m_high != b.m_high ? a.m_high < b.m_high : a.m_low < b.m_low;
+    }
+    return a.toString() < b.toString();
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <QHashFunctions>
+#include <QMetaType>
+#include <QString>
+#include <QStringView>
+#include <QtGlobal>
+
+// 16-byte identifier of a node or choice. Ids created by the editor are
+// UUIDs held in binary form; any other id text found in a project file is
+// interned in a process-wide table, so every id converts back to exactly the
+// text it was read from. Text is only needed when saving or exporting.
+class ObjectId
+{
+public:
+    constexpr ObjectId() = default;
+
+    [[nodiscard]] static ObjectId create();
+    // An empty string gives the null id.
+    [[nodiscard]] static ObjectId fromString(QStringView text);
+    [[nodiscard]] QString toString() const;
+
+    [[nodiscard]] constexpr bool isNull() const { return m_high == 0 && m_low == 0; }
+
+    friend constexpr bool operator==(const ObjectId &a, const ObjectId &b)
+    {
+        return a.m_high == b.m_high && a.m_low == b.m_low;
+    }
+    friend constexpr bool operator!=(const ObjectId &a, const ObjectId &b) { return !(a == b); }
+    // Orders like the text form, so maps keyed by ids iterate as they did
+    // when they were keyed by strings.
+    friend bool operator<(const ObjectId &a, const ObjectId &b);
+
+    friend size_t qHash(const ObjectId &id, size_t seed = 0) noexcept
+    {
+        return qHashMulti(seed, id.m_high, id.m_low);
+    }
+
+private:
+    constexpr ObjectId(quint64 high, quint64 low)
+        : m_high(high)
+        , m_low(low)
+    {
+    }
+
+    // Marks interned ids; m_low then indexes the table. No UUID the editor
+    // creates has all bits of m_high set.
+    static constexpr quint64 kInternedHigh = ~quint64(0);
+
+    [[nodiscard]] constexpr bool isInterned() const { return m_high == kInternedHigh; }
+
+    quint64 m_high{0};
+    quint64 m_low{0};
+};
+
+Q_DECLARE_TYPEINFO(ObjectId, Q_PRIMITIVE_TYPE);
+Q_DECLARE_METATYPE(ObjectId)
@@ -1,11 +1,18 @@
 #include "Project.h"
 
 #include <QFile>
-#include <QJsonArray>
-#include <QJsonDocument>
-#include <QJsonObject>
+#include <QFileInfo>
+#include <QSaveFile>
 
-#include "Utilities.h"
+#include <algorithm>
+#include <utility>
+
+#include "MappedFile.h"
+#include "ProjectBinaryFormat.h"
+#include "ProjectBinaryReader.h"
+#include "ProjectBinaryWriter.h"
+#include "ProjectJsonReader.h"
+#include "ProjectJsonWriter.h"
 
 Project::Project(QObject *parent)
     : QObject(parent)
@@ -14,113 +21,536 @@ Project::Project(QObject *parent)
 
 StoryNode *Project::addNode(StoryNode::Type type)
 {
-    auto node = std::make_shared<StoryNode>(generateId());
-    node->setType(type);
-    node->setTitle(QStringLiteral("New Node"));
-    StoryNode *nodePtr = node.get();
-    m_nodes.insert(node->id(), node);
-    emit changed();
-    return nodePtr;
+    StoryNode node(generateId());
+    node.setType(type);
+    node.setTitle(QStringLiteral("New Node"));
+    const ObjectId nodeId = node.id();
+    StoryNode *added = m_nodes.get(m_nodes.insert(std::move(node)));
+    m_pendingChanges.recordNodeAdded(nodeId);
+    notifyChanged();
+    return added;
 }
 
-void Project::removeNode(const QString &nodeId)
+void Project::removeNode(const ObjectId &nodeId)
 {
-    m_nodes.remove(nodeId);
+    removeNodes(QSet<ObjectId>{nodeId});
+}
 
-    for (auto it = m_nodes.begin(); it != m_nodes.end(); ++it) {
-        StoryNode *otherNode = it.value().get();
-        if (!otherNode) {
-            continue;
-        }
-        auto &choices = otherNode->choices();
-        for (int i = choices.size() - 1; i >= 0; --i) {
-            if (choices[i].targetNodeId == nodeId) {
-                choices.removeAt(i);
-            }
-        }
+void Project::removeNodes(const QSet<ObjectId> &nodeIds)
+{
+    for (const ObjectId &nodeId : nodeIds) {
+        detachNode(nodeId, nodeIds);
     }
-    emit changed();
+    notifyChanged();
 }
 
 void Project::clear()
 {
     m_nodes.clear();
-    emit changed();
+    m_incoming.clear();
+    m_choiceSources.clear();
+    m_pendingChanges.recordReset();
+    notifyChanged();
 }
 
-StoryNode *Project::getNode(const QString &nodeId)
+ObjectId Project::addChoice(const ObjectId &sourceNodeId, Choice choice)
 {
-    if (auto it = m_nodes.find(nodeId); it != m_nodes.end()) {
-        return it.value().get();
+    StoryNode *source = getNode(sourceNodeId);
+    if (!source) {
+        return {};
+    }
+    if (choice.id.isNull()) {
+        choice.id = generateId();
     }
-    return nullptr;
+    const ObjectId choiceId = choice.id;
+    indexChoice(sourceNodeId, choice);
+    source->choices().append(std::move(choice));
+    m_pendingChanges.recordChoiceAdded(sourceNodeId, choiceId);
+    m_pendingChanges.recordNodeModified(sourceNodeId);
+    notifyChanged();
+    return choiceId;
 }
 
-const StoryNode *Project::getNode(const QString &nodeId) const
+void Project::updateChoice(const ObjectId &sourceNodeId, const Choice &choice)
 {
-    if (auto it = m_nodes.constFind(nodeId); it != m_nodes.cend()) {
-        return it.value().get();
+    if (m_choiceSources.value(choice.id) != sourceNodeId) {
+        return;
+    }
+    StoryNode *source = getNode(sourceNodeId);
+    Choice *existing = source ? source->findChoice(choice.id) : nullptr;
+    if (!existing) {
+        return;
+    }
+    if (existing->targetNodeId != choice.targetNodeId) {
+        unindexChoice(sourceNodeId, *existing);
+        indexChoice(sourceNodeId, choice);
     }
-    return nullptr;
+    *existing = choice;
+    m_pendingChanges.recordChoiceModified(sourceNodeId, choice.id);
+    m_pendingChanges.recordNodeModified(sourceNodeId);
+    notifyChanged();
 }
 
-bool Project::loadFromFile(const QString &fileName)
+void Project::removeChoice(const ObjectId &sourceNodeId, const ObjectId &choiceId)
+{
+    StoryNode *source = m_choiceSources.value(choiceId) == sourceNodeId ? getNode(sourceNodeId) : nullptr;
+    if (!source) {
+        return;
+    }
+    auto &choices = source->choices();
+    for (int i = choices.size() - 1; i >= 0; --i) {
+        if (choices[i].id == choiceId) {
+            unindexChoice(sourceNodeId, choices[i]);
+            choices.removeAt(i);
+            m_pendingChanges.recordChoiceRemoved(sourceNodeId, choiceId);
+            m_pendingChanges.recordNodeModified(sourceNodeId);
+        }
+    }
+    notifyChanged();
+}
+
+QList<ChoiceRef> Project::incomingChoices(const ObjectId &nodeId) const
+{
+    return m_incoming.value(nodeId);
+}
+
+const Choice *Project::findChoice(const ObjectId &choiceId) const
+{
+    const StoryNode *source = getNode(choiceSource(choiceId));
+    return source ? source->findChoice(choiceId) : nullptr;
+}
+
+void Project::beginBatch()
+{
+    ++m_batchDepth;
+}
+
+void Project::commitBatch()
+{
+    if (m_batchDepth <= 0) {
+        return;
+    }
+    --m_batchDepth;
+    notifyChanged();
+}
+
+void Project::notifyNodeChanged(const ObjectId &nodeId)
+{
+    if (!m_nodes.contains(nodeId)) {
+        return;
+    }
+    m_pendingChanges.recordNodeModified(nodeId);
+    notifyChanged();
+}
+
+StoryNode *Project::getNode(const ObjectId &nodeId)
+{
+    return m_nodes.find(nodeId);
+}
+
+const StoryNode *Project::getNode(const ObjectId &nodeId) const
+{
+    return m_nodes.find(nodeId);
+}
+
+Project::FileFormat Project::formatForFileName(const QString &fileName)
+{
+    return fileName.endsWith(QStringLiteral(".vnb"), Qt::CaseInsensitive) ? FileFormat::Binary : FileFormat::Json;
+}
+
+bool Project::loadFromFile(const QString &fileName, const LoadProgressCallback &progress)
 {
     QFile file(fileName);
     if (!file.open(QIODevice::ReadOnly)) {
+        m_errorString = file.errorString();
         return false;
     }
 
-    const QByteArray data = file.readAll();
-    const QJsonDocument document = QJsonDocument::fromJson(data);
-    if (!document.isObject()) {
-        return false;
+    // Parse into a fresh map so a failed or canceled load leaves the current
+    // project untouched.
+    StoryNodeMap nodes;
+    bool mayHoldLegacyScripts = true;
+    if (ProjectBinaryFormat::hasMagic(file.peek(ProjectBinaryFormat::kHeaderSize))) {
+        file.close();
+        auto mapped = MappedFile::open(fileName, &m_errorString);
+        if (!mapped) {
+            return false;
+        }
+        ProjectBinaryReader reader(std::move(mapped));
+        reader.setProgressCallback(progress);
+        if (!reader.read(nodes)) {
+            m_errorString = reader.errorString();
+            return false;
+        }
+        mayHoldLegacyScripts = reader.mayHoldLegacyScripts();
+    } else {
+        ProjectJsonReader reader(&file);
+        reader.setProgressCallback(progress);
+        if (!reader.read(nodes)) {
+            m_errorString = reader.errorString();
+            return false;
+        }
     }
 
-    fromJson(document.object());
-    emit changed();
+    // Converted here once, so nothing that reads scripts later has to parse
+    // HTML again.
+    QList<ObjectId> convertedIds;
+    if (mayHoldLegacyScripts) {
+        for (const std::shared_ptr<StoryNode> &node : std::as_const(nodes)) {
+            if (node && node->convertLegacyScript()) {
+                convertedIds.append(node->id());
+            }
+        }
+    }
+
+    adoptNodes(std::move(nodes));
+    m_convertedScriptNodeIds = std::move(convertedIds);
+    m_errorString.clear();
     return true;
 }
 
-bool Project::saveToFile(const QString &fileName) const
+bool Project::saveToFile(const QString &fileName, QJsonDocument::JsonFormat format) const
 {
-    QFile file(fileName);
-    if (!file.open(QIODevice::WriteOnly)) {
-        return false;
+    releaseScriptFile(fileName);
+    // Files list nodes by id whatever slots they occupy.
+    QList<const StoryNode *> nodes;
+    nodes.reserve(m_nodes.size());
+    for (const StoryNode &node : m_nodes) {
+        nodes.append(&node);
     }
+    std::sort(nodes.begin(), nodes.end(), [](const StoryNode *a, const StoryNode *b) { return a->id() < b->id(); });
+    return writeNodes(nodes, fileName, format, &m_errorString);
+}
 
-    const QJsonDocument document(toJson());
-    file.write(document.toJson(QJsonDocument::Indented));
-    return true;
+ProjectSnapshot Project::snapshot() const
+{
+    if (m_isSnapshotReset) {
+        QList<SharedNodeMap::Entry> entries;
+        entries.reserve(m_nodes.size());
+        for (const StoryNode &node : m_nodes) {
+            entries.append({node.id(), std::make_shared<const StoryNode>(node)});
+        }
+        m_snapshotNodes.assign(std::move(entries));
+        m_isSnapshotReset = false;
+    } else {
+        for (const ObjectId &nodeId : std::as_const(m_staleSnapshotIds)) {
+            const StoryNode *node = getNode(nodeId);
+            if (node) {
+                m_snapshotNodes.insert(nodeId, std::make_shared<const StoryNode>(*node));
+            } else {
+                m_snapshotNodes.remove(nodeId);
+            }
+        }
+    }
+    m_staleSnapshotIds.clear();
+    return ProjectSnapshot(m_version, m_snapshotNodes);
+}
+
+QList<ObjectId> Project::damagedScriptNodeIds() const
+{
+    QList<ObjectId> result;
+    for (const StoryNode &node : m_nodes) {
+        if (node.isScriptDamaged()) {
+            result.append(node.id());
+        }
+    }
+    return result;
 }
 
-QString Project::generateId()
+bool Project::saveNodesToFile(const SharedNodeMap &nodes, const QString &fileName,
+                              QJsonDocument::JsonFormat format, QString *errorString)
 {
-    return generateUuid();
+    QList<const StoryNode *> ordered;
+    ordered.reserve(nodes.size());
+    for (auto it = nodes.cbegin(); it != nodes.cend(); ++it) {
+        if (it.value()) {
+            ordered.append(it.value().get());
+        }
+    }
+    return writeNodes(ordered, fileName, format, errorString);
 }
 
-QJsonObject Project::toJson() const
+bool Project::writeNodes(const QList<const StoryNode *> &nodes, const QString &fileName,
+                         QJsonDocument::JsonFormat format, QString *errorString)
 {
-    QJsonObject root;
-    QJsonArray nodesArray;
-    for (auto it = m_nodes.cbegin(); it != m_nodes.cend(); ++it) {
-        const StoryNode *node = it.value().get();
-        if (node) {
-            nodesArray.append(node->toJson());
+    // Written out, a damaged script would get a fresh checksum and pass for
+    // intact from then on.
+    for (const StoryNode *node : nodes) {
+        if (node->isScriptDamaged()) {
+            if (errorString) {
+                *errorString = QStringLiteral("The script of node %1 does not match its checksum in the file it was "
+                                              "loaded from; set it again before saving")
+                                   .arg(node->id().toString());
+            }
+            return false;
         }
     }
-    root[QStringLiteral("nodes")] = nodesArray;
-    return root;
+
+    QString error;
+    QSaveFile file(fileName);
+    bool written = file.open(QIODevice::WriteOnly);
+    if (!written) {
+        error = file.errorString();
+    } else if (formatForFileName(fileName) == FileFormat::Binary) {
+        ProjectBinaryWriter writer(&file);
+        written = writer.write(nodes);
+        error = writer.errorString();
+    } else {
+        ProjectJsonWriter writer(&file, format);
+        written = writer.write(nodes);
+        error = writer.errorString();
+    }
+    if (!written) {
+        file.cancelWriting();
+    } else if (!file.commit()) {
+        written = false;
+        error = file.errorString();
+    }
+    if (errorString) {
+        *errorString = written ? QString() : error;
+    }
+    return written;
+}
+
+ObjectId Project::generateId()
+{
+    return ObjectId::create();
 }
 
-void Project::fromJson(const QJsonObject &json)
+void Project::detachNode(const ObjectId &nodeId, const QSet<ObjectId> &removedIds)
 {
+    const StoryNode *node = m_nodes.find(nodeId);
+    if (!node) {
+        return;
+    }
+    for (const Choice &choice : node->choices()) {
+        unindexChoice(nodeId, choice);
+        m_pendingChanges.recordChoiceRemoved(nodeId, choice.id);
+    }
+    m_nodes.remove(nodeId);
+    m_pendingChanges.recordNodeRemoved(nodeId);
+
+    // Sources that are removed in the same pass drop their choices with them.
+    const QList<ChoiceRef> incoming = m_incoming.take(nodeId);
+    for (const ChoiceRef &ref : incoming) {
+        if (removedIds.contains(ref.sourceNodeId)) {
+            continue;
+        }
+        StoryNode *source = getNode(ref.sourceNodeId);
+        if (!source) {
+            continue;
+        }
+        auto &choices = source->choices();
+        for (int i = choices.size() - 1; i >= 0; --i) {
+            if (choices[i].id == ref.choiceId) {
+                choices.removeAt(i);
+            }
+        }
+        m_choiceSources.remove(ref.choiceId);
+        m_pendingChanges.recordChoiceRemoved(ref.sourceNodeId, ref.choiceId);
+        m_pendingChanges.recordNodeModified(ref.sourceNodeId);
+    }
+}
+
+void Project::indexChoice(const ObjectId &sourceNodeId, const Choice &choice)
+{
+    m_choiceSources.insert(choice.id, sourceNodeId);
+    if (choice.targetNodeId.isNull()) {
+        return;
+    }
+    m_incoming[choice.targetNodeId].append(ChoiceRef{sourceNodeId, choice.id});
+}
+
+void Project::unindexChoice(const ObjectId &sourceNodeId, const Choice &choice)
+{
+    // A file may repeat a choice id in another node; keep that node's entry.
+    if (auto source = m_choiceSources.find(choice.id);
+        source != m_choiceSources.end() && source.value() == sourceNodeId) {
+        m_choiceSources.erase(source);
+    }
+    auto it = m_incoming.find(choice.targetNodeId);
+    if (it == m_incoming.end()) {
+        return;
+    }
+    it.value().removeIf([&](const ChoiceRef &ref) {
+        return ref.choiceId == choice.id && ref.sourceNodeId == sourceNodeId;
+    });
+    if (it.value().isEmpty()) {
+        m_incoming.erase(it);
+    }
+}
+
+void Project::rebuildChoiceIndex()
+{
+    m_incoming.clear();
+    m_choiceSources.clear();
+    for (const StoryNode &node : m_nodes) {
+        for (const Choice &choice : node.choices()) {
+            indexChoice(node.id(), choice);
+        }
+    }
+}
+
+// Some platforms refuse to replace a file that is mapped.
+void Project::releaseScriptFile(const QString &fileName) const
+{
+    const QFileInfo target(fileName);
+    const MappedFile *checked = nullptr;
+    bool matches = false;
+    for (const StoryNode &node : m_nodes) {
+        const std::shared_ptr<const MappedFile> source = node.scriptFile();
+        if (!source) {
+            continue;
+        }
+        if (source.get() != checked) {
+            checked = source.get();
+            matches = QFileInfo(source->fileName()) == target;
+        }
+        if (matches) {
+            node.script();
+        }
+    }
+}
+
+void Project::notifyChanged()
+{
+    if (m_batchDepth > 0 || m_pendingChanges.isEmpty()) {
+        return;
+    }
+    const ProjectChangeSet changes = std::exchange(m_pendingChanges, ProjectChangeSet{});
+    ++m_version;
+    if (changes.reset) {
+        m_isSnapshotReset = !std::exchange(m_isSnapshotPrepared, false);
+        m_staleSnapshotIds.clear();
+    } else if (!m_isSnapshotReset) {
+        m_staleSnapshotIds.unite(changes.addedNodes);
+        m_staleSnapshotIds.unite(changes.removedNodes);
+        m_staleSnapshotIds.unite(changes.modifiedNodes);
+    }
+    if (changes.reset) {
+        emit projectReset();
+    } else {
+        for (auto it = changes.removedChoices.cbegin(); it != changes.removedChoices.cend(); ++it) {
+            emit choiceRemoved(it.value(), it.key());
+        }
+        for (const ObjectId &nodeId : changes.removedNodes) {
+            emit nodeRemoved(nodeId);
+        }
+        for (const ObjectId &nodeId : changes.addedNodes) {
+            emit nodeAdded(nodeId);
+        }
+        for (auto it = changes.addedChoices.cbegin(); it != changes.addedChoices.cend(); ++it) {
+            emit choiceAdded(it.value(), it.key());
+        }
+        for (const ObjectId &nodeId : changes.modifiedNodes) {
+            emit nodeChanged(nodeId);
+        }
+        for (auto it = changes.modifiedChoices.cbegin(); it != changes.modifiedChoices.cend(); ++it) {
+            emit choiceChanged(it.value(), it.key());
+        }
+    }
+    emit changesCommitted(changes);
+    emit changed();
+}
+
+void Project::adoptNodes(StoryNodeMap nodes)
+{
+    // The snapshot map is built here, while the nodes are at hand, so the
+    // first snapshot after a load is as cheap as any later one. Inside an
+    // outer batch more edits may follow, so it is left to snapshot().
+    const bool prepareSnapshot = m_batchDepth == 0;
+    QList<SharedNodeMap::Entry> entries;
+    entries.reserve(prepareSnapshot ? nodes.size() : 0);
+
+    ProjectBatch batch(this);
     clear();
+    m_nodes.reserve(nodes.size());
+    for (auto it = nodes.begin(); it != nodes.end(); ++it) {
+        if (!it.value()) {
+            continue;
+        }
+        // Nodes still shared with someone else are copied, not moved from.
+        const NodeHandle handle =
+            it.value().use_count() == 1 ? m_nodes.insert(std::move(*it.value())) : m_nodes.insert(*it.value());
+        if (prepareSnapshot) {
+            const StoryNode *node = m_nodes.get(handle);
+            entries.append({node->id(), std::make_shared<const StoryNode>(*node)});
+        }
+    }
+    rebuildChoiceIndex();
+    if (prepareSnapshot) {
+        m_snapshotNodes.assign(std::move(entries));
+        m_isSnapshotPrepared = true;
+    }
+}
+
+void Project::restoreNodes(const QHash<ObjectId, std::shared_ptr<const StoryNode>> &images)
+{
+    ProjectBatch batch(this);
+    for (auto it = images.cbegin(); it != images.cend(); ++it) {
+        const ObjectId &nodeId = it.key();
+        const StoryNode *image = it.value().get();
+        StoryNode *existing = m_nodes.find(nodeId);
+        if (!image) {
+            if (!existing) {
+                continue;
+            }
+            // Nodes pointing here are restored from their own images.
+            restoreChoices(nodeId, existing->choices(), {});
+            m_nodes.remove(nodeId);
+            m_pendingChanges.recordNodeRemoved(nodeId);
+        } else if (!existing) {
+            restoreChoices(nodeId, {}, image->choices());
+            m_nodes.insert(*image);
+            m_pendingChanges.recordNodeAdded(nodeId);
+        } else {
+            restoreChoices(nodeId, existing->choices(), image->choices());
+            *existing = *image;
+            m_pendingChanges.recordNodeModified(nodeId);
+        }
+    }
+}
+
+void Project::restoreChoices(const ObjectId &nodeId, const QList<Choice> &current, const QList<Choice> &restored)
+{
+    QHash<ObjectId, const Choice *> remaining;
+    remaining.reserve(current.size());
+    for (const Choice &choice : current) {
+        remaining.insert(choice.id, &choice);
+    }
+    for (const Choice &choice : restored) {
+        const Choice *old = remaining.take(choice.id);
+        if (!old) {
+            indexChoice(nodeId, choice);
+            m_pendingChanges.recordChoiceAdded(nodeId, choice.id);
+            continue;
+        }
+        if (old->targetNodeId != choice.targetNodeId) {
+            unindexChoice(nodeId, *old);
+            indexChoice(nodeId, choice);
+        }
+        if (old->text != choice.text || old->targetNodeId != choice.targetNodeId
+            || old->condition != choice.condition) {
+            m_pendingChanges.recordChoiceModified(nodeId, choice.id);
+        }
+    }
+    for (const Choice *old : std::as_const(remaining)) {
+        unindexChoice(nodeId, *old);
+        m_pendingChanges.recordChoiceRemoved(nodeId, old->id);
+    }
+}
 
-    const QJsonArray nodesArray = json.value(QStringLiteral("nodes")).toArray();
-    for (const QJsonValue &value : nodesArray) {
-        const StoryNode node = StoryNode::fromJson(value.toObject());
-        auto nodePtr = std::make_shared<StoryNode>(node);
-        m_nodes.insert(nodePtr->id(), nodePtr);
+ProjectBatch::ProjectBatch(Project *project)
+    : m_project(project)
+{
+    if (m_project) {
+        m_project->beginBatch();
+    }
+}
+
+ProjectBatch::~ProjectBatch()
+{
+    if (m_project) {
+        m_project->commitBatch();
     }
 }
@@ -1,38 +1,155 @@
 #pragma once
 
-#include <QJsonObject>
+#include <QHash>
+#include <QJsonDocument>
+#include <QList>
 #include <QMap>
 #include <QObject>
+#include <QSet>
 #include <QString>
 
+#include <functional>
 #include <memory>
 
+#include "NodeStore.h"
+#include "ProjectChangeSet.h"
+#include "ProjectSnapshot.h"
 #include "StoryNode.h"
 
+struct ChoiceRef {
+    ObjectId sourceNodeId;
+    ObjectId choiceId;
+};
+
 class Project : public QObject
 {
     Q_OBJECT
 public:
     explicit Project(QObject *parent = nullptr);
     StoryNode *addNode(StoryNode::Type type);
-    void removeNode(const QString &nodeId);
+    void removeNode(const ObjectId &nodeId);
+    void removeNodes(const QSet<ObjectId> &nodeIds);
     void clear();
 
-    StoryNode *getNode(const QString &nodeId);
-    const StoryNode *getNode(const QString &nodeId) const;
-    const QMap<QString, std::shared_ptr<StoryNode>> &nodes() const { return m_nodes; }
+    ObjectId addChoice(const ObjectId &sourceNodeId, Choice choice);
+    void updateChoice(const ObjectId &sourceNodeId, const Choice &choice);
+    void removeChoice(const ObjectId &sourceNodeId, const ObjectId &choiceId);
+    QList<ChoiceRef> incomingChoices(const ObjectId &nodeId) const;
+    // Node holding the choice, or a null id; a hash lookup.
+    [[nodiscard]] ObjectId choiceSource(const ObjectId &choiceId) const { return m_choiceSources.value(choiceId); }
+    [[nodiscard]] const Choice *findChoice(const ObjectId &choiceId) const;
+
+    // Notifications are deferred while a batch is open and emitted as one
+    // change set when the outermost batch is committed. Prefer ProjectBatch.
+    void beginBatch();
+    void commitBatch();
+    [[nodiscard]] bool isInBatch() const { return m_batchDepth > 0; }
+
+    // Reports an in-place edit (title, script, position) made through a
+    // StoryNode pointer so listeners can refresh.
+    void notifyNodeChanged(const ObjectId &nodeId);
+
+    StoryNode *getNode(const ObjectId &nodeId);
+    const StoryNode *getNode(const ObjectId &nodeId) const;
+    const NodeStore &nodes() const { return m_nodes; }
+
+    // Called with (bytesRead, totalBytes); returning false cancels the load.
+    using LoadProgressCallback = std::function<bool(qint64, qint64)>;
+
+    enum class FileFormat { Json, Binary };
+
+    // Saving picks the format from the extension (.vnb is binary); loading
+    // looks at the file's magic bytes. The JSON format argument is ignored
+    // for binary files.
+    static FileFormat formatForFileName(const QString &fileName);
+    [[nodiscard]] bool loadFromFile(const QString &fileName, const LoadProgressCallback &progress = {});
+    [[nodiscard]] bool saveToFile(const QString &fileName,
+                                  QJsonDocument::JsonFormat format = QJsonDocument::Indented) const;
+    [[nodiscard]] QString errorString() const { return m_errorString; }
+    // Nodes whose legacy HTML script the last load converted. The file keeps
+    // the HTML until those nodes are saved again.
+    [[nodiscard]] const QList<ObjectId> &convertedScriptNodeIds() const { return m_convertedScriptNodeIds; }
+    // Incremented each time a change set is committed.
+    [[nodiscard]] quint64 version() const { return m_version; }
+    // State as of the last committed change set, for readers on other
+    // threads. Only nodes changed since the previous snapshot are copied and
+    // the copies share their strings with the model; with earlier snapshots
+    // still alive, each changed node also copies its chunk of the node map
+    // (see SharedNodeMap). Edits made through a StoryNode pointer show up
+    // once they are reported.
+    [[nodiscard]] ProjectSnapshot snapshot() const;
+    // Writes nodes without touching a Project, e.g. from a worker thread.
+    [[nodiscard]] static bool saveNodesToFile(const SharedNodeMap &nodes, const QString &fileName,
+                                              QJsonDocument::JsonFormat format = QJsonDocument::Indented,
+                                              QString *errorString = nullptr);
 
-    [[nodiscard]] bool loadFromFile(const QString &fileName);
-    [[nodiscard]] bool saveToFile(const QString &fileName) const;
+    // Replaces every node, moving the ones nobody else holds out of the map;
+    // listeners see a single reset.
+    void adoptNodes(StoryNodeMap nodes);
+    // Makes each listed node equal to its image, adding it if missing; a null
+    // image removes the node. Existing nodes keep their address and listeners
+    // see one change set. Used by undo and redo.
+    void restoreNodes(const QHash<ObjectId, std::shared_ptr<const StoryNode>> &images);
+    // Nodes whose script did not match its checksum when read; see
+    // StoryNode::isScriptDamaged(). Checks every script not yet checked.
+    [[nodiscard]] QList<ObjectId> damagedScriptNodeIds() const;
+    // Decodes the scripts still mapped from fileName so it can be replaced.
+    void releaseScriptFile(const QString &fileName) const;
 
-    QString generateId();
+    ObjectId generateId();
 
 signals:
+    // Emitted once per committed change set, removals first, after the model
+    // reached its final state.
+    void nodeAdded(const ObjectId &nodeId);
+    void nodeRemoved(const ObjectId &nodeId);
+    void nodeChanged(const ObjectId &nodeId);
+    void choiceAdded(const ObjectId &sourceNodeId, const ObjectId &choiceId);
+    void choiceRemoved(const ObjectId &sourceNodeId, const ObjectId &choiceId);
+    void choiceChanged(const ObjectId &sourceNodeId, const ObjectId &choiceId);
+    void projectReset();
+
+    void changesCommitted(const ProjectChangeSet &changes);
     void changed();
 
 private:
-    QMap<QString, std::shared_ptr<StoryNode>> m_nodes;
+    NodeStore m_nodes;
+    // Predecessor index: target node id -> choices jumping to it.
+    QHash<ObjectId, QList<ChoiceRef>> m_incoming;
+    // Choice id -> id of the node holding it.
+    QHash<ObjectId, ObjectId> m_choiceSources;
+    ProjectChangeSet m_pendingChanges;
+    int m_batchDepth{0};
+    quint64 m_version{0};
+    // Node copies backing snapshot(); ids listed as stale are re-copied on
+    // the next call.
+    mutable SharedNodeMap m_snapshotNodes;
+    mutable QSet<ObjectId> m_staleSnapshotIds;
+    mutable bool m_isSnapshotReset{true};
+    // adoptNodes() already filled m_snapshotNodes for its reset.
+    bool m_isSnapshotPrepared{false};
+    mutable QString m_errorString;
+    QList<ObjectId> m_convertedScriptNodeIds;
+
+    void detachNode(const ObjectId &nodeId, const QSet<ObjectId> &removedIds);
+    void indexChoice(const ObjectId &sourceNodeId, const Choice &choice);
+    void unindexChoice(const ObjectId &sourceNodeId, const Choice &choice);
+    void rebuildChoiceIndex();
+    void restoreChoices(const ObjectId &nodeId, const QList<Choice> &current, const QList<Choice> &restored);
+    void notifyChanged();
+    static bool writeNodes(const QList<const StoryNode *> &nodes, const QString &fileName,
+                           QJsonDocument::JsonFormat format, QString *errorString);
+};
+
+class ProjectBatch
+{
+public:
+    explicit ProjectBatch(Project *project);
+    ~ProjectBatch();
 
-    QJsonObject toJson() const;
-    void fromJson(const QJsonObject &json);
+    ProjectBatch(const ProjectBatch &) = delete;
+    ProjectBatch &operator=(const ProjectBatch &) = delete;
+
+private:
+    Project *m_project{nullptr};
 };
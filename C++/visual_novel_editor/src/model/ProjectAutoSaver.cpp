@@ -0,0 +1,154 @@
+#include "ProjectAutoSaver.h"
+
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QTimer>
+#include <QtConcurrentRun>
+
+#include <utility>
+
+#include "Project.h"
+#include "ProjectChangeSet.h"
+
+namespace {
+constexpr int kDefaultIntervalMs = 2 * 60 * 1000;
+constexpr int kDefaultBackupCount = 3;
+
+// Writes next to the newest backup first and only then shifts the older
+// ones, so a failed write leaves every existing backup in place.
+QString writeBackup(const ProjectSnapshot &snapshot, const QString &projectFileName, int backupCount)
+{
+    const QString pending = ProjectAutoSaver::backupFileName(projectFileName, -1);
+    QString error;
+    if (!Project::saveNodesToFile(snapshot.nodes(), pending, QJsonDocument::Indented, &error)) {
+        return error.isEmpty() ? QStringLiteral("Unable to write %1").arg(pending) : error;
+    }
+
+    QFile::remove(ProjectAutoSaver::backupFileName(projectFileName, backupCount - 1));
+    for (int index = backupCount - 2; index >= 0; --index) {
+        const QString from = ProjectAutoSaver::backupFileName(projectFileName, index);
+        if (QFile::exists(from)) {
+            QFile::rename(from, ProjectAutoSaver::backupFileName(projectFileName, index + 1));
+        }
+    }
+    const QString newest = ProjectAutoSaver::backupFileName(projectFileName, 0);
+    QFile::remove(newest);
+    if (!QFile::rename(pending, newest)) {
+        return QStringLiteral("Unable to replace %1").arg(newest);
+    }
+    return {};
+}
+}
+
+ProjectAutoSaver::ProjectAutoSaver(Project *project, QObject *parent)
+    : QObject(parent)
+    , m_project(project)
+    , m_timer(new QTimer(this))
+    , m_backupCount(kDefaultBackupCount)
+{
+    m_timer->setInterval(kDefaultIntervalMs);
+    connect(m_timer, &QTimer::timeout, this, &ProjectAutoSaver::saveNow);
+    connect(&m_saveWatcher, &QFutureWatcher<QString>::finished, this, &ProjectAutoSaver::finishSave);
+    if (m_project) {
+        connect(m_project, &Project::changesCommitted, this, &ProjectAutoSaver::onChangesCommitted);
+    }
+}
+
+ProjectAutoSaver::~ProjectAutoSaver()
+{
+    waitForSave();
+}
+
+QString ProjectAutoSaver::backupFileName(const QString &projectFileName, int index)
+{
+    const QFileInfo info(projectFileName);
+    QString name = info.completeBaseName() + QStringLiteral(".autosave");
+    if (index < 0) {
+        name += QStringLiteral(".pending");
+    } else if (index > 0) {
+        name += QLatin1Char('.') + QString::number(index);
+    }
+    if (!info.suffix().isEmpty()) {
+        name += QLatin1Char('.') + info.suffix();
+    }
+    return info.dir().filePath(name);
+}
+
+void ProjectAutoSaver::setEnabled(bool enabled)
+{
+    m_enabled = enabled;
+    updateTimer();
+}
+
+void ProjectAutoSaver::setInterval(int msec)
+{
+    m_timer->setInterval(qMax(1, msec));
+}
+
+int ProjectAutoSaver::interval() const
+{
+    return m_timer->interval();
+}
+
+void ProjectAutoSaver::setBackupCount(int count)
+{
+    m_backupCount = qMax(1, count);
+}
+
+void ProjectAutoSaver::setProjectFileName(const QString &fileName)
+{
+    waitForSave();
+    m_projectFileName = fileName;
+    m_isDirty = false;
+    updateTimer();
+}
+
+bool ProjectAutoSaver::saveNow()
+{
+    if (!m_project || !m_isDirty || m_projectFileName.isEmpty() || isSaving()) {
+        return false;
+    }
+    m_isDirty = false;
+    m_save = QtConcurrent::run(writeBackup, m_project->snapshot(), m_projectFileName, m_backupCount);
+    m_saveWatcher.setFuture(m_save);
+    return true;
+}
+
+void ProjectAutoSaver::waitForSave()
+{
+    if (m_save.isValid()) {
+        m_save.waitForFinished();
+        finishSave();
+    }
+}
+
+void ProjectAutoSaver::onChangesCommitted(const ProjectChangeSet &changes)
+{
+    // A reset comes from loading or clearing, which leaves nothing to back up.
+    m_isDirty = !changes.reset;
+}
+
+void ProjectAutoSaver::finishSave()
+{
+    if (!m_save.isValid() || !m_save.isFinished()) {
+        return;
+    }
+    const QString error = std::exchange(m_save, {}).result();
+    if (!error.isEmpty()) {
+        // Try again on the next tick.
+        m_isDirty = true;
+    }
+    emit saveFinished(error.isEmpty(), error);
+}
+
+void ProjectAutoSaver::updateTimer()
+{
+    if (m_enabled && !m_projectFileName.isEmpty()) {
+        if (!m_timer->isActive()) {
+            m_timer->start();
+        }
+    } else {
+        m_timer->stop();
+    }
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <QFuture>
+#include <QFutureWatcher>
+#include <QObject>
+#include <QString>
+
+class Project;
+class QTimer;
+struct ProjectChangeSet;
+
+// Periodically writes a snapshot of the project to backups beside the
+// project file: "<name>.autosave.<ext>" is the newest, older ones are kept as
+// "<name>.autosave.1.<ext>" and so on. The snapshot is taken on the calling
+// thread and serialized on a worker, so editing never waits for the disk.
+class ProjectAutoSaver : public QObject
+{
+    Q_OBJECT
+public:
+    explicit ProjectAutoSaver(Project *project, QObject *parent = nullptr);
+    ~ProjectAutoSaver() override;
+
+    static QString backupFileName(const QString &projectFileName, int index = 0);
+
+    void setEnabled(bool enabled);
+    [[nodiscard]] bool isEnabled() const { return m_enabled; }
+    void setInterval(int msec);
+    [[nodiscard]] int interval() const;
+    // Number of backups kept, including the newest.
+    void setBackupCount(int count);
+    [[nodiscard]] int backupCount() const { return m_backupCount; }
+
+    // Untitled projects are not autosaved.
+    void setProjectFileName(const QString &fileName);
+    [[nodiscard]] QString projectFileName() const { return m_projectFileName; }
+    // Called after a regular save; nothing is written until the next edit.
+    void markSaved() { m_isDirty = false; }
+
+    // Starts a save if there are unsaved edits and none is running.
+    bool saveNow();
+    [[nodiscard]] bool isSaving() const { return m_save.isValid(); }
+    // Blocks until a running save has finished and been reported.
+    void waitForSave();
+
+signals:
+    void saveFinished(bool succeeded, const QString &errorString);
+
+private:
+    void onChangesCommitted(const ProjectChangeSet &changes);
+    void finishSave();
+    void updateTimer();
+
+    Project *m_project{nullptr};
+    QTimer *m_timer{nullptr};
+    QString m_projectFileName;
+    int m_backupCount;
+    bool m_enabled{false};
+    bool m_isDirty{false};
+    QFuture<QString> m_save;
+    QFutureWatcher<QString> m_saveWatcher;
+};
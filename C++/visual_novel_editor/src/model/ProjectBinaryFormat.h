@@ -0,0 +1,57 @@
+#pragma once
+
+#include <QByteArrayView>
+#include <QString>
+#include <QtGlobal>
+
+// Layout of .vnb project files. Integers are little endian.
+//
+//   header   "VNPB", quint16 version, quint16 section count
+//   section  quint32 tag, quint32 payload size, quint32 CRC-32 of the payload
+//
+// STRS is a CBOR array holding every distinct id, title, choice text and
+// condition once. NODE is a CBOR array of node records that refer to STRS by
+// index. SCRP holds the UTF-8 scripts back to back; node records address them
+// by offset and size and carry each script's own CRC-32, so a loader can map
+// SCRP and check a script only when it is first read.
+//
+// Version 1 files may hold scripts as the HTML older editors saved; from
+// version 2 on every script is plain text or RichText's stored form, so a
+// loader need not decode the scripts to convert them.
+namespace ProjectBinaryFormat {
+
+inline constexpr char kMagic[] = {'V', 'N', 'P', 'B'};
+inline constexpr quint16 kVersion = 2;
+inline constexpr quint16 kMinVersion = 1;
+inline constexpr qsizetype kHeaderSize = 8;
+inline constexpr qsizetype kSectionHeaderSize = 12;
+
+constexpr quint32 makeTag(char a, char b, char c, char d)
+{
+    return quint32(uchar(a)) | quint32(uchar(b)) << 8 | quint32(uchar(c)) << 16 | quint32(uchar(d)) << 24;
+}
+
+inline constexpr quint32 kStringsTag = makeTag('S', 'T', 'R', 'S');
+inline constexpr quint32 kScriptsTag = makeTag('S', 'C', 'R', 'P');
+inline constexpr quint32 kNodesTag = makeTag('N', 'O', 'D', 'E');
+
+// Node record: [id, title, script offset, script size, type, x, y, [choices],
+//               script CRC-32]
+// Choice record: [id, text, target, condition or null]
+// Readers skip trailing fields they do not know. Records written before the
+// script CRC was added end after the choices.
+inline constexpr int kNodeFieldCount = 9;
+inline constexpr int kChoiceFieldCount = 4;
+
+inline bool hasMagic(QByteArrayView data)
+{
+    return data.size() >= qsizetype(sizeof(kMagic)) && data.first(sizeof(kMagic)) == QByteArrayView(kMagic, sizeof(kMagic));
+}
+
+inline QString tagName(quint32 tag)
+{
+    const char name[] = {char(tag & 0xFF), char(tag >> 8 & 0xFF), char(tag >> 16 & 0xFF), char(tag >> 24 & 0xFF)};
+    return QString::fromLatin1(name, sizeof(name));
+}
+
+} // namespace ProjectBinaryFormat
@@ -0,0 +1,249 @@
+#include "ProjectBinaryReader.h"
+
+#include <QHash>
+#include <QtEndian>
+
+#include <utility>
+
+#include "CborUtils.h"
+#include "Crc32.h"
+#include "ProjectBinaryFormat.h"
+
+using namespace ProjectBinaryFormat;
+
+ProjectBinaryReader::ProjectBinaryReader(std::shared_ptr<const MappedFile> file)
+    : m_file(std::move(file))
+    , m_data(m_file ? m_file->data() : QByteArrayView())
+{
+}
+
+void ProjectBinaryReader::setProgressCallback(std::function<bool(qint64, qint64)> callback)
+{
+    m_progressCallback = std::move(callback);
+}
+
+bool ProjectBinaryReader::read(StoryNodeMap &nodes)
+{
+    m_wasCanceled = false;
+    m_errorString.clear();
+    m_strings.clear();
+    m_scriptsNeedVerifying = false;
+    m_mayHoldLegacyScripts = false;
+
+    if (!reportProgress(0)) {
+        return false;
+    }
+
+    if (m_data.size() < kHeaderSize || !hasMagic(m_data)) {
+        return fail(QStringLiteral("Not a binary project file"));
+    }
+    const quint16 version = qFromLittleEndian<quint16>(m_data.data() + 4);
+    if (version < kMinVersion || version > kVersion) {
+        return fail(QStringLiteral("Unsupported binary project version %1").arg(version));
+    }
+    m_mayHoldLegacyScripts = version < 2;
+    const quint16 sectionCount = qFromLittleEndian<quint16>(m_data.data() + 6);
+
+    QHash<quint32, Section> sections;
+    qsizetype position = kHeaderSize;
+    for (int i = 0; i < sectionCount; ++i) {
+        if (m_data.size() - position < kSectionHeaderSize) {
+            return fail(QStringLiteral("Project file is truncated at offset %1").arg(position));
+        }
+        Section section;
+        section.tag = qFromLittleEndian<quint32>(m_data.data() + position);
+        section.size = qFromLittleEndian<quint32>(m_data.data() + position + 4);
+        section.checksum = qFromLittleEndian<quint32>(m_data.data() + position + 8);
+        section.offset = position + kSectionHeaderSize;
+        if (m_data.size() - section.offset < section.size) {
+            return corrupt(section.tag, QStringLiteral("truncated"));
+        }
+        position = section.offset + section.size;
+        sections.insert(section.tag, section);
+    }
+
+    for (const quint32 tag : {kStringsTag, kNodesTag}) {
+        if (!sections.contains(tag)) {
+            return fail(QStringLiteral("Section %1 is missing").arg(tagName(tag)));
+        }
+    }
+    const Section strings = sections.value(kStringsTag);
+    const Section nodeRecords = sections.value(kNodesTag);
+    const Section scripts = sections.value(kScriptsTag, Section{kScriptsTag});
+    if (!verify(strings) || !readStrings(strings) || !reportProgress(strings.offset + strings.size)) {
+        return false;
+    }
+    if (!verify(nodeRecords) || !readNodes(nodeRecords, scripts, nodes)) {
+        return false;
+    }
+    // Records without a script CRC can only be trusted once the whole
+    // section has been checked.
+    if (m_scriptsNeedVerifying && !verify(scripts)) {
+        return false;
+    }
+    return reportProgress(m_data.size());
+}
+
+bool ProjectBinaryReader::verify(const Section &section)
+{
+    if (crc32(m_data.sliced(section.offset, section.size)) != section.checksum) {
+        return corrupt(section.tag, QStringLiteral("checksum mismatch"));
+    }
+    return true;
+}
+
+bool ProjectBinaryReader::readStrings(const Section &section)
+{
+    QCborStreamReader cbor(m_data.data() + section.offset, section.size);
+    if (!enterCborArray(cbor)) {
+        return corrupt(kStringsTag, QStringLiteral("expected an array"));
+    }
+    while (cbor.hasNext()) {
+        QString value;
+        if (!readCborText(cbor, value)) {
+            return corrupt(kStringsTag, QStringLiteral("invalid string at index %1").arg(m_strings.size()));
+        }
+        m_strings.append(std::move(value));
+    }
+    if (!cbor.leaveContainer()) {
+        return corrupt(kStringsTag, cbor.lastError().toString());
+    }
+    return true;
+}
+
+bool ProjectBinaryReader::readNodes(const Section &section, const Section &scripts, StoryNodeMap &nodes)
+{
+    QCborStreamReader cbor(m_data.data() + section.offset, section.size);
+    if (!enterCborArray(cbor)) {
+        return corrupt(kNodesTag, QStringLiteral("expected an array"));
+    }
+    while (cbor.hasNext()) {
+        auto node = std::make_shared<StoryNode>();
+        if (!readNode(cbor, scripts, *node)) {
+            return corrupt(kNodesTag, QStringLiteral("invalid record for node %1").arg(nodes.size()));
+        }
+        const ObjectId id = node->id();
+        nodes.insert(id, std::move(node));
+    }
+    if (!cbor.leaveContainer()) {
+        return corrupt(kNodesTag, cbor.lastError().toString());
+    }
+    return true;
+}
+
+bool ProjectBinaryReader::readNode(QCborStreamReader &cbor, const Section &scripts, StoryNode &node)
+{
+    ObjectId id;
+    QString title;
+    quint64 scriptOffset = 0;
+    quint64 scriptSize = 0;
+    quint64 type = 0;
+    double x = 0.0;
+    double y = 0.0;
+    if (!enterCborArray(cbor) || !readIdRef(cbor, id) || !readStringRef(cbor, title)
+        || !readCborUnsigned(cbor, scriptOffset) || !readCborUnsigned(cbor, scriptSize)
+        || !readCborUnsigned(cbor, type) || !readCborDouble(cbor, x) || !readCborDouble(cbor, y)) {
+        return false;
+    }
+    if (scriptOffset > quint64(scripts.size) || scriptSize > quint64(scripts.size) - scriptOffset) {
+        return false;
+    }
+
+    node.setId(id);
+    node.setTitle(title);
+    node.setType(type <= quint64(StoryNode::Type::End) ? StoryNode::Type(type) : StoryNode::Type::Dialogue);
+    node.setPosition(QPointF(x, y));
+
+    if (!enterCborArray(cbor)) {
+        return false;
+    }
+    while (cbor.hasNext()) {
+        Choice choice;
+        if (!readChoice(cbor, choice)) {
+            return false;
+        }
+        node.choices().append(std::move(choice));
+    }
+    if (!cbor.leaveContainer()) {
+        return false;
+    }
+
+    MappedBytes script{m_file, scripts.offset + qsizetype(scriptOffset), qsizetype(scriptSize), std::nullopt};
+    if (cbor.hasNext()) {
+        quint64 checksum = 0;
+        if (!readCborUnsigned(cbor, checksum)) {
+            return false;
+        }
+        script.checksum = quint32(checksum);
+    } else {
+        m_scriptsNeedVerifying = true;
+    }
+    node.setScript(std::move(script));
+    return leaveCborArray(cbor);
+}
+
+bool ProjectBinaryReader::readChoice(QCborStreamReader &cbor, Choice &choice)
+{
+    if (!enterCborArray(cbor) || !readIdRef(cbor, choice.id) || !readStringRef(cbor, choice.text)
+        || !readIdRef(cbor, choice.targetNodeId)) {
+        return false;
+    }
+    if (cbor.isNull()) {
+        if (!cbor.next()) {
+            return false;
+        }
+    } else {
+        QString condition;
+        if (!readStringRef(cbor, condition)) {
+            return false;
+        }
+        choice.condition = std::move(condition);
+    }
+    return leaveCborArray(cbor);
+}
+
+bool ProjectBinaryReader::readStringRef(QCborStreamReader &cbor, QString &value)
+{
+    quint64 index = 0;
+    if (!readCborUnsigned(cbor, index) || index >= quint64(m_strings.size())) {
+        return false;
+    }
+    value = m_strings.at(qsizetype(index));
+    return true;
+}
+
+bool ProjectBinaryReader::readIdRef(QCborStreamReader &cbor, ObjectId &value)
+{
+    QString text;
+    if (!readStringRef(cbor, text)) {
+        return false;
+    }
+    value = ObjectId::fromString(text);
+    return true;
+}
+
+bool ProjectBinaryReader::reportProgress(qint64 position)
+{
+    if (!m_progressCallback) {
+        return true;
+    }
+    if (!m_progressCallback(position, m_data.size())) {
+        m_wasCanceled = true;
+        m_errorString = QStringLiteral("Loading was canceled");
+        return false;
+    }
+    return true;
+}
+
+bool ProjectBinaryReader::corrupt(quint32 tag, const QString &detail)
+{
+    return fail(QStringLiteral("Section %1 is corrupt: %2").arg(tagName(tag), detail));
+}
+
+bool ProjectBinaryReader::fail(const QString &message)
+{
+    if (m_errorString.isEmpty()) {
+        m_errorString = message;
+    }
+    return false;
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <QByteArrayView>
+#include <QString>
+#include <QStringList>
+
+#include <functional>
+#include <memory>
+
+#include "MappedFile.h"
+#include "StoryNode.h"
+
+class QCborStreamReader;
+
+// Reads the .vnb format described in ProjectBinaryFormat.h straight from a
+// mapped file. Node headers are decoded up front; scripts are handed to the
+// nodes as ranges of the mapping and decoded when first read. The STRS and
+// NODE sections are checked against their CRC before they are decoded, and
+// SCRP is checked per script on first read.
+class ProjectBinaryReader
+{
+public:
+    explicit ProjectBinaryReader(std::shared_ptr<const MappedFile> file);
+
+    [[nodiscard]] bool read(StoryNodeMap &nodes);
+    void setProgressCallback(std::function<bool(qint64, qint64)> callback);
+    [[nodiscard]] bool wasCanceled() const { return m_wasCanceled; }
+    [[nodiscard]] QString errorString() const { return m_errorString; }
+    // The file predates version 2 and its scripts may be legacy HTML.
+    [[nodiscard]] bool mayHoldLegacyScripts() const { return m_mayHoldLegacyScripts; }
+
+private:
+    struct Section {
+        quint32 tag{0};
+        qsizetype offset{0};
+        qsizetype size{0};
+        quint32 checksum{0};
+    };
+
+    bool verify(const Section &section);
+    bool readStrings(const Section &section);
+    bool readNodes(const Section &section, const Section &scripts, StoryNodeMap &nodes);
+    bool readNode(QCborStreamReader &cbor, const Section &scripts, StoryNode &node);
+    bool readChoice(QCborStreamReader &cbor, Choice &choice);
+    bool readStringRef(QCborStreamReader &cbor, QString &value);
+    bool readIdRef(QCborStreamReader &cbor, ObjectId &value);
+    bool reportProgress(qint64 position);
+    bool corrupt(quint32 tag, const QString &detail);
+    bool fail(const QString &message);
+
+    std::shared_ptr<const MappedFile> m_file;
+    QByteArrayView m_data;
+    std::function<bool(qint64, qint64)> m_progressCallback;
+    QStringList m_strings;
+    bool m_scriptsNeedVerifying{false};
+    bool m_mayHoldLegacyScripts{false};
+    bool m_wasCanceled{false};
+    QString m_errorString;
+};
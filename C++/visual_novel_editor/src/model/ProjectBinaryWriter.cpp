@@ -0,0 +1,118 @@
+#include "ProjectBinaryWriter.h"
+
+#include <QCborStreamWriter>
+#include <QIODevice>
+#include <QtEndian>
+
+#include <cstring>
+#include <limits>
+#include <utility>
+
+#include "Crc32.h"
+#include "ProjectBinaryFormat.h"
+
+using namespace ProjectBinaryFormat;
+
+ProjectBinaryWriter::ProjectBinaryWriter(QIODevice *device)
+    : m_device(device)
+{
+}
+
+bool ProjectBinaryWriter::write(const QList<const StoryNode *> &nodes)
+{
+    m_stringIndex.clear();
+    m_strings.clear();
+    m_errorString.clear();
+
+    QByteArray scripts;
+    QByteArray nodeRecords;
+    {
+        QCborStreamWriter cbor(&nodeRecords);
+        cbor.startArray(quint64(nodes.size()));
+        for (const StoryNode *node : nodes) {
+            const QByteArray script = node->scriptUtf8();
+            cbor.startArray(kNodeFieldCount);
+            cbor.append(stringIndex(node->id().toString()));
+            cbor.append(stringIndex(node->title()));
+            cbor.append(quint64(scripts.size()));
+            cbor.append(quint64(script.size()));
+            cbor.append(quint64(node->type()));
+            cbor.append(node->position().x());
+            cbor.append(node->position().y());
+            cbor.startArray(quint64(node->choices().size()));
+            for (const Choice &choice : node->choices()) {
+                cbor.startArray(kChoiceFieldCount);
+                cbor.append(stringIndex(choice.id.toString()));
+                cbor.append(stringIndex(choice.text));
+                cbor.append(stringIndex(choice.targetNodeId.toString()));
+                if (choice.condition.has_value()) {
+                    cbor.append(stringIndex(*choice.condition));
+                } else {
+                    cbor.appendNull();
+                }
+                cbor.endArray();
+            }
+            cbor.endArray();
+            cbor.append(quint64(crc32(script)));
+            cbor.endArray();
+            scripts.append(script);
+        }
+        cbor.endArray();
+    }
+
+    QByteArray strings;
+    {
+        QCborStreamWriter cbor(&strings);
+        cbor.startArray(quint64(m_strings.size()));
+        for (const QString &value : std::as_const(m_strings)) {
+            cbor.append(value);
+        }
+        cbor.endArray();
+    }
+
+    char header[kHeaderSize];
+    memcpy(header, kMagic, sizeof(kMagic));
+    qToLittleEndian<quint16>(kVersion, header + 4);
+    qToLittleEndian<quint16>(3, header + 6);
+    if (m_device->write(header, kHeaderSize) != kHeaderSize) {
+        return fail(m_device->errorString());
+    }
+    return writeSection(kStringsTag, strings) && writeSection(kScriptsTag, scripts)
+        && writeSection(kNodesTag, nodeRecords);
+}
+
+quint64 ProjectBinaryWriter::stringIndex(const QString &value)
+{
+    auto it = m_stringIndex.constFind(value);
+    if (it != m_stringIndex.cend()) {
+        return it.value();
+    }
+    const quint64 index = quint64(m_strings.size());
+    m_strings.append(value);
+    m_stringIndex.insert(value, index);
+    return index;
+}
+
+bool ProjectBinaryWriter::writeSection(quint32 tag, const QByteArray &payload)
+{
+    if (quint64(payload.size()) > std::numeric_limits<quint32>::max()) {
+        return fail(QStringLiteral("Section %1 exceeds 4 GiB").arg(tagName(tag)));
+    }
+    char header[kSectionHeaderSize];
+    qToLittleEndian<quint32>(tag, header);
+    qToLittleEndian<quint32>(quint32(payload.size()), header + 4);
+    qToLittleEndian<quint32>(crc32(payload), header + 8);
+    if (m_device->write(header, kSectionHeaderSize) != kSectionHeaderSize
+        || m_device->write(payload) != payload.size()) {
+        return fail(m_device->errorString());
+    }
+    return true;
+}
+
+bool ProjectBinaryWriter::fail(const QString &message)
+{
+    if (m_errorString.isEmpty()) {
+        m_errorString = message;
+    }
+    return false;
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <QHash>
+#include <QList>
+#include <QString>
+#include <QStringList>
+
+#include "StoryNode.h"
+
+class QIODevice;
+
+// Writes the .vnb format described in ProjectBinaryFormat.h.
+class ProjectBinaryWriter
+{
+public:
+    explicit ProjectBinaryWriter(QIODevice *device);
+
+    [[nodiscard]] bool write(const QList<const StoryNode *> &nodes);
+    [[nodiscard]] QString errorString() const { return m_errorString; }
+
+private:
+    quint64 stringIndex(const QString &value);
+    bool writeSection(quint32 tag, const QByteArray &payload);
+    bool fail(const QString &message);
+
+    QIODevice *m_device{nullptr};
+    QHash<QString, quint64> m_stringIndex;
+    QStringList m_strings;
+    QString m_errorString;
+};
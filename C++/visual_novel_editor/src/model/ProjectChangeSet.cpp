@@ -0,0 +1,82 @@
+#include "ProjectChangeSet.h"
+
+bool ProjectChangeSet::isEmpty() const
+{
+    return !reset && addedNodes.isEmpty() && removedNodes.isEmpty() && modifiedNodes.isEmpty()
+        && addedChoices.isEmpty() && removedChoices.isEmpty() && modifiedChoices.isEmpty();
+}
+
+void ProjectChangeSet::clear()
+{
+    *this = ProjectChangeSet{};
+}
+
+void ProjectChangeSet::recordNodeAdded(const ObjectId &nodeId)
+{
+    if (reset) {
+        return;
+    }
+    if (removedNodes.remove(nodeId)) {
+        modifiedNodes.insert(nodeId);
+        return;
+    }
+    addedNodes.insert(nodeId);
+}
+
+void ProjectChangeSet::recordNodeRemoved(const ObjectId &nodeId)
+{
+    if (reset) {
+        return;
+    }
+    modifiedNodes.remove(nodeId);
+    if (addedNodes.remove(nodeId)) {
+        return;
+    }
+    removedNodes.insert(nodeId);
+}
+
+void ProjectChangeSet::recordNodeModified(const ObjectId &nodeId)
+{
+    if (reset || addedNodes.contains(nodeId) || removedNodes.contains(nodeId)) {
+        return;
+    }
+    modifiedNodes.insert(nodeId);
+}
+
+void ProjectChangeSet::recordChoiceAdded(const ObjectId &sourceNodeId, const ObjectId &choiceId)
+{
+    if (reset) {
+        return;
+    }
+    if (removedChoices.remove(choiceId)) {
+        modifiedChoices.insert(choiceId, sourceNodeId);
+        return;
+    }
+    addedChoices.insert(choiceId, sourceNodeId);
+}
+
+void ProjectChangeSet::recordChoiceRemoved(const ObjectId &sourceNodeId, const ObjectId &choiceId)
+{
+    if (reset) {
+        return;
+    }
+    modifiedChoices.remove(choiceId);
+    if (addedChoices.remove(choiceId)) {
+        return;
+    }
+    removedChoices.insert(choiceId, sourceNodeId);
+}
+
+void ProjectChangeSet::recordChoiceModified(const ObjectId &sourceNodeId, const ObjectId &choiceId)
+{
+    if (reset || addedChoices.contains(choiceId) || removedChoices.contains(choiceId)) {
+        return;
+    }
+    modifiedChoices.insert(choiceId, sourceNodeId);
+}
+
+void ProjectChangeSet::recordReset()
+{
+    clear();
+    reset = true;
+}
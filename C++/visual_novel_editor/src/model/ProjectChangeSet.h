@@ -0,0 +1,29 @@
+#pragma once
+
+#include <QHash>
+#include <QSet>
+
+#include "ObjectId.h"
+
+struct ProjectChangeSet {
+    QSet<ObjectId> addedNodes;
+    QSet<ObjectId> removedNodes;
+    QSet<ObjectId> modifiedNodes;
+    // Choice id -> id of the node owning the choice.
+    QHash<ObjectId, ObjectId> addedChoices;
+    QHash<ObjectId, ObjectId> removedChoices;
+    QHash<ObjectId, ObjectId> modifiedChoices;
+    // Set when the whole project was replaced; the id sets are left empty.
+    bool reset{false};
+
+    [[nodiscard]] bool isEmpty() const;
+    void clear();
+
+    void recordNodeAdded(const ObjectId &nodeId);
+    void recordNodeRemoved(const ObjectId &nodeId);
+    void recordNodeModified(const ObjectId &nodeId);
+    void recordChoiceAdded(const ObjectId &sourceNodeId, const ObjectId &choiceId);
+    void recordChoiceRemoved(const ObjectId &sourceNodeId, const ObjectId &choiceId);
+    void recordChoiceModified(const ObjectId &sourceNodeId, const ObjectId &choiceId);
+    void recordReset();
+};
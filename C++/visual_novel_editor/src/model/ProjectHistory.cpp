@@ -0,0 +1,299 @@
+#include "ProjectHistory.h"
+
+#include <QSet>
+
+#include <utility>
+
+#include "Project.h"
+#include "ProjectChangeSet.h"
+
+namespace {
+constexpr qint64 kDefaultMemoryLimit = 64 * 1024 * 1024;
+constexpr int kDefaultMergeIntervalMs = 1000;
+
+qint64 textCost(const QString &text)
+{
+    return text.size() * qint64(sizeof(QChar));
+}
+
+qint64 imageCost(const StoryNode *node)
+{
+    if (!node) {
+        return 0;
+    }
+    qint64 cost = qint64(sizeof(StoryNode)) + textCost(node->title());
+    if (node->isScriptLoaded()) {
+        cost += textCost(node->script());
+    }
+    for (const Choice &choice : node->choices()) {
+        cost += qint64(sizeof(Choice)) + textCost(choice.text) + textCost(choice.condition.value_or(QString()));
+    }
+    return cost;
+}
+
+std::shared_ptr<const StoryNode> withoutScript(const StoryNode &node)
+{
+    auto image = std::make_shared<StoryNode>(node);
+    image->setScript(QString());
+    return image;
+}
+}
+
+ProjectHistory::ProjectHistory(Project *project, QObject *parent)
+    : QObject(parent)
+    , m_project(project)
+    , m_memoryLimit(kDefaultMemoryLimit)
+    , m_mergeInterval(kDefaultMergeIntervalMs)
+{
+    m_clock.start();
+    if (m_project) {
+        connect(m_project, &Project::changesCommitted, this, &ProjectHistory::onChangesCommitted);
+    }
+    resetState();
+}
+
+ProjectHistory::~ProjectHistory() = default;
+
+void ProjectHistory::undo()
+{
+    if (!canUndo()) {
+        return;
+    }
+    const bool couldRedo = canRedo();
+    --m_index;
+    apply(m_steps[m_index], true);
+    m_canMerge = false;
+    emitStateChanges(true, couldRedo);
+}
+
+void ProjectHistory::redo()
+{
+    if (!canRedo()) {
+        return;
+    }
+    const bool couldUndo = canUndo();
+    apply(m_steps[m_index], false);
+    ++m_index;
+    m_canMerge = false;
+    emitStateChanges(couldUndo, true);
+}
+
+void ProjectHistory::clear()
+{
+    const bool couldUndo = canUndo();
+    const bool couldRedo = canRedo();
+    m_steps.clear();
+    m_index = 0;
+    m_memoryUsage = 0;
+    m_canMerge = false;
+    emitStateChanges(couldUndo, couldRedo);
+}
+
+void ProjectHistory::setMemoryLimit(qint64 bytes)
+{
+    const bool couldUndo = canUndo();
+    const bool couldRedo = canRedo();
+    m_memoryLimit = bytes;
+    trim();
+    emitStateChanges(couldUndo, couldRedo);
+}
+
+void ProjectHistory::onChangesCommitted(const ProjectChangeSet &changes)
+{
+    if (changes.reset) {
+        resetState();
+        clear();
+        return;
+    }
+
+    QSet<ObjectId> nodeIds = changes.addedNodes;
+    nodeIds.unite(changes.removedNodes);
+    nodeIds.unite(changes.modifiedNodes);
+
+    const ProjectSnapshot previous = std::exchange(m_state, m_project->snapshot());
+    Step step;
+    for (const ObjectId &nodeId : std::as_const(nodeIds)) {
+        NodeImage before = previous.nodes().value(nodeId);
+        NodeImage after = m_state.nodes().value(nodeId);
+        if (m_isApplying || (!before && !after)) {
+            continue;
+        }
+
+        NodeChange change{nodeId, before, after, {}};
+        if (before && after) {
+            if (!before->hasSameScript(*after)) {
+                change.scriptDelta = TextDelta::between(before->script(), after->script());
+            } else if (before->title() == after->title() && before->position() == after->position()
+                       && before->type() == after->type() && before->choices() == after->choices()) {
+                continue;
+            }
+            change.before = withoutScript(*before);
+            change.after = withoutScript(*after);
+        }
+        step.changes.append(std::move(change));
+    }
+
+    if (m_isApplying || step.changes.isEmpty()) {
+        return;
+    }
+    step.time = m_clock.elapsed();
+    updateStep(step);
+    push(std::move(step));
+}
+
+void ProjectHistory::resetState()
+{
+    m_state = m_project ? m_project->snapshot() : ProjectSnapshot();
+}
+
+void ProjectHistory::push(Step step)
+{
+    const bool couldUndo = canUndo();
+    const bool couldRedo = canRedo();
+    if (!merge(step)) {
+        for (qsizetype i = m_index; i < m_steps.size(); ++i) {
+            m_memoryUsage -= m_steps[i].cost;
+        }
+        m_steps.erase(m_steps.begin() + m_index, m_steps.end());
+        m_memoryUsage += step.cost;
+        m_steps.append(std::move(step));
+        m_index = m_steps.size();
+    }
+    m_canMerge = true;
+    trim();
+    emitStateChanges(couldUndo, couldRedo);
+}
+
+bool ProjectHistory::merge(Step &step)
+{
+    if (!m_canMerge || m_steps.isEmpty() || m_index != m_steps.size()) {
+        return false;
+    }
+    Step &last = m_steps.last();
+    if (step.kind == StepKind::Other || step.kind != last.kind || step.changes.size() != last.changes.size()
+        || step.time - last.time > m_mergeInterval) {
+        return false;
+    }
+    QHash<ObjectId, NodeChange *> lastChanges;
+    for (NodeChange &change : last.changes) {
+        lastChanges.insert(change.nodeId, &change);
+    }
+    for (const NodeChange &change : std::as_const(step.changes)) {
+        if (!lastChanges.contains(change.nodeId)) {
+            return false;
+        }
+    }
+
+    for (const NodeChange &change : std::as_const(step.changes)) {
+        NodeChange *merged = lastChanges.value(change.nodeId);
+        merged->after = change.after;
+        if (step.kind != StepKind::Script) {
+            continue;
+        }
+        // Rebuild the script as it was before the earlier step and diff it
+        // against the current one.
+        const NodeImage current = m_state.nodes().value(change.nodeId);
+        const QString newScript = current ? current->script() : QString();
+        const TextDelta &later = change.scriptDelta;
+        const QString middle = later.revert(newScript);
+        TextDelta &earlier = merged->scriptDelta;
+        earlier = TextDelta::between(earlier.revert(middle), newScript);
+    }
+    m_memoryUsage -= last.cost;
+    updateStep(last);
+    last.time = step.time;
+    m_memoryUsage += last.cost;
+    return true;
+}
+
+void ProjectHistory::apply(const Step &step, bool isUndo)
+{
+    QHash<ObjectId, NodeImage> images;
+    images.reserve(step.changes.size());
+    for (const NodeChange &change : step.changes) {
+        const NodeImage &source = isUndo ? change.before : change.after;
+        if (!source || !change.before || !change.after) {
+            images.insert(change.nodeId, source);
+            continue;
+        }
+        auto image = std::make_shared<StoryNode>(*source);
+        const NodeImage current = m_state.nodes().value(change.nodeId);
+        const TextDelta &delta = change.scriptDelta;
+        if (delta.isEmpty()) {
+            if (current) {
+                image->copyScriptFrom(*current);
+            }
+        } else {
+            const QString script = current ? current->script() : QString();
+            image->setScript(isUndo ? delta.revert(script) : delta.apply(script));
+        }
+        images.insert(change.nodeId, std::move(image));
+    }
+
+    m_isApplying = true;
+    m_project->restoreNodes(images);
+    m_isApplying = false;
+}
+
+// The newest step is kept even when it alone is over the limit, so a large
+// delete can always be undone.
+void ProjectHistory::trim()
+{
+    while (m_memoryUsage > m_memoryLimit && m_steps.size() > 1) {
+        if (m_index > 1) {
+            m_memoryUsage -= m_steps.first().cost;
+            m_steps.removeFirst();
+            --m_index;
+        } else if (m_index < m_steps.size()) {
+            m_memoryUsage -= m_steps.last().cost;
+            m_steps.removeLast();
+        } else {
+            break;
+        }
+    }
+}
+
+void ProjectHistory::updateStep(Step &step) const
+{
+    step.cost = 0;
+    StepKind kind = StepKind::Other;
+    bool isFirst = true;
+    for (const NodeChange &change : std::as_const(step.changes)) {
+        step.cost += qint64(sizeof(NodeChange)) + imageCost(change.before.get()) + imageCost(change.after.get())
+            + textCost(change.scriptDelta.removed) + textCost(change.scriptDelta.inserted);
+
+        StepKind changeKind = StepKind::Other;
+        if (change.before && change.after) {
+            const StoryNode &before = *change.before;
+            const StoryNode &after = *change.after;
+            const bool titleChanged = before.title() != after.title();
+            const bool scriptChanged = !change.scriptDelta.isEmpty();
+            const bool moved = before.position() != after.position();
+            const bool otherChanged = before.type() != after.type() || before.choices() != after.choices();
+            if (!otherChanged && int(titleChanged) + int(scriptChanged) + int(moved) == 1) {
+                changeKind = titleChanged ? StepKind::Title : (scriptChanged ? StepKind::Script : StepKind::Move);
+            }
+        }
+        if (isFirst) {
+            kind = changeKind;
+            isFirst = false;
+        } else if (kind != changeKind) {
+            kind = StepKind::Other;
+        }
+    }
+    // Only moves merge across several nodes.
+    if (kind != StepKind::Move && step.changes.size() > 1) {
+        kind = StepKind::Other;
+    }
+    step.kind = kind;
+}
+
+void ProjectHistory::emitStateChanges(bool couldUndo, bool couldRedo)
+{
+    if (couldUndo != canUndo()) {
+        emit canUndoChanged(canUndo());
+    }
+    if (couldRedo != canRedo()) {
+        emit canRedoChanged(canRedo());
+    }
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <QElapsedTimer>
+#include <QHash>
+#include <QList>
+#include <QObject>
+#include <QString>
+
+#include <memory>
+
+#include "ProjectSnapshot.h"
+#include "StoryNode.h"
+#include "TextDelta.h"
+
+class Project;
+struct ProjectChangeSet;
+
+// Undo stack fed by the project's committed change sets, so every edit that
+// reaches the model (node and choice edits, moves, deletes, pastes) can be
+// undone without a command class per operation. A step keeps the before and
+// after state of the nodes it touched; for nodes that survive the step the
+// script is kept as a text delta instead of two full copies. Undoing or
+// redoing a step restores all of its nodes in one change set.
+class ProjectHistory : public QObject
+{
+    Q_OBJECT
+public:
+    explicit ProjectHistory(Project *project, QObject *parent = nullptr);
+    ~ProjectHistory() override;
+
+    [[nodiscard]] bool canUndo() const { return m_index > 0; }
+    [[nodiscard]] bool canRedo() const { return m_index < m_steps.size(); }
+    [[nodiscard]] qsizetype count() const { return m_steps.size(); }
+    [[nodiscard]] qsizetype index() const { return m_index; }
+    void undo();
+    void redo();
+    void clear();
+
+    // The oldest steps are dropped once the history holds more than this.
+    // The current state is not counted: it is the project's latest snapshot,
+    // whose nodes the project keeps either way.
+    void setMemoryLimit(qint64 bytes);
+    [[nodiscard]] qint64 memoryLimit() const { return m_memoryLimit; }
+    [[nodiscard]] qint64 memoryUsage() const { return m_memoryUsage; }
+
+    // Edits of the same field of one node, or moves of the same nodes, that
+    // follow each other within this interval become a single step.
+    void setMergeInterval(int msec) { m_mergeInterval = msec; }
+    [[nodiscard]] int mergeInterval() const { return m_mergeInterval; }
+    // Makes the next edit start a new step even if it could be merged.
+    void closeStep() { m_canMerge = false; }
+
+signals:
+    void canUndoChanged(bool canUndo);
+    void canRedoChanged(bool canRedo);
+
+private:
+    using NodeImage = std::shared_ptr<const StoryNode>;
+
+    enum class StepKind { Other, Title, Script, Move };
+
+    // A null image means the node did not exist on that side. When both
+    // exist, their scripts are empty and scriptDelta holds the change.
+    struct NodeChange {
+        ObjectId nodeId;
+        NodeImage before;
+        NodeImage after;
+        TextDelta scriptDelta;
+    };
+
+    struct Step {
+        QList<NodeChange> changes;
+        StepKind kind{StepKind::Other};
+        qint64 time{0};
+        qint64 cost{0};
+    };
+
+    void onChangesCommitted(const ProjectChangeSet &changes);
+    void resetState();
+    void push(Step step);
+    [[nodiscard]] bool merge(Step &step);
+    void apply(const Step &step, bool isUndo);
+    void trim();
+    void updateStep(Step &step) const;
+    void emitStateChanges(bool couldUndo, bool couldRedo);
+
+    Project *m_project{nullptr};
+    // Last reported state of every node, shared with the project's snapshots
+    // and with the steps that need it.
+    ProjectSnapshot m_state;
+    QList<Step> m_steps;
+    qsizetype m_index{0};
+    qint64 m_memoryLimit;
+    qint64 m_memoryUsage{0};
+    int m_mergeInterval;
+    bool m_canMerge{false};
+    bool m_isApplying{false};
+    QElapsedTimer m_clock;
+};
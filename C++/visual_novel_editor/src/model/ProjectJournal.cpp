@@ -0,0 +1,837 @@
+#include "ProjectJournal.h"
+
+#include <QCborStreamReader>
+#include <QCborStreamWriter>
+#include <QDateTime>
+#include <QFileInfo>
+#include <QPointF>
+#include <QSaveFile>
+#include <QSet>
+#include <QtConcurrentRun>
+#include <QtEndian>
+
+#include <cstring>
+#include <optional>
+#include <utility>
+
+#ifdef Q_OS_WIN
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#include "CborUtils.h"
+#include "Crc32.h"
+#include "Project.h"
+#include "ProjectChangeSet.h"
+#include "TextDelta.h"
+
+// Layout, integers little endian:
+//   header  "VNJL", quint16 version, quint16 flags,
+//           qint64 size and qint64 mtime (ms) of the project file it extends
+//   record  quint32 payload size, quint32 CRC-32 of the payload, CBOR payload
+//
+// Payloads are [0] for a commit marker, [1, id, title, script, type, x, y,
+// [[id, text, target, condition or null], ...]] for the full state of an
+// added node, [2, id] for a removed node and [3, id, title, type, x, y,
+// [choices...], script edit] for an edited one, where every field that did
+// not change is null. A script edit is [position, removed size, inserted
+// text, checksum before, checksum after], the checksums being CRC-32 over
+// the UTF-16 script. Replaying a record sets state, and a script edit is
+// only applied to the text it was made on, so records that were already
+// folded into the project file can be replayed again harmlessly.
+//
+// The compacting flag is set, and synced, before a compaction replaces the
+// project file and cleared with the header that describes the new file. A
+// journal carrying it is applied even if the project file no longer matches,
+// since a crash in between leaves the compacted file behind.
+
+// The fields of a node an edit record sets; the others are left alone.
+struct JournalNodeEdit {
+    struct Script {
+        qsizetype position{0};
+        qsizetype removedSize{0};
+        QString inserted;
+        quint32 before{0};
+        quint32 after{0};
+    };
+
+    std::optional<QString> title;
+    std::optional<StoryNode::Type> type;
+    std::optional<QPointF> position;
+    std::optional<QList<Choice>> choices;
+    std::optional<Script> script;
+};
+
+namespace {
+constexpr char kMagic[] = {'V', 'N', 'J', 'L'};
+constexpr quint16 kVersion = 2;
+// Version 1 journals lack edit records and are otherwise the same.
+constexpr quint16 kMinVersion = 1;
+constexpr qsizetype kHeaderSize = 24;
+constexpr qsizetype kFlagsOffset = 6;
+constexpr quint16 kCompactingFlag = 0x1;
+constexpr qsizetype kFrameHeaderSize = 8;
+constexpr qint64 kDefaultCompactionThreshold = 4 * 1024 * 1024;
+
+bool syncFile(QFile &file)
+{
+    if (!file.flush()) {
+        return false;
+    }
+#ifdef Q_OS_WIN
+    return _commit(file.handle()) == 0;
+#else
+    return ::fsync(file.handle()) == 0;
+#endif
+}
+
+QByteArray encodeCommit()
+{
+    QByteArray payload;
+    QCborStreamWriter cbor(&payload);
+    cbor.startArray(1);
+    cbor.append(quint64(0));
+    cbor.endArray();
+    return payload;
+}
+
+quint32 scriptChecksum(const QString &script)
+{
+    return crc32(QByteArrayView(reinterpret_cast<const char *>(script.constData()),
+                                script.size() * qsizetype(sizeof(QChar))));
+}
+
+void encodeChoices(QCborStreamWriter &cbor, const QList<Choice> &choices)
+{
+    cbor.startArray(quint64(choices.size()));
+    for (const Choice &choice : choices) {
+        cbor.startArray(4);
+        cbor.append(choice.id.toString());
+        cbor.append(choice.text);
+        cbor.append(choice.targetNodeId.toString());
+        if (choice.condition.has_value()) {
+            cbor.append(*choice.condition);
+        } else {
+            cbor.appendNull();
+        }
+        cbor.endArray();
+    }
+    cbor.endArray();
+}
+
+QByteArray encodeUpsert(const StoryNode &node)
+{
+    QByteArray payload;
+    QCborStreamWriter cbor(&payload);
+    const QByteArray script = node.scriptUtf8();
+    cbor.startArray(8);
+    cbor.append(quint64(1));
+    cbor.append(node.id().toString());
+    cbor.append(node.title());
+    cbor.appendTextString(script.constData(), script.size());
+    cbor.append(quint64(node.type()));
+    cbor.append(node.position().x());
+    cbor.append(node.position().y());
+    encodeChoices(cbor, node.choices());
+    cbor.endArray();
+    return payload;
+}
+
+// Empty when nothing the journal keeps differs.
+QByteArray encodeEdit(const StoryNode &before, const StoryNode &after)
+{
+    const bool titleChanged = before.title() != after.title();
+    const bool typeChanged = before.type() != after.type();
+    const bool moved = before.position() != after.position();
+    const bool choicesChanged = before.choices() != after.choices();
+    const bool scriptChanged = !before.hasSameScript(after);
+    if (!titleChanged && !typeChanged && !moved && !choicesChanged && !scriptChanged) {
+        return {};
+    }
+
+    QByteArray payload;
+    QCborStreamWriter cbor(&payload);
+    cbor.startArray(8);
+    cbor.append(quint64(3));
+    cbor.append(after.id().toString());
+    titleChanged ? cbor.append(after.title()) : cbor.appendNull();
+    typeChanged ? cbor.append(quint64(after.type())) : cbor.appendNull();
+    if (moved) {
+        cbor.append(after.position().x());
+        cbor.append(after.position().y());
+    } else {
+        cbor.appendNull();
+        cbor.appendNull();
+    }
+    if (choicesChanged) {
+        encodeChoices(cbor, after.choices());
+    } else {
+        cbor.appendNull();
+    }
+    if (scriptChanged) {
+        const QString beforeScript = before.script();
+        const QString afterScript = after.script();
+        const TextDelta delta = TextDelta::between(beforeScript, afterScript);
+        cbor.startArray(5);
+        cbor.append(quint64(delta.position));
+        cbor.append(quint64(delta.removed.size()));
+        cbor.append(delta.inserted);
+        cbor.append(quint64(scriptChecksum(beforeScript)));
+        cbor.append(quint64(scriptChecksum(afterScript)));
+        cbor.endArray();
+    } else {
+        cbor.appendNull();
+    }
+    cbor.endArray();
+    return payload;
+}
+
+QByteArray encodeRemove(const ObjectId &nodeId)
+{
+    QByteArray payload;
+    QCborStreamWriter cbor(&payload);
+    cbor.startArray(2);
+    cbor.append(quint64(2));
+    cbor.append(nodeId.toString());
+    cbor.endArray();
+    return payload;
+}
+
+bool decodeChoice(QCborStreamReader &cbor, Choice &choice)
+{
+    if (!enterCborArray(cbor) || !readCborId(cbor, choice.id) || !readCborText(cbor, choice.text)
+        || !readCborId(cbor, choice.targetNodeId)) {
+        return false;
+    }
+    if (cbor.isNull()) {
+        if (!cbor.next()) {
+            return false;
+        }
+    } else {
+        QString condition;
+        if (!readCborText(cbor, condition)) {
+            return false;
+        }
+        choice.condition = std::move(condition);
+    }
+    return leaveCborArray(cbor);
+}
+
+bool decodeNode(QCborStreamReader &cbor, StoryNode &node)
+{
+    ObjectId id;
+    QString title;
+    QString script;
+    quint64 type = 0;
+    double x = 0.0;
+    double y = 0.0;
+    if (!readCborId(cbor, id) || !readCborText(cbor, title) || !readCborText(cbor, script)
+        || !readCborUnsigned(cbor, type) || !readCborDouble(cbor, x) || !readCborDouble(cbor, y)
+        || !enterCborArray(cbor)) {
+        return false;
+    }
+    node.setId(id);
+    node.setTitle(title);
+    node.setScript(script);
+    node.setType(type <= quint64(StoryNode::Type::End) ? StoryNode::Type(type) : StoryNode::Type::Dialogue);
+    node.setPosition(QPointF(x, y));
+    while (cbor.hasNext()) {
+        Choice choice;
+        if (!decodeChoice(cbor, choice)) {
+            return false;
+        }
+        node.choices().append(std::move(choice));
+    }
+    return cbor.leaveContainer();
+}
+
+// Null fields are skipped and leave the optional unset.
+bool skipNull(QCborStreamReader &cbor, bool &isNull)
+{
+    isNull = cbor.isNull();
+    return !isNull || cbor.next();
+}
+
+bool decodeEdit(QCborStreamReader &cbor, ObjectId &id, JournalNodeEdit &edit)
+{
+    bool isNull = false;
+    if (!readCborId(cbor, id) || !skipNull(cbor, isNull)) {
+        return false;
+    }
+    if (!isNull) {
+        QString title;
+        if (!readCborText(cbor, title)) {
+            return false;
+        }
+        edit.title = std::move(title);
+    }
+    if (!skipNull(cbor, isNull)) {
+        return false;
+    }
+    if (!isNull) {
+        quint64 type = 0;
+        if (!readCborUnsigned(cbor, type)) {
+            return false;
+        }
+        edit.type = type <= quint64(StoryNode::Type::End) ? StoryNode::Type(type) : StoryNode::Type::Dialogue;
+    }
+    if (!skipNull(cbor, isNull)) {
+        return false;
+    }
+    if (!isNull) {
+        double x = 0.0;
+        double y = 0.0;
+        if (!readCborDouble(cbor, x) || !readCborDouble(cbor, y)) {
+            return false;
+        }
+        edit.position = QPointF(x, y);
+    } else if (!skipNull(cbor, isNull) || !isNull) {
+        return false;
+    }
+    if (!skipNull(cbor, isNull)) {
+        return false;
+    }
+    if (!isNull) {
+        QList<Choice> choices;
+        if (!enterCborArray(cbor)) {
+            return false;
+        }
+        while (cbor.hasNext()) {
+            Choice choice;
+            if (!decodeChoice(cbor, choice)) {
+                return false;
+            }
+            choices.append(std::move(choice));
+        }
+        if (!cbor.leaveContainer()) {
+            return false;
+        }
+        edit.choices = std::move(choices);
+    }
+    if (!skipNull(cbor, isNull)) {
+        return false;
+    }
+    if (!isNull) {
+        JournalNodeEdit::Script script;
+        quint64 position = 0;
+        quint64 removedSize = 0;
+        quint64 before = 0;
+        quint64 after = 0;
+        if (!enterCborArray(cbor) || !readCborUnsigned(cbor, position) || !readCborUnsigned(cbor, removedSize)
+            || !readCborText(cbor, script.inserted) || !readCborUnsigned(cbor, before)
+            || !readCborUnsigned(cbor, after) || !leaveCborArray(cbor)) {
+            return false;
+        }
+        script.position = qsizetype(position);
+        script.removedSize = qsizetype(removedSize);
+        script.before = quint32(before);
+        script.after = quint32(after);
+        edit.script = std::move(script);
+    }
+    return true;
+}
+
+void applyEdit(StoryNode &node, const JournalNodeEdit &edit)
+{
+    if (edit.title) {
+        node.setTitle(*edit.title);
+    }
+    if (edit.type) {
+        node.setType(*edit.type);
+    }
+    if (edit.position) {
+        node.setPosition(*edit.position);
+    }
+    if (edit.choices) {
+        node.choices() = *edit.choices;
+    }
+    if (edit.script) {
+        // Skipped for a script that already holds the edit, as after a
+        // compaction cut short by a crash, or that is not the one it was
+        // made on.
+        const JournalNodeEdit::Script &script = *edit.script;
+        const QString current = node.script();
+        const quint32 checksum = scriptChecksum(current);
+        if (checksum == script.before && checksum != script.after && script.position >= 0 && script.removedSize >= 0
+            && script.position + script.removedSize <= current.size()) {
+            node.setScript(current.left(script.position) + script.inserted
+                           + current.mid(script.position + script.removedSize));
+        }
+    }
+}
+
+struct Fingerprint {
+    qint64 size{0};
+    qint64 modified{0};
+};
+
+Fingerprint fingerprintOf(const QString &fileName)
+{
+    const QFileInfo info(fileName);
+    return {info.size(), info.lastModified().toMSecsSinceEpoch()};
+}
+}
+
+ProjectJournal::ProjectJournal(Project *project, QObject *parent)
+    : QObject(parent)
+    , m_project(project)
+    , m_compactionThreshold(kDefaultCompactionThreshold)
+{
+    if (m_project) {
+        connect(m_project, &Project::changesCommitted, this, &ProjectJournal::onChangesCommitted);
+    }
+    connect(&m_compactionWatcher, &QFutureWatcher<QString>::finished, this, &ProjectJournal::finishCompaction);
+}
+
+ProjectJournal::~ProjectJournal()
+{
+    close();
+}
+
+QString ProjectJournal::journalFileName(const QString &projectFileName)
+{
+    return projectFileName + QStringLiteral(".journal");
+}
+
+bool ProjectJournal::create(const QString &projectFileName)
+{
+    // A project file that was just written in full already holds more than
+    // its old journal; folding the journal in would undo the difference.
+    closeJournal(projectFileName != m_projectFileName);
+    m_projectFileName = projectFileName;
+    m_file.setFileName(journalFileName(projectFileName));
+    if (!m_file.open(QIODevice::ReadWrite | QIODevice::Truncate)) {
+        return fail(m_file.errorString());
+    }
+    if (!writeHeader(&m_file) || !syncFile(m_file)) {
+        const QString error = m_file.errorString();
+        m_file.close();
+        return fail(error);
+    }
+    m_committedSize = kHeaderSize;
+    m_state = m_project ? m_project->snapshot() : ProjectSnapshot();
+    m_errorString.clear();
+    return true;
+}
+
+bool ProjectJournal::open(const QString &projectFileName)
+{
+    close();
+    const QString fileName = journalFileName(projectFileName);
+    if (!QFile::exists(fileName)) {
+        return create(projectFileName);
+    }
+
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return fail(file.errorString());
+    }
+    const QByteArray data = file.readAll();
+    file.close();
+
+    const Fingerprint base = fingerprintOf(projectFileName);
+    const quint16 version = data.size() >= kHeaderSize ? qFromLittleEndian<quint16>(data.constData() + 4) : 0;
+    const bool isJournal = data.size() >= kHeaderSize && data.startsWith(QByteArrayView(kMagic, sizeof(kMagic)))
+        && version >= kMinVersion && version <= kVersion;
+    const bool matchesBase = isJournal && qFromLittleEndian<qint64>(data.constData() + 8) == base.size
+        && qFromLittleEndian<qint64>(data.constData() + 16) == base.modified;
+    const bool wasCompacting =
+        isJournal && (qFromLittleEndian<quint16>(data.constData() + kFlagsOffset) & kCompactingFlag) != 0;
+    if (!matchesBase && !wasCompacting) {
+        // The project file was replaced behind the journal's back; keep the
+        // journal around for inspection but do not apply it.
+        const QString staleName = fileName + QStringLiteral(".stale");
+        QFile::remove(staleName);
+        QFile::rename(fileName, staleName);
+        return fail(QStringLiteral("The journal does not match the project file and was moved to %1")
+                        .arg(staleName));
+    }
+
+    QList<Record> committed;
+    QList<Record> pending;
+    qint64 committedSize = kHeaderSize;
+    qint64 offset = kHeaderSize;
+    readRecords(data, committed, pending, committedSize, offset);
+
+    m_projectFileName = projectFileName;
+    applyRecords(m_project, committed);
+
+    m_file.setFileName(fileName);
+    // A compaction interrupted by a crash may have left a new project file;
+    // the header is pointed at whichever file is there now. Older journals
+    // get the current version before edit records follow their own.
+    const bool rewriteHeader = wasCompacting || version != kVersion;
+    if (!m_file.open(QIODevice::ReadWrite) || !m_file.resize(offset)
+        || (rewriteHeader && (!m_file.seek(0) || !writeHeader(&m_file) || !syncFile(m_file)))
+        || !m_file.seek(offset)) {
+        const QString error = m_file.errorString();
+        m_file.close();
+        return fail(error);
+    }
+    m_committedSize = committedSize;
+    m_uncommitted = std::move(pending);
+    resetState();
+    m_errorString.clear();
+    return true;
+}
+
+void ProjectJournal::close()
+{
+    closeJournal(true);
+}
+
+void ProjectJournal::closeJournal(bool fold)
+{
+    waitForCompaction();
+    // Saved records are left for open() to replay, so closing costs nothing
+    // on the GUI thread. Only a tail that should already have been compacted,
+    // as after a failed compaction, is folded into the project file here.
+    if (fold && isOpen() && m_committedSize > kHeaderSize && m_committedSize > m_compactionThreshold) {
+        foldCommitted();
+    }
+    m_file.close();
+    m_uncommitted.clear();
+    m_state = ProjectSnapshot();
+    m_committedSize = 0;
+    m_projectFileName.clear();
+}
+
+void ProjectJournal::recoverUncommitted()
+{
+    applyRecords(m_project, m_uncommitted);
+    if (isOpen()) {
+        resetState();
+    }
+}
+
+void ProjectJournal::resetState()
+{
+    if (!m_project) {
+        m_state = ProjectSnapshot();
+        return;
+    }
+    // Scripts converted from HTML on load differ from the project file, so
+    // those nodes are left out and recorded in full once they are reported.
+    const ProjectSnapshot snapshot = m_project->snapshot();
+    SharedNodeMap nodes = snapshot.nodes();
+    for (const ObjectId &nodeId : m_project->convertedScriptNodeIds()) {
+        nodes.remove(nodeId);
+    }
+    m_state = ProjectSnapshot(snapshot.version(), std::move(nodes));
+}
+
+void ProjectJournal::discardUncommitted()
+{
+    if (!isOpen()) {
+        return;
+    }
+    if (!m_file.resize(m_committedSize) || !m_file.seek(m_committedSize)) {
+        fail(m_file.errorString());
+    }
+    m_uncommitted.clear();
+}
+
+bool ProjectJournal::commit()
+{
+    if (!isOpen()) {
+        return fail(QStringLiteral("The journal is not open"));
+    }
+    if (!appendRecord(encodeCommit()) || !syncFile(m_file)) {
+        return fail(m_file.errorString());
+    }
+    m_committedSize = m_file.pos();
+    m_uncommitted.clear();
+    m_errorString.clear();
+    if (m_committedSize > m_compactionThreshold && !isCompacting()) {
+        startCompaction();
+    }
+    return true;
+}
+
+void ProjectJournal::waitForCompaction()
+{
+    if (m_compaction.isValid()) {
+        m_compaction.waitForFinished();
+        finishCompaction();
+    }
+}
+
+void ProjectJournal::onChangesCommitted(const ProjectChangeSet &changes)
+{
+    if (!isOpen() || m_isReplaying || !m_project) {
+        return;
+    }
+    // A reset means another project was loaded or created; this journal no
+    // longer describes the model.
+    if (changes.reset) {
+        close();
+        return;
+    }
+
+    // Nodes the journal already holds are recorded as the fields that
+    // changed, so typing into a long script appends what was typed.
+    const ProjectSnapshot previous = std::exchange(m_state, m_project->snapshot());
+    for (const ObjectId &nodeId : changes.removedNodes) {
+        appendRecord(encodeRemove(nodeId));
+        m_uncommitted.append(Record{RecordType::RemoveNode, nodeId});
+    }
+    QSet<ObjectId> written = changes.addedNodes;
+    written.unite(changes.modifiedNodes);
+    for (const ObjectId &nodeId : std::as_const(written)) {
+        const StoryNode *node = m_state.node(nodeId);
+        if (!node) {
+            continue;
+        }
+        const StoryNode *before = previous.node(nodeId);
+        if (!before) {
+            appendRecord(encodeUpsert(*node));
+            m_uncommitted.append(Record{RecordType::UpsertNode, nodeId});
+        } else if (const QByteArray edit = encodeEdit(*before, *node); !edit.isEmpty()) {
+            appendRecord(edit);
+            m_uncommitted.append(Record{RecordType::EditNode, nodeId});
+        }
+    }
+    // Reaching the OS is enough to survive an editor crash; commit() syncs.
+    m_file.flush();
+}
+
+bool ProjectJournal::appendRecord(const QByteArray &payload)
+{
+    char header[kFrameHeaderSize];
+    qToLittleEndian<quint32>(quint32(payload.size()), header);
+    qToLittleEndian<quint32>(crc32(payload), header + 4);
+    if (m_file.write(header, kFrameHeaderSize) != kFrameHeaderSize || m_file.write(payload) != payload.size()) {
+        return fail(m_file.errorString());
+    }
+    return true;
+}
+
+void ProjectJournal::readRecords(const QByteArray &data, QList<Record> &committed, QList<Record> &pending,
+                                 qint64 &committedSize, qint64 &offset)
+{
+    // Records are read up to the first torn or damaged one, which is where
+    // the last session stopped writing.
+    while (data.size() - offset >= kFrameHeaderSize) {
+        const quint32 size = qFromLittleEndian<quint32>(data.constData() + offset);
+        const quint32 checksum = qFromLittleEndian<quint32>(data.constData() + offset + 4);
+        if (data.size() - offset - kFrameHeaderSize < qint64(size)) {
+            break;
+        }
+        const QByteArrayView payload(data.constData() + offset + kFrameHeaderSize, size);
+        if (crc32(payload) != checksum) {
+            break;
+        }
+
+        QCborStreamReader cbor(payload.data(), payload.size());
+        quint64 type = 0;
+        if (!enterCborArray(cbor) || !readCborUnsigned(cbor, type)) {
+            break;
+        }
+        Record record;
+        record.type = RecordType(type);
+        if (record.type == RecordType::UpsertNode) {
+            record.node = std::make_shared<StoryNode>();
+            if (!decodeNode(cbor, *record.node)) {
+                break;
+            }
+            record.nodeId = record.node->id();
+        } else if (record.type == RecordType::RemoveNode) {
+            if (!readCborId(cbor, record.nodeId)) {
+                break;
+            }
+        } else if (record.type == RecordType::EditNode) {
+            auto edit = std::make_shared<JournalNodeEdit>();
+            if (!decodeEdit(cbor, record.nodeId, *edit)) {
+                break;
+            }
+            record.edit = std::move(edit);
+        } else if (record.type != RecordType::Commit) {
+            break;
+        }
+        if (!leaveCborArray(cbor)) {
+            break;
+        }
+
+        offset += kFrameHeaderSize + size;
+        if (record.type == RecordType::Commit) {
+            committed.append(pending);
+            pending.clear();
+            committedSize = offset;
+        } else {
+            pending.append(std::move(record));
+        }
+    }
+}
+
+void ProjectJournal::applyRecords(Project *project, const QList<Record> &records)
+{
+    if (!project || records.isEmpty()) {
+        return;
+    }
+    StoryNodeMap nodes;
+    for (const StoryNode &node : project->nodes()) {
+        nodes.insert(node.id(), std::make_shared<StoryNode>(node));
+    }
+    for (const Record &record : records) {
+        if (record.type == RecordType::RemoveNode) {
+            nodes.remove(record.nodeId);
+        } else if (record.type == RecordType::UpsertNode && record.node) {
+            // Records written by older editors may still hold HTML.
+            auto node = std::make_shared<StoryNode>(*record.node);
+            node->convertLegacyScript();
+            nodes.insert(record.nodeId, std::move(node));
+        } else if (record.type == RecordType::EditNode && record.edit) {
+            if (const auto it = nodes.find(record.nodeId); it != nodes.end() && *it) {
+                applyEdit(**it, *record.edit);
+            }
+        }
+    }
+    m_isReplaying = true;
+    project->adoptNodes(std::move(nodes));
+    m_isReplaying = false;
+}
+
+bool ProjectJournal::foldCommitted()
+{
+    // The model may hold unsaved edits, or already another project, so the
+    // saved state is rebuilt from the project file and the journal.
+    if (!m_file.flush() || !m_file.seek(0)) {
+        return fail(m_file.errorString());
+    }
+    const QByteArray data = m_file.readAll();
+    QList<Record> committed;
+    QList<Record> pending;
+    qint64 committedSize = kHeaderSize;
+    qint64 end = kHeaderSize;
+    readRecords(data, committed, pending, committedSize, end);
+
+    Project saved;
+    if (!saved.loadFromFile(m_projectFileName)) {
+        return fail(saved.errorString());
+    }
+    applyRecords(&saved, committed);
+    if (!setCompacting(true)) {
+        return false;
+    }
+    if (m_project) {
+        m_project->releaseScriptFile(m_projectFileName);
+    }
+    if (!saved.saveToFile(m_projectFileName)) {
+        setCompacting(false);
+        return fail(saved.errorString());
+    }
+
+    // Only the unsaved records are left for the next open to offer.
+    const QByteArray tail = data.mid(committedSize, end - committedSize);
+    m_file.close();
+    QSaveFile rewritten(m_file.fileName());
+    if (!rewritten.open(QIODevice::WriteOnly) || !writeHeader(&rewritten) || rewritten.write(tail) != tail.size()
+        || !rewritten.commit()) {
+        return fail(rewritten.errorString());
+    }
+    return true;
+}
+
+bool ProjectJournal::setCompacting(bool compacting)
+{
+    char flags[sizeof(quint16)];
+    qToLittleEndian<quint16>(compacting ? kCompactingFlag : 0, flags);
+    const qint64 end = m_file.pos();
+    if (!m_file.seek(kFlagsOffset) || m_file.write(flags, sizeof(flags)) != qint64(sizeof(flags))
+        || !m_file.seek(end) || !syncFile(m_file)) {
+        return fail(m_file.errorString());
+    }
+    return true;
+}
+
+bool ProjectJournal::writeHeader(QIODevice *device)
+{
+    const Fingerprint base = fingerprintOf(m_projectFileName);
+    char header[kHeaderSize] = {};
+    memcpy(header, kMagic, sizeof(kMagic));
+    qToLittleEndian<quint16>(kVersion, header + 4);
+    qToLittleEndian<qint64>(base.size, header + 8);
+    qToLittleEndian<qint64>(base.modified, header + 16);
+    return device->write(header, kHeaderSize) == kHeaderSize;
+}
+
+void ProjectJournal::startCompaction()
+{
+    if (!m_project) {
+        return;
+    }
+    if (!setCompacting(true)) {
+        return;
+    }
+    m_project->releaseScriptFile(m_projectFileName);
+
+    // The model keeps changing while the worker runs; those edits stay in
+    // the journal.
+    const ProjectSnapshot snapshot = m_project->snapshot();
+    m_compactionOffset = m_committedSize;
+    const QString fileName = m_projectFileName;
+    m_compaction = QtConcurrent::run([snapshot, fileName]() {
+        QString error;
+        if (!Project::saveNodesToFile(snapshot.nodes(), fileName, QJsonDocument::Indented, &error)
+            && error.isEmpty()) {
+            error = QStringLiteral("Unable to write %1").arg(fileName);
+        }
+        return error;
+    });
+    m_compactionWatcher.setFuture(m_compaction);
+}
+
+void ProjectJournal::finishCompaction()
+{
+    if (!m_compaction.isValid() || !m_compaction.isFinished()) {
+        return;
+    }
+    const QString error = m_compaction.result();
+    m_compaction = {};
+    if (!error.isEmpty()) {
+        // The project file was left as it was.
+        setCompacting(false);
+        fail(error);
+        emit compactionFinished(false);
+        return;
+    }
+
+    // The project file now holds everything up to m_compactionOffset; start
+    // the journal over with whatever was recorded since.
+    m_file.flush();
+    const qint64 end = m_file.pos();
+    bool succeeded = m_file.seek(m_compactionOffset);
+    const QByteArray tail = succeeded ? m_file.readAll() : QByteArray();
+    m_file.close();
+
+    // The new header carries no compacting flag.
+    QSaveFile rewritten(m_file.fileName());
+    succeeded = succeeded && rewritten.open(QIODevice::WriteOnly) && writeHeader(&rewritten)
+        && rewritten.write(tail) == tail.size() && rewritten.commit();
+    if (!succeeded) {
+        fail(rewritten.errorString());
+    }
+
+    if (!m_file.open(QIODevice::ReadWrite)) {
+        fail(m_file.errorString());
+        emit compactionFinished(false);
+        return;
+    }
+    if (succeeded) {
+        m_committedSize = kHeaderSize + (m_committedSize - m_compactionOffset);
+    } else {
+        // Records replay idempotently, so pointing the old journal at the new
+        // project file keeps it valid; this also clears the compacting flag.
+        m_file.seek(0);
+        writeHeader(&m_file);
+    }
+    m_file.seek(succeeded ? kHeaderSize + (end - m_compactionOffset) : end);
+    emit compactionFinished(succeeded);
+}
+
+bool ProjectJournal::fail(const QString &message)
+{
+    m_errorString = message;
+    return false;
+}
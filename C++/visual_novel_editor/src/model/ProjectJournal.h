@@ -0,0 +1,106 @@
+#pragma once
+
+#include <QByteArray>
+#include <QFile>
+#include <QFuture>
+#include <QFutureWatcher>
+#include <QList>
+#include <QObject>
+#include <QString>
+
+#include <memory>
+
+#include "ProjectSnapshot.h"
+#include "StoryNode.h"
+
+class Project;
+struct JournalNodeEdit;
+struct ProjectChangeSet;
+
+// Append-only log of model edits kept beside a project file as
+// "<project>.journal". Saving appends a commit marker instead of rewriting
+// the project; the records are folded back into the project file by a
+// background compaction once the journal grows past a threshold, and until
+// then open() applies them on top of the file it loaded. Records after the last commit marker are the unsaved
+// edits of a session that ended without saving and can be recovered on the
+// next open.
+class ProjectJournal : public QObject
+{
+    Q_OBJECT
+public:
+    explicit ProjectJournal(Project *project, QObject *parent = nullptr);
+    ~ProjectJournal() override;
+
+    static QString journalFileName(const QString &projectFileName);
+
+    // Starts an empty journal for a project that was just written in full.
+    bool create(const QString &projectFileName);
+    // Attaches to a project that was just loaded and applies the committed
+    // records of its journal, if any.
+    [[nodiscard]] bool open(const QString &projectFileName);
+    // Detaches from the project file. Saved records stay in the journal
+    // unless they are past the compaction threshold, in which case they are
+    // folded into the project file; unsaved records stay for the next open.
+    void close();
+    [[nodiscard]] bool isOpen() const { return m_file.isOpen(); }
+    [[nodiscard]] QString projectFileName() const { return m_projectFileName; }
+
+    [[nodiscard]] bool hasUncommittedRecords() const { return !m_uncommitted.isEmpty(); }
+    void recoverUncommitted();
+    void discardUncommitted();
+
+    // Marks everything recorded so far as saved and syncs the journal.
+    [[nodiscard]] bool commit();
+
+    void setCompactionThreshold(qint64 bytes) { m_compactionThreshold = bytes; }
+    [[nodiscard]] qint64 compactionThreshold() const { return m_compactionThreshold; }
+    [[nodiscard]] bool isCompacting() const { return m_compaction.isRunning(); }
+    // Blocks until a running compaction has finished and been applied.
+    void waitForCompaction();
+
+    [[nodiscard]] QString errorString() const { return m_errorString; }
+
+signals:
+    void compactionFinished(bool succeeded);
+
+private:
+    enum class RecordType : quint64 { Commit = 0, UpsertNode = 1, RemoveNode = 2, EditNode = 3 };
+
+    // Records read back from the file carry the node or the edit.
+    struct Record {
+        RecordType type{RecordType::Commit};
+        ObjectId nodeId;
+        std::shared_ptr<StoryNode> node;
+        std::shared_ptr<const JournalNodeEdit> edit;
+    };
+
+    void onChangesCommitted(const ProjectChangeSet &changes);
+    bool appendRecord(const QByteArray &payload);
+    // Reads from offset on; committedSize ends up past the last commit
+    // marker, offset past the last whole record.
+    static void readRecords(const QByteArray &data, QList<Record> &committed, QList<Record> &pending,
+                            qint64 &committedSize, qint64 &offset);
+    void applyRecords(Project *project, const QList<Record> &records);
+    void resetState();
+    bool foldCommitted();
+    void closeJournal(bool fold);
+    bool setCompacting(bool compacting);
+    bool writeHeader(QIODevice *device);
+    void startCompaction();
+    void finishCompaction();
+    bool fail(const QString &message);
+
+    Project *m_project{nullptr};
+    QString m_projectFileName;
+    QFile m_file;
+    QList<Record> m_uncommitted;
+    qint64 m_committedSize{0};
+    qint64 m_compactionThreshold;
+    QFuture<QString> m_compaction;
+    QFutureWatcher<QString> m_compactionWatcher;
+    qint64 m_compactionOffset{0};
+    bool m_isReplaying{false};
+    // The model as the journal last recorded it, to diff edits against.
+    ProjectSnapshot m_state;
+    QString m_errorString;
+};
@@ -0,0 +1,284 @@
+#include "ProjectJsonReader.h"
+
+#include <QIODevice>
+
+#include <utility>
+
+namespace {
+constexpr qint64 kProgressStep = 256 * 1024;
+using Token = JsonStreamReader::Token;
+}
+
+ProjectJsonReader::ProjectJsonReader(QIODevice *device)
+    : m_device(device)
+    , m_reader(device)
+{
+}
+
+void ProjectJsonReader::setProgressCallback(std::function<bool(qint64, qint64)> callback)
+{
+    m_progressCallback = std::move(callback);
+}
+
+bool ProjectJsonReader::read(StoryNodeMap &nodes)
+{
+    m_wasCanceled = false;
+    m_errorString.clear();
+    m_totalBytes = m_device ? m_device->size() : 0;
+    m_nextProgressAt = 0;
+
+    if (!reportProgress()) {
+        return false;
+    }
+    if (m_reader.readNext() != Token::BeginObject) {
+        return fail(QStringLiteral("Project file is not a JSON object"));
+    }
+
+    while (true) {
+        const Token token = m_reader.readNext();
+        if (token == Token::EndObject) {
+            break;
+        }
+        if (token != Token::Name) {
+            return fail(QString());
+        }
+        if (m_reader.name() == QStringLiteral("nodes")) {
+            if (!readNodes(nodes)) {
+                return false;
+            }
+        } else if (!m_reader.skipValue()) {
+            return fail(QString());
+        }
+    }
+
+    if (m_reader.readNext() != Token::EndDocument) {
+        return fail(QString());
+    }
+    m_nextProgressAt = 0;
+    return reportProgress();
+}
+
+bool ProjectJsonReader::readNodes(StoryNodeMap &nodes)
+{
+    if (m_reader.readNext() != Token::BeginArray) {
+        return m_reader.skipCurrent() || fail(QString());
+    }
+
+    while (true) {
+        const Token token = m_reader.readNext();
+        if (token == Token::EndArray) {
+            return true;
+        }
+        if (token != Token::BeginObject) {
+            if (!m_reader.skipCurrent()) {
+                return fail(QString());
+            }
+            continue;
+        }
+
+        auto node = std::make_shared<StoryNode>();
+        if (!readNode(*node)) {
+            return false;
+        }
+        const ObjectId id = node->id();
+        nodes.insert(id, std::move(node));
+
+        if (!reportProgress()) {
+            return false;
+        }
+    }
+}
+
+bool ProjectJsonReader::readNode(StoryNode &node)
+{
+    while (true) {
+        const Token token = m_reader.readNext();
+        if (token == Token::EndObject) {
+            return true;
+        }
+        if (token != Token::Name) {
+            return fail(QString());
+        }
+
+        const QString key = m_reader.name();
+        bool ok = true;
+        QString text;
+        if (key == QStringLiteral("id")) {
+            ObjectId id;
+            ok = readId(id);
+            node.setId(id);
+        } else if (key == QStringLiteral("title")) {
+            ok = readString(text);
+            node.setTitle(text);
+        } else if (key == QStringLiteral("script")) {
+            ok = readString(text);
+            node.setScript(text);
+        } else if (key == QStringLiteral("type")) {
+            ok = readString(text);
+            node.setType(StoryNode::typeFromString(text));
+        } else if (key == QStringLiteral("choices")) {
+            ok = readChoices(node);
+        } else if (key == QStringLiteral("position")) {
+            ok = readPosition(node);
+        } else {
+            ok = m_reader.skipValue() || fail(QString());
+        }
+        if (!ok) {
+            return false;
+        }
+    }
+}
+
+bool ProjectJsonReader::readChoices(StoryNode &node)
+{
+    if (m_reader.readNext() != Token::BeginArray) {
+        return m_reader.skipCurrent() || fail(QString());
+    }
+
+    while (true) {
+        const Token token = m_reader.readNext();
+        if (token == Token::EndArray) {
+            return true;
+        }
+        Choice choice;
+        if (token == Token::BeginObject) {
+            if (!readChoice(choice)) {
+                return false;
+            }
+        } else if (!m_reader.skipCurrent()) {
+            return fail(QString());
+        }
+        node.choices().append(std::move(choice));
+    }
+}
+
+bool ProjectJsonReader::readChoice(Choice &choice)
+{
+    while (true) {
+        const Token token = m_reader.readNext();
+        if (token == Token::EndObject) {
+            return true;
+        }
+        if (token != Token::Name) {
+            return fail(QString());
+        }
+
+        const QString key = m_reader.name();
+        bool ok = true;
+        if (key == QStringLiteral("id")) {
+            ok = readId(choice.id);
+        } else if (key == QStringLiteral("text")) {
+            ok = readString(choice.text);
+        } else if (key == QStringLiteral("target")) {
+            ok = readId(choice.targetNodeId);
+        } else if (key == QStringLiteral("condition")) {
+            QString condition;
+            ok = readString(condition);
+            choice.condition = std::move(condition);
+        } else {
+            ok = m_reader.skipValue() || fail(QString());
+        }
+        if (!ok) {
+            return false;
+        }
+    }
+}
+
+bool ProjectJsonReader::readPosition(StoryNode &node)
+{
+    if (m_reader.readNext() != Token::BeginObject) {
+        return m_reader.skipCurrent() || fail(QString());
+    }
+
+    QPointF position;
+    while (true) {
+        const Token token = m_reader.readNext();
+        if (token == Token::EndObject) {
+            break;
+        }
+        if (token != Token::Name) {
+            return fail(QString());
+        }
+
+        const QString key = m_reader.name();
+        double value = 0.0;
+        bool ok = true;
+        if (key == QStringLiteral("x")) {
+            ok = readNumber(value);
+            position.setX(value);
+        } else if (key == QStringLiteral("y")) {
+            ok = readNumber(value);
+            position.setY(value);
+        } else {
+            ok = m_reader.skipValue() || fail(QString());
+        }
+        if (!ok) {
+            return false;
+        }
+    }
+    node.setPosition(position);
+    return true;
+}
+
+// Mirrors QJsonValue::toString(): values of another type read as empty.
+bool ProjectJsonReader::readString(QString &value)
+{
+    if (m_reader.readNext() == Token::String) {
+        value = m_reader.stringValue();
+        return true;
+    }
+    value.clear();
+    return m_reader.skipCurrent() || fail(QString());
+}
+
+bool ProjectJsonReader::readId(ObjectId &value)
+{
+    QString text;
+    const bool ok = readString(text);
+    value = ObjectId::fromString(text);
+    return ok;
+}
+
+// Mirrors QJsonValue::toDouble(): values of another type read as 0.
+bool ProjectJsonReader::readNumber(double &value)
+{
+    if (m_reader.readNext() == Token::Number) {
+        value = m_reader.numberValue();
+        return true;
+    }
+    value = 0.0;
+    return m_reader.skipCurrent() || fail(QString());
+}
+
+bool ProjectJsonReader::reportProgress()
+{
+    if (!m_progressCallback) {
+        return true;
+    }
+    const qint64 position = m_reader.bytesRead();
+    if (position < m_nextProgressAt) {
+        return true;
+    }
+    m_nextProgressAt = position + kProgressStep;
+    if (!m_progressCallback(position, m_totalBytes)) {
+        m_wasCanceled = true;
+        m_errorString = QStringLiteral("Loading was canceled");
+        return false;
+    }
+    return true;
+}
+
+// An empty message reports the tokenizer's own error.
+bool ProjectJsonReader::fail(const QString &message)
+{
+    if (m_errorString.isEmpty()) {
+        if (m_reader.hasError()) {
+            m_errorString = m_reader.errorString();
+        } else if (!message.isEmpty()) {
+            m_errorString = message;
+        } else {
+            m_errorString = QStringLiteral("Malformed project file at offset %1").arg(m_reader.bytesRead());
+        }
+    }
+    return false;
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <QString>
+
+#include <functional>
+
+#include "JsonStreamReader.h"
+#include "StoryNode.h"
+
+class QIODevice;
+
+// Builds the node map of a .json project straight from the token stream,
+// without materializing a QJsonDocument.
+class ProjectJsonReader
+{
+public:
+    explicit ProjectJsonReader(QIODevice *device);
+
+    [[nodiscard]] bool read(StoryNodeMap &nodes);
+    void setProgressCallback(std::function<bool(qint64, qint64)> callback);
+    [[nodiscard]] bool wasCanceled() const { return m_wasCanceled; }
+    [[nodiscard]] QString errorString() const { return m_errorString; }
+
+private:
+    bool readNodes(StoryNodeMap &nodes);
+    bool readNode(StoryNode &node);
+    bool readChoices(StoryNode &node);
+    bool readChoice(Choice &choice);
+    bool readPosition(StoryNode &node);
+    bool readString(QString &value);
+    bool readId(ObjectId &value);
+    bool readNumber(double &value);
+    bool reportProgress();
+    bool fail(const QString &message);
+
+    QIODevice *m_device{nullptr};
+    JsonStreamReader m_reader;
+    std::function<bool(qint64, qint64)> m_progressCallback;
+    qint64 m_totalBytes{0};
+    qint64 m_nextProgressAt{0};
+    bool m_wasCanceled{false};
+    QString m_errorString;
+};
@@ -0,0 +1,72 @@
+#include "ProjectJsonWriter.h"
+
+// Keys are written in the sorted order QJsonObject uses.
+
+ProjectJsonWriter::ProjectJsonWriter(QIODevice *device, QJsonDocument::JsonFormat format)
+    : m_writer(device, format)
+{
+}
+
+bool ProjectJsonWriter::write(const QList<const StoryNode *> &nodes)
+{
+    m_writer.beginObject();
+    m_writer.writeName(QStringLiteral("nodes"));
+    m_writer.beginArray();
+    for (const StoryNode *node : nodes) {
+        writeNode(*node);
+        if (m_writer.hasError()) {
+            return false;
+        }
+    }
+    m_writer.endArray();
+    m_writer.endObject();
+    return m_writer.flush();
+}
+
+void ProjectJsonWriter::writeNode(const StoryNode &node)
+{
+    m_writer.beginObject();
+
+    m_writer.writeName(QStringLiteral("choices"));
+    m_writer.beginArray();
+    for (const Choice &choice : node.choices()) {
+        writeChoice(choice);
+    }
+    m_writer.endArray();
+
+    m_writer.writeName(QStringLiteral("id"));
+    m_writer.writeString(node.id().toString());
+
+    m_writer.writeName(QStringLiteral("position"));
+    m_writer.beginObject();
+    m_writer.writeName(QStringLiteral("x"));
+    m_writer.writeNumber(node.position().x());
+    m_writer.writeName(QStringLiteral("y"));
+    m_writer.writeNumber(node.position().y());
+    m_writer.endObject();
+
+    m_writer.writeName(QStringLiteral("script"));
+    m_writer.writeString(node.script());
+    m_writer.writeName(QStringLiteral("title"));
+    m_writer.writeString(node.title());
+    m_writer.writeName(QStringLiteral("type"));
+    m_writer.writeString(StoryNode::typeToString(node.type()));
+
+    m_writer.endObject();
+}
+
+void ProjectJsonWriter::writeChoice(const Choice &choice)
+{
+    m_writer.beginObject();
+    if (choice.condition.has_value()) {
+        m_writer.writeName(QStringLiteral("condition"));
+        m_writer.writeString(*choice.condition);
+    }
+    m_writer.writeName(QStringLiteral("id"));
+    m_writer.writeString(choice.id.toString());
+    m_writer.writeName(QStringLiteral("target"));
+    m_writer.writeString(choice.targetNodeId.toString());
+    m_writer.writeName(QStringLiteral("text"));
+    m_writer.writeString(choice.text);
+    m_writer.endObject();
+}
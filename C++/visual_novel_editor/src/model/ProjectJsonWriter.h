@@ -0,0 +1,27 @@
+#pragma once
+
+#include <QJsonDocument>
+#include <QList>
+#include <QString>
+
+#include "JsonStreamWriter.h"
+#include "StoryNode.h"
+
+class QIODevice;
+
+// Serializes nodes while walking the model; nothing but the write buffer is
+// held in memory. The output is what StoryNode::toJson() would produce.
+class ProjectJsonWriter
+{
+public:
+    explicit ProjectJsonWriter(QIODevice *device, QJsonDocument::JsonFormat format = QJsonDocument::Indented);
+
+    [[nodiscard]] bool write(const QList<const StoryNode *> &nodes);
+    [[nodiscard]] QString errorString() const { return m_writer.errorString(); }
+
+private:
+    void writeNode(const StoryNode &node);
+    void writeChoice(const Choice &choice);
+
+    JsonStreamWriter m_writer;
+};
@@ -0,0 +1,9 @@
+#include "ProjectSnapshot.h"
+
+#include <utility>
+
+ProjectSnapshot::ProjectSnapshot(quint64 version, SharedNodeMap nodes)
+    : m_version(version)
+    , m_nodes(std::move(nodes))
+{
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <QString>
+
+#include "SharedNodeMap.h"
+#include "StoryNode.h"
+
+// Immutable view of a project as of one committed change set. Copying is
+// O(1) and a snapshot may be read from any thread while the project keeps
+// changing. Nodes that did not change between versions are shared by their
+// snapshots and are only reachable as const.
+class ProjectSnapshot
+{
+public:
+    ProjectSnapshot() = default;
+    ProjectSnapshot(quint64 version, SharedNodeMap nodes);
+
+    [[nodiscard]] quint64 version() const { return m_version; }
+    [[nodiscard]] const SharedNodeMap &nodes() const { return m_nodes; }
+    [[nodiscard]] const StoryNode *node(const ObjectId &nodeId) const { return m_nodes.find(nodeId); }
+    [[nodiscard]] qsizetype size() const { return m_nodes.size(); }
+    [[nodiscard]] bool isEmpty() const { return m_nodes.isEmpty(); }
+
+private:
+    quint64 m_version{0};
+    SharedNodeMap m_nodes;
+};
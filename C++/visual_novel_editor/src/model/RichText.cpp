@@ -0,0 +1,497 @@
+#include "RichText.h"
+
+#include <QColor>
+#include <QFont>
+#include <QTextBlock>
+#include <QTextCharFormat>
+#include <QTextCursor>
+#include <QTextDocument>
+#include <QTextFragment>
+
+#include <limits>
+#include <utility>
+
+namespace {
+// Stored form: kMarker, runs separated by ';', kMarker, text. A run is
+// "start,length" followed by b, i, u, s<points> and c<#rrggbb> as needed.
+constexpr QChar kMarker{0x1E};
+
+qsizetype readNumber(QStringView text, qsizetype &pos)
+{
+    qsizetype value = 0;
+    const qsizetype begin = pos;
+    while (pos < text.size() && text[pos].isDigit()) {
+        value = value * 10 + text[pos].digitValue();
+        if (value > std::numeric_limits<int>::max()) {
+            return -1;
+        }
+        ++pos;
+    }
+    return pos == begin ? -1 : value;
+}
+
+// Value of the style attribute of a tag, without the quotes.
+QStringView styleOf(QStringView tag)
+{
+    const qsizetype at = tag.indexOf(u"style=\"");
+    if (at < 0) {
+        return {};
+    }
+    const qsizetype begin = at + 7;
+    const qsizetype end = tag.indexOf(u'"', begin);
+    return end < 0 ? QStringView() : tag.sliced(begin, end - begin);
+}
+
+// Applies the CSS QTextEdit writes into style attributes to format. Layout
+// properties are ignored; a value that cannot be mapped to a run fails.
+bool applyStyle(QStringView style, TextRun &format, int defaultPointSize)
+{
+    for (const QStringView declaration : style.split(u';')) {
+        const qsizetype colon = declaration.indexOf(u':');
+        if (colon < 0) {
+            continue;
+        }
+        const QStringView name = declaration.left(colon).trimmed();
+        const QStringView value = declaration.sliced(colon + 1).trimmed();
+        if (name == u"font-weight") {
+            bool ok = false;
+            const int weight = value.toInt(&ok);
+            if (value == u"bold" || (ok && weight >= QFont::DemiBold)) {
+                format.flags |= TextRun::Bold;
+            } else {
+                format.flags &= ~TextRun::Bold;
+            }
+        } else if (name == u"font-style") {
+            if (value == u"italic" || value == u"oblique") {
+                format.flags |= TextRun::Italic;
+            } else {
+                format.flags &= ~TextRun::Italic;
+            }
+        } else if (name == u"text-decoration") {
+            if (value.contains(u"underline")) {
+                format.flags |= TextRun::Underline;
+            } else {
+                format.flags &= ~TextRun::Underline;
+            }
+        } else if (name == u"font-size") {
+            bool ok = false;
+            const double size = value.endsWith(u"pt") ? value.chopped(2).toDouble(&ok) : 0.0;
+            if (!ok || size <= 0.0) {
+                return false;
+            }
+            const int points = qMin(qRound(size), 0xFFFF);
+            format.pointSize = points == defaultPointSize ? 0 : quint16(qMax(points, 1));
+        } else if (name == u"color") {
+            bool ok = false;
+            const uint rgb = value.size() == 7 && value[0] == u'#' ? value.sliced(1).toUInt(&ok, 16) : 0;
+            if (!ok) {
+                return false;
+            }
+            format.color = qRgb(qRed(rgb), qGreen(rgb), qBlue(rgb));
+        }
+    }
+    return true;
+}
+
+// Decodes the entity at pos and moves past it.
+bool appendEntity(QStringView html, qsizetype &pos, QString &text)
+{
+    const qsizetype end = html.indexOf(u';', pos);
+    if (end < 0 || end - pos > 10) {
+        return false;
+    }
+    const QStringView name = html.sliced(pos + 1, end - pos - 1);
+    pos = end + 1;
+    if (name == u"lt") {
+        text += QLatin1Char('<');
+    } else if (name == u"gt") {
+        text += QLatin1Char('>');
+    } else if (name == u"amp") {
+        text += QLatin1Char('&');
+    } else if (name == u"quot") {
+        text += QLatin1Char('"');
+    } else if (name == u"apos") {
+        text += QLatin1Char('\'');
+    } else if (name == u"nbsp") {
+        text += QChar(QChar::Nbsp);
+    } else if (name.startsWith(u'#')) {
+        bool ok = false;
+        const bool isHex = name.size() > 1 && (name[1] == u'x' || name[1] == u'X');
+        const uint code = isHex ? name.sliced(2).toUInt(&ok, 16) : name.sliced(1).toUInt(&ok, 10);
+        if (!ok || code > 0x10FFFF) {
+            return false;
+        }
+        const char32_t ucs4 = code;
+        text += QString::fromUcs4(&ucs4, 1);
+    } else {
+        return false;
+    }
+    return true;
+}
+}
+
+RichText::RichText(QString text, QList<TextRun> runs)
+    : m_text(std::move(text))
+{
+    for (const TextRun &run : runs) {
+        appendRun(run);
+    }
+}
+
+RichText RichText::fromScript(const QString &script)
+{
+    if (script.startsWith(kMarker)) {
+        const qsizetype end = script.indexOf(kMarker, 1);
+        if (end > 0) {
+            RichText result;
+            result.m_text = script.mid(end + 1);
+            if (parseRuns(QStringView(script).sliced(1, end - 1), result.m_text.size(), result.m_runs)) {
+                return result;
+            }
+        }
+    }
+    return RichText(script);
+}
+
+bool RichText::isLegacyScript(const QString &script)
+{
+    return !script.startsWith(kMarker) && Qt::mightBeRichText(script);
+}
+
+RichText RichText::fromLegacyScript(const QString &html)
+{
+    RichText result;
+    if (readQtHtml(html, result)) {
+        return result;
+    }
+    QTextDocument document;
+    document.setHtml(html);
+    return fromDocument(document);
+}
+
+QString RichText::toScript() const
+{
+    if (m_runs.isEmpty() && !m_text.startsWith(kMarker) && !Qt::mightBeRichText(m_text)) {
+        return m_text;
+    }
+    QString script;
+    script.reserve(m_text.size() + m_runs.size() * 12 + 2);
+    script += kMarker;
+    for (qsizetype i = 0; i < m_runs.size(); ++i) {
+        const TextRun &run = m_runs[i];
+        if (i > 0) {
+            script += QLatin1Char(';');
+        }
+        script += QString::number(run.start) + QLatin1Char(',') + QString::number(run.length);
+        if (run.flags & TextRun::Bold) {
+            script += QLatin1Char('b');
+        }
+        if (run.flags & TextRun::Italic) {
+            script += QLatin1Char('i');
+        }
+        if (run.flags & TextRun::Underline) {
+            script += QLatin1Char('u');
+        }
+        if (run.pointSize > 0) {
+            script += QLatin1Char('s') + QString::number(run.pointSize);
+        }
+        if (run.color != 0) {
+            script += QLatin1Char('c') + QColor(run.color).name();
+        }
+    }
+    script += kMarker;
+    script += m_text;
+    return script;
+}
+
+RichText RichText::fromDocument(const QTextDocument &document)
+{
+    // HTML written by QTextEdit repeats the editor's font size on every
+    // span; only sizes that differ from it were chosen by the author.
+    const int defaultPointSize = qRound(document.defaultFont().pointSizeF());
+    RichText result;
+    for (QTextBlock block = document.begin(); block.isValid(); block = block.next()) {
+        if (block != document.begin()) {
+            result.m_text += QLatin1Char('\n');
+        }
+        for (auto it = block.begin(); !it.atEnd(); ++it) {
+            const QTextFragment fragment = it.fragment();
+            if (!fragment.isValid()) {
+                continue;
+            }
+            const QTextCharFormat format = fragment.charFormat();
+            TextRun run;
+            run.start = result.m_text.size();
+            run.length = fragment.length();
+            if (format.fontWeight() >= QFont::DemiBold) {
+                run.flags |= TextRun::Bold;
+            }
+            if (format.fontItalic()) {
+                run.flags |= TextRun::Italic;
+            }
+            if (format.fontUnderline()) {
+                run.flags |= TextRun::Underline;
+            }
+            if (format.hasProperty(QTextFormat::FontPointSize)) {
+                const int pointSize = qRound(format.fontPointSize());
+                if (pointSize > 0 && pointSize != defaultPointSize) {
+                    run.pointSize = quint16(qMin(pointSize, 0xFFFF));
+                }
+            }
+            if (format.hasProperty(QTextFormat::ForegroundBrush)) {
+                run.color = format.foreground().color().rgb();
+            }
+            result.m_text += fragment.text();
+            result.appendRun(run);
+        }
+    }
+    return result;
+}
+
+void RichText::toDocument(QTextDocument *document) const
+{
+    document->clear();
+    QTextCursor cursor(document);
+    qsizetype pos = 0;
+    for (const TextRun &run : m_runs) {
+        if (run.start > pos) {
+            cursor.insertText(m_text.mid(pos, run.start - pos), QTextCharFormat());
+        }
+        QTextCharFormat format;
+        if (run.flags & TextRun::Bold) {
+            format.setFontWeight(QFont::Bold);
+        }
+        if (run.flags & TextRun::Italic) {
+            format.setFontItalic(true);
+        }
+        if (run.flags & TextRun::Underline) {
+            format.setFontUnderline(true);
+        }
+        if (run.pointSize > 0) {
+            format.setFontPointSize(run.pointSize);
+        }
+        if (run.color != 0) {
+            format.setForeground(QColor::fromRgba(run.color));
+        }
+        cursor.insertText(m_text.mid(run.start, run.length), format);
+        pos = run.start + run.length;
+    }
+    if (pos < m_text.size()) {
+        cursor.insertText(m_text.mid(pos), QTextCharFormat());
+    }
+}
+
+bool RichText::parseRuns(QStringView encoded, qsizetype textSize, QList<TextRun> &runs)
+{
+    qsizetype pos = 0;
+    qsizetype end = 0;
+    while (pos < encoded.size()) {
+        TextRun run;
+        run.start = readNumber(encoded, pos);
+        if (run.start < end || pos >= encoded.size() || encoded[pos++] != QLatin1Char(',')) {
+            return false;
+        }
+        run.length = readNumber(encoded, pos);
+        if (run.length <= 0 || run.length > textSize - run.start) {
+            return false;
+        }
+        while (pos < encoded.size() && encoded[pos] != QLatin1Char(';')) {
+            const QChar attribute = encoded[pos++];
+            if (attribute == QLatin1Char('b')) {
+                run.flags |= TextRun::Bold;
+            } else if (attribute == QLatin1Char('i')) {
+                run.flags |= TextRun::Italic;
+            } else if (attribute == QLatin1Char('u')) {
+                run.flags |= TextRun::Underline;
+            } else if (attribute == QLatin1Char('s')) {
+                const qsizetype size = readNumber(encoded, pos);
+                if (size <= 0 || size > 0xFFFF) {
+                    return false;
+                }
+                run.pointSize = quint16(size);
+            } else if (attribute == QLatin1Char('c') && encoded.size() - pos >= 7 && encoded[pos] == QLatin1Char('#')) {
+                bool ok = false;
+                const uint rgb = encoded.sliced(pos + 1, 6).toUInt(&ok, 16);
+                if (!ok) {
+                    return false;
+                }
+                run.color = qRgb(qRed(rgb), qGreen(rgb), qBlue(rgb));
+                pos += 7;
+            } else {
+                return false;
+            }
+        }
+        if (pos < encoded.size()) {
+            ++pos;
+        }
+        end = run.start + run.length;
+        runs.append(run);
+    }
+    return true;
+}
+
+// Walks the subset of HTML that QTextEdit::toHtml() produces for the
+// formats runs can hold. Anything else (tables, lists, images, links, pixel
+// sizes) fails and is left to QTextDocument.
+bool RichText::readQtHtml(QStringView html, RichText &result)
+{
+    // The first entry is the body format, the second the paragraph's.
+    QList<TextRun> formats{TextRun()};
+    int defaultPointSize = 0;
+    bool isInBody = false;
+    bool isInParagraph = false;
+    bool isEmptyParagraph = false;
+    bool hasParagraph = false;
+    qsizetype pos = 0;
+    while (pos < html.size()) {
+        if (html[pos] != u'<') {
+            if (!isInParagraph) {
+                if (!html[pos].isSpace()) {
+                    return false;
+                }
+                ++pos;
+                continue;
+            }
+            const qsizetype start = result.m_text.size();
+            while (pos < html.size() && html[pos] != u'<') {
+                if (html[pos] == u'&') {
+                    if (!appendEntity(html, pos, result.m_text)) {
+                        return false;
+                    }
+                } else {
+                    result.m_text += html[pos++];
+                }
+            }
+            TextRun run = formats.last();
+            run.start = start;
+            run.length = result.m_text.size() - start;
+            result.appendRun(run);
+            continue;
+        }
+
+        if (html.sliced(pos).startsWith(u"<!--")) {
+            const qsizetype end = html.indexOf(u"-->", pos);
+            if (end < 0) {
+                return false;
+            }
+            pos = end + 3;
+            continue;
+        }
+        const qsizetype close = html.indexOf(u'>', pos);
+        if (close < 0) {
+            return false;
+        }
+        QStringView tag = html.sliced(pos + 1, close - pos - 1);
+        pos = close + 1;
+        const bool isEndTag = tag.startsWith(u'/');
+        if (isEndTag) {
+            tag = tag.sliced(1);
+        }
+        qsizetype nameSize = 0;
+        while (nameSize < tag.size() && !tag[nameSize].isSpace() && tag[nameSize] != u'/') {
+            ++nameSize;
+        }
+        const QStringView name = tag.left(nameSize);
+        const QStringView style = styleOf(tag);
+
+        if (name.startsWith(u'!') || name == u"html" || name == u"head" || name == u"meta") {
+            continue;
+        }
+        if (name == u"style" || name == u"title") {
+            if (!isEndTag) {
+                const qsizetype end = html.indexOf(QStringLiteral("</") + name.toString(), pos);
+                if (end < 0) {
+                    return false;
+                }
+                pos = end;
+            }
+            continue;
+        }
+        if (name == u"body") {
+            isInBody = !isEndTag;
+            if (isInBody) {
+                TextRun body;
+                if (!applyStyle(style, body, 0)) {
+                    return false;
+                }
+                defaultPointSize = body.pointSize;
+                body.pointSize = 0;
+                formats = {body};
+            }
+            continue;
+        }
+        if (!isInBody) {
+            return false;
+        }
+        if (name == u"p") {
+            if (isEndTag != isInParagraph) {
+                return false;
+            }
+            isInParagraph = !isEndTag;
+            formats.resize(1);
+            if (isInParagraph) {
+                if (hasParagraph) {
+                    result.m_text += QLatin1Char('\n');
+                }
+                hasParagraph = true;
+                isEmptyParagraph = style.contains(u"-qt-paragraph-type:empty");
+                TextRun paragraph = formats.first();
+                if (!applyStyle(style, paragraph, defaultPointSize)) {
+                    return false;
+                }
+                formats.append(paragraph);
+            }
+            continue;
+        }
+        if (!isInParagraph) {
+            return false;
+        }
+        if (name == u"br") {
+            // An empty paragraph holds a <br /> that is not part of its text.
+            if (!isEmptyParagraph) {
+                result.m_text += QChar(QChar::LineSeparator);
+            }
+            continue;
+        }
+        if (name != u"span" && name != u"b" && name != u"strong" && name != u"i" && name != u"em" && name != u"u") {
+            return false;
+        }
+        if (isEndTag) {
+            if (formats.size() <= 2) {
+                return false;
+            }
+            formats.removeLast();
+            continue;
+        }
+        TextRun format = formats.last();
+        if (name == u"b" || name == u"strong") {
+            format.flags |= TextRun::Bold;
+        } else if (name == u"i" || name == u"em") {
+            format.flags |= TextRun::Italic;
+        } else if (name == u"u") {
+            format.flags |= TextRun::Underline;
+        }
+        if (!applyStyle(style, format, defaultPointSize)) {
+            return false;
+        }
+        formats.append(format);
+    }
+    return hasParagraph && !isInParagraph;
+}
+
+// Drops empty and unformatted runs and joins a run to the previous one when
+// they touch and share a format.
+void RichText::appendRun(TextRun run)
+{
+    if (run.length <= 0 || run.isPlain()) {
+        return;
+    }
+    if (!m_runs.isEmpty()) {
+        TextRun &last = m_runs.last();
+        if (last.start + last.length == run.start && last.hasSameFormat(run)) {
+            last.length += run.length;
+            return;
+        }
+    }
+    m_runs.append(run);
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <QList>
+#include <QRgb>
+#include <QString>
+#include <QStringView>
+#include <QtGlobal>
+
+class QTextDocument;
+
+// A formatted span of RichText::text. Runs are sorted, do not overlap and
+// never carry an empty format; text outside every run is unformatted.
+struct TextRun {
+    enum Flag : quint8 { Bold = 0x1, Italic = 0x2, Underline = 0x4 };
+
+    qsizetype start{0};
+    qsizetype length{0};
+    quint8 flags{0};
+    // Zero keeps the default size.
+    quint16 pointSize{0};
+    // Zero keeps the default color; set colors are opaque.
+    QRgb color{0};
+
+    [[nodiscard]] bool hasSameFormat(const TextRun &other) const
+    {
+        return flags == other.flags && pointSize == other.pointSize && color == other.color;
+    }
+    [[nodiscard]] bool isPlain() const { return flags == 0 && pointSize == 0 && color == 0; }
+
+    friend bool operator==(const TextRun &a, const TextRun &b)
+    {
+        return a.start == b.start && a.length == b.length && a.hasSameFormat(b);
+    }
+};
+
+// Script text as plain UTF-16 with a run list for the character formats the
+// inspector offers. This is what scripts are stored as; the HTML QTextEdit
+// produced before is converted once, when a project is read (see
+// StoryNode::convertLegacyScript()). Line breaks within a paragraph are kept
+// as QChar::LineSeparator, as QTextDocument does.
+class RichText
+{
+public:
+    RichText() = default;
+    explicit RichText(QString text, QList<TextRun> runs = {});
+
+    [[nodiscard]] const QString &text() const { return m_text; }
+    [[nodiscard]] const QList<TextRun> &runs() const { return m_runs; }
+    [[nodiscard]] bool isPlain() const { return m_runs.isEmpty(); }
+
+    // Accepts the stored form or plain text; legacy HTML must have been
+    // converted before and is otherwise taken as plain text.
+    [[nodiscard]] static RichText fromScript(const QString &script);
+    // HTML saved by QTextEdit before scripts were stored as runs.
+    [[nodiscard]] static bool isLegacyScript(const QString &script);
+    // Falls back to QTextDocument for HTML the fast reader does not know, so
+    // it must run on the GUI thread.
+    [[nodiscard]] static RichText fromLegacyScript(const QString &html);
+    // Unformatted text is stored as is, so plain scripts stay readable in
+    // the project file. Anything else is a marker, the runs and the text.
+    [[nodiscard]] QString toScript() const;
+
+    [[nodiscard]] static RichText fromDocument(const QTextDocument &document);
+    void toDocument(QTextDocument *document) const;
+
+    friend bool operator==(const RichText &a, const RichText &b)
+    {
+        return a.m_text == b.m_text && a.m_runs == b.m_runs;
+    }
+
+private:
+    [[nodiscard]] static bool readQtHtml(QStringView html, RichText &result);
+    [[nodiscard]] static bool parseRuns(QStringView encoded, qsizetype textSize, QList<TextRun> &runs);
+    void appendRun(TextRun run);
+
+    QString m_text;
+    QList<TextRun> m_runs;
+};
@@ -0,0 +1,115 @@
+#include "SharedNodeMap.h"
+
+#include <algorithm>
+#include <utility>
+
+namespace {
+bool entryIdLess(const SharedNodeMap::Entry &entry, const ObjectId &id)
+{
+    return entry.id < id;
+}
+}
+
+const StoryNode *SharedNodeMap::find(const ObjectId &id) const
+{
+    const Entry *entry = findEntry(id);
+    return entry ? entry->node.get() : nullptr;
+}
+
+SharedNodeMap::NodePointer SharedNodeMap::value(const ObjectId &id) const
+{
+    const Entry *entry = findEntry(id);
+    return entry ? entry->node : nullptr;
+}
+
+void SharedNodeMap::insert(const ObjectId &id, NodePointer node)
+{
+    if (m_chunks.isEmpty()) {
+        m_chunks.append(QList<Entry>{Entry{id, std::move(node)}});
+        m_size = 1;
+        return;
+    }
+    const qsizetype index = chunkFor(id);
+    QList<Entry> &chunk = m_chunks[index];
+    const auto it = std::lower_bound(chunk.begin(), chunk.end(), id, entryIdLess);
+    if (it != chunk.end() && it->id == id) {
+        it->node = std::move(node);
+        return;
+    }
+    chunk.insert(it, Entry{id, std::move(node)});
+    ++m_size;
+    if (chunk.size() > kMaxChunkSize) {
+        const qsizetype half = chunk.size() / 2;
+        QList<Entry> upper = chunk.sliced(half);
+        chunk.resize(half);
+        m_chunks.insert(index + 1, std::move(upper));
+    }
+}
+
+bool SharedNodeMap::remove(const ObjectId &id)
+{
+    if (!findEntry(id)) {
+        return false;
+    }
+    const qsizetype index = chunkFor(id);
+    QList<Entry> &chunk = m_chunks[index];
+    chunk.erase(std::lower_bound(chunk.begin(), chunk.end(), id, entryIdLess));
+    --m_size;
+    // Iteration relies on every chunk holding at least one entry.
+    if (chunk.isEmpty()) {
+        m_chunks.removeAt(index);
+    }
+    return true;
+}
+
+void SharedNodeMap::clear()
+{
+    m_chunks.clear();
+    m_size = 0;
+}
+
+void SharedNodeMap::assign(QList<Entry> entries)
+{
+    std::sort(entries.begin(), entries.end(), [](const Entry &a, const Entry &b) { return a.id < b.id; });
+    m_chunks.clear();
+    m_chunks.reserve((entries.size() + kMaxChunkSize - 1) / kMaxChunkSize);
+    for (qsizetype start = 0; start < entries.size(); start += kMaxChunkSize) {
+        m_chunks.append(entries.sliced(start, qMin(kMaxChunkSize, entries.size() - start)));
+    }
+    m_size = entries.size();
+}
+
+qsizetype SharedNodeMap::sharedChunkCount(const SharedNodeMap &other) const
+{
+    qsizetype count = 0;
+    qsizetype j = 0;
+    for (const QList<Entry> &chunk : m_chunks) {
+        // Both lists are in id order, so shared chunks come in the same order.
+        while (j < other.m_chunks.size() && other.m_chunks.at(j).last().id < chunk.first().id) {
+            ++j;
+        }
+        if (j < other.m_chunks.size() && other.m_chunks.at(j).constData() == chunk.constData()) {
+            ++count;
+        }
+    }
+    return count;
+}
+
+qsizetype SharedNodeMap::chunkFor(const ObjectId &id) const
+{
+    const auto it = std::lower_bound(m_chunks.cbegin(), m_chunks.cend(), id,
+                                     [](const QList<Entry> &chunk, const ObjectId &key) {
+                                         return chunk.last().id < key;
+                                     });
+    return it == m_chunks.cend() ? m_chunks.size() - 1 : it - m_chunks.cbegin();
+}
+
+const SharedNodeMap::Entry *SharedNodeMap::findEntry(const ObjectId &id) const
+{
+    if (m_chunks.isEmpty()) {
+        return nullptr;
+    }
+    const QList<Entry> &chunk = m_chunks.at(chunkFor(id));
+    const auto it = std::lower_bound(chunk.cbegin(), chunk.cend(), id, entryIdLess);
+    return it != chunk.cend() && it->id == id ? &*it : nullptr;
+}
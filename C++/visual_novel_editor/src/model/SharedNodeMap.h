@@ -0,0 +1,102 @@
+#pragma once
+
+#include <QList>
+#include <QtGlobal>
+
+#include <cstddef>
+#include <iterator>
+#include <memory>
+
+#include "ObjectId.h"
+#include "StoryNode.h"
+
+// Ordered map from ids to immutable nodes, kept as a list of sorted chunks
+// of at most kMaxChunkSize entries. Copies share the chunk list and the
+// chunks; changing a copy afterwards duplicates the chunk list, one pointer
+// per chunk, and the chunk holding the entry, never the whole map.
+class SharedNodeMap
+{
+public:
+    using NodePointer = std::shared_ptr<const StoryNode>;
+
+    struct Entry {
+        ObjectId id;
+        NodePointer node;
+    };
+
+    class const_iterator
+    {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = NodePointer;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const NodePointer *;
+        using reference = const NodePointer &;
+
+        const_iterator(const QList<QList<Entry>> *chunks, qsizetype chunk)
+            : m_chunks(chunks)
+            , m_chunk(chunk)
+        {
+        }
+
+        [[nodiscard]] const ObjectId &key() const { return entry().id; }
+        [[nodiscard]] const NodePointer &value() const { return entry().node; }
+        reference operator*() const { return entry().node; }
+        pointer operator->() const { return &entry().node; }
+
+        const_iterator &operator++()
+        {
+            if (++m_position == m_chunks->at(m_chunk).size()) {
+                ++m_chunk;
+                m_position = 0;
+            }
+            return *this;
+        }
+
+        friend bool operator==(const const_iterator &a, const const_iterator &b)
+        {
+            return a.m_chunk == b.m_chunk && a.m_position == b.m_position;
+        }
+        friend bool operator!=(const const_iterator &a, const const_iterator &b) { return !(a == b); }
+
+    private:
+        [[nodiscard]] const Entry &entry() const { return m_chunks->at(m_chunk).at(m_position); }
+
+        const QList<QList<Entry>> *m_chunks;
+        qsizetype m_chunk;
+        qsizetype m_position{0};
+    };
+
+    [[nodiscard]] qsizetype size() const { return m_size; }
+    [[nodiscard]] bool isEmpty() const { return m_size == 0; }
+    [[nodiscard]] bool contains(const ObjectId &id) const { return find(id) != nullptr; }
+    [[nodiscard]] const StoryNode *find(const ObjectId &id) const;
+    // Null for ids that are not in the map.
+    [[nodiscard]] NodePointer value(const ObjectId &id) const;
+
+    void insert(const ObjectId &id, NodePointer node);
+    bool remove(const ObjectId &id);
+    void clear();
+    // Replaces the contents with entries in any order; ids must be unique.
+    void assign(QList<Entry> entries);
+
+    // Chunks whose storage this map shares with other; the rest were copied
+    // since the two maps were the same.
+    [[nodiscard]] qsizetype sharedChunkCount(const SharedNodeMap &other) const;
+    [[nodiscard]] qsizetype chunkCount() const { return m_chunks.size(); }
+
+    const_iterator begin() const { return {&m_chunks, 0}; }
+    const_iterator end() const { return {&m_chunks, m_chunks.size()}; }
+    const_iterator cbegin() const { return begin(); }
+    const_iterator cend() const { return end(); }
+
+private:
+    static constexpr qsizetype kMaxChunkSize = 256;
+
+    // The chunk that holds id or would hold it; the map must not be empty.
+    [[nodiscard]] qsizetype chunkFor(const ObjectId &id) const;
+    [[nodiscard]] const Entry *findEntry(const ObjectId &id) const;
+
+    QList<QList<Entry>> m_chunks;
+    qsizetype m_size{0};
+};
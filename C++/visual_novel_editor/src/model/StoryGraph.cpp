@@ -0,0 +1,127 @@
+#include "StoryGraph.h"
+
+#include <numeric>
+#include <utility>
+
+#include "Choice.h"
+
+StoryGraph::StoryGraph(ProjectSnapshot snapshot)
+    : m_snapshot(std::move(snapshot))
+{
+    const SharedNodeMap &nodes = m_snapshot.nodes();
+    m_nodes.reserve(nodes.size());
+    m_indices.reserve(nodes.size());
+    for (auto it = nodes.cbegin(); it != nodes.cend(); ++it) {
+        m_indices.insert(it.key(), int(m_nodes.size()));
+        m_nodes.append(it.value().get());
+    }
+
+    m_edgeOffsets.reserve(m_nodes.size() + 1);
+    m_edgeOffsets.append(0);
+    for (const StoryNode *node : std::as_const(m_nodes)) {
+        for (const Choice &choice : node->choices()) {
+            if (const int target = indexOf(choice.targetNodeId); target >= 0) {
+                m_targets.append(target);
+            }
+        }
+        m_edgeOffsets.append(int(m_targets.size()));
+    }
+}
+
+QList<int> StoryGraph::traverse(const QList<int> &starts, Order order, const QBitArray &mask) const
+{
+    const auto allowed = [&mask](int index) { return mask.isEmpty() || mask.testBit(index); };
+    QList<int> result;
+    QBitArray visited(int(size()));
+
+    if (order == Order::DepthFirst) {
+        // Marked when popped rather than when pushed, so a node reached
+        // again through an earlier sibling keeps the preorder position.
+        QList<int> stack;
+        for (int start : starts) {
+            stack.append(start);
+            while (!stack.isEmpty()) {
+                const int index = stack.takeLast();
+                if (visited.testBit(index) || !allowed(index)) {
+                    continue;
+                }
+                visited.setBit(index);
+                result.append(index);
+                const std::span<const int> next = targets(index);
+                for (auto it = next.rbegin(); it != next.rend(); ++it) {
+                    if (!visited.testBit(*it)) {
+                        stack.append(*it);
+                    }
+                }
+            }
+        }
+        return result;
+    }
+
+    // The result doubles as the queue.
+    qsizetype head = 0;
+    for (int start : starts) {
+        if (visited.testBit(start) || !allowed(start)) {
+            continue;
+        }
+        visited.setBit(start);
+        result.append(start);
+        for (; head < result.size(); ++head) {
+            for (int target : targets(result[head])) {
+                if (!visited.testBit(target) && allowed(target)) {
+                    visited.setBit(target);
+                    result.append(target);
+                }
+            }
+        }
+    }
+    return result;
+}
+
+QBitArray StoryGraph::reachable(const QList<int> &starts, const QBitArray &mask) const
+{
+    QBitArray result(int(size()));
+    for (int index : traverse(starts, Order::BreadthFirst, mask)) {
+        result.setBit(index);
+    }
+    return result;
+}
+
+QList<int> StoryGraph::components(const QBitArray &mask) const
+{
+    const auto allowed = [&mask](int index) { return mask.isEmpty() || mask.testBit(index); };
+    QList<int> parent(size());
+    std::iota(parent.begin(), parent.end(), 0);
+    const auto root = [&parent](int index) {
+        while (parent[index] != index) {
+            parent[index] = parent[parent[index]];
+            index = parent[index];
+        }
+        return index;
+    };
+
+    for (int index = 0; index < size(); ++index) {
+        if (!allowed(index)) {
+            continue;
+        }
+        for (int target : targets(index)) {
+            if (!allowed(target)) {
+                continue;
+            }
+            const int a = root(index);
+            const int b = root(target);
+            // The smaller index stays the root, so roots need no renumbering.
+            if (a < b) {
+                parent[b] = a;
+            } else if (b < a) {
+                parent[a] = b;
+            }
+        }
+    }
+
+    QList<int> result(size());
+    for (int index = 0; index < size(); ++index) {
+        result[index] = allowed(index) ? root(index) : -1;
+    }
+    return result;
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <QBitArray>
+#include <QHash>
+#include <QList>
+
+#include <span>
+
+#include "ObjectId.h"
+#include "ProjectSnapshot.h"
+
+// Choice edges of a snapshot over dense node indices, for walks that must
+// not recurse: exports, reachability and validation. Nodes are indexed in
+// id order and edges are kept in choice order; choices whose target is not
+// in the snapshot are left out. Holds the snapshot, so it outlives edits to
+// the project.
+class StoryGraph
+{
+public:
+    enum class Order {
+        // Preorder: a node's targets, in choice order, come before its
+        // siblings' targets, as a recursive walk would visit them.
+        DepthFirst,
+        // By number of hops from the nearest start.
+        BreadthFirst
+    };
+
+    explicit StoryGraph(ProjectSnapshot snapshot);
+
+    [[nodiscard]] const ProjectSnapshot &snapshot() const { return m_snapshot; }
+    [[nodiscard]] qsizetype size() const { return m_nodes.size(); }
+    // -1 for ids the snapshot does not contain.
+    [[nodiscard]] int indexOf(const ObjectId &nodeId) const { return m_indices.value(nodeId, -1); }
+    [[nodiscard]] const StoryNode &node(int index) const { return *m_nodes[index]; }
+    [[nodiscard]] std::span<const int> targets(int index) const
+    {
+        return {m_targets.constData() + m_edgeOffsets[index], m_targets.constData() + m_edgeOffsets[index + 1]};
+    }
+
+    // Visits every node reachable from starts, each once, starts taken in
+    // order. Starts must be valid indices. A non-empty mask limits the walk to the nodes whose bit is set.
+    [[nodiscard]] QList<int> traverse(const QList<int> &starts, Order order, const QBitArray &mask = {}) const;
+    [[nodiscard]] QBitArray reachable(const QList<int> &starts, const QBitArray &mask = {}) const;
+    // Weakly connected components: for each node, the smallest index in its
+    // component, or -1 for nodes outside a non-empty mask.
+    [[nodiscard]] QList<int> components(const QBitArray &mask = {}) const;
+
+private:
+    ProjectSnapshot m_snapshot;
+    QList<const StoryNode *> m_nodes;
+    QHash<ObjectId, int> m_indices;
+    // Targets of node i are m_targets[m_edgeOffsets[i]] up to the next offset.
+    QList<int> m_edgeOffsets;
+    QList<int> m_targets;
+};
@@ -3,8 +3,11 @@
 #include <QJsonArray>
 #include <QJsonValue>
 
-namespace {
-QString typeToString(StoryNode::Type type)
+#include <utility>
+
+#include "RichText.h"
+
+QString StoryNode::typeToString(StoryNode::Type type)
 {
     switch (type) {
     case StoryNode::Type::Dialogue:
@@ -19,7 +22,7 @@ QString typeToString(StoryNode::Type type)
     return QStringLiteral("dialogue");
 }
 
-StoryNode::Type typeFromString(const QString &value)
+StoryNode::Type StoryNode::typeFromString(const QString &value)
 {
     if (value == QStringLiteral("menu")) {
         return StoryNode::Type::Menu;
@@ -32,19 +35,100 @@ StoryNode::Type typeFromString(const QString &value)
     }
     return StoryNode::Type::Dialogue;
 }
-} // namespace
 
-StoryNode::StoryNode(const QString &id)
+StoryNode::StoryNode(const ObjectId &id)
     : m_id(id)
 {
 }
 
+QString StoryNode::script() const
+{
+    return m_lazyScript ? m_lazyScript->text() : m_script;
+}
+
+void StoryNode::setScript(const QString &script)
+{
+    m_script = script;
+    m_lazyScript.reset();
+}
+
+bool StoryNode::convertLegacyScript()
+{
+    // A damaged script stays as read, so saving still refuses it.
+    const QString current = script();
+    if (!RichText::isLegacyScript(current) || isScriptDamaged()) {
+        return false;
+    }
+    setScript(RichText::fromLegacyScript(current).toScript());
+    return true;
+}
+
+void StoryNode::setScript(MappedBytes utf8)
+{
+    m_script.clear();
+    m_lazyScript = std::make_shared<const LazyScript>(std::move(utf8));
+}
+
+bool StoryNode::hasSameScript(const StoryNode &other) const
+{
+    if (m_lazyScript || other.m_lazyScript) {
+        return m_lazyScript == other.m_lazyScript || script() == other.script();
+    }
+    return m_script == other.m_script;
+}
+
+void StoryNode::copyScriptFrom(const StoryNode &other)
+{
+    m_script = other.m_script;
+    m_lazyScript = other.m_lazyScript;
+}
+
+bool StoryNode::isScriptLoaded() const
+{
+    return !m_lazyScript || m_lazyScript->isDecoded();
+}
+
+bool StoryNode::isScriptDamaged() const
+{
+    return m_lazyScript && m_lazyScript->isDamaged();
+}
+
+std::shared_ptr<const MappedFile> StoryNode::scriptFile() const
+{
+    return m_lazyScript ? m_lazyScript->file() : nullptr;
+}
+
+QByteArray StoryNode::scriptUtf8() const
+{
+    return m_lazyScript ? m_lazyScript->utf8() : m_script.toUtf8();
+}
+
+Choice *StoryNode::findChoice(const ObjectId &choiceId)
+{
+    for (Choice &choice : m_choices) {
+        if (choice.id == choiceId) {
+            return &choice;
+        }
+    }
+    return nullptr;
+}
+
+const Choice *StoryNode::findChoice(const ObjectId &choiceId) const
+{
+    for (const Choice &choice : m_choices) {
+        if (choice.id == choiceId) {
+            return &choice;
+        }
+    }
+    return nullptr;
+}
+
 QJsonObject StoryNode::toJson() const
 {
     QJsonObject obj;
-    obj[QStringLiteral("id")] = m_id;
+    obj[QStringLiteral("id")] = m_id.toString();
     obj[QStringLiteral("title")] = m_title;
-    obj[QStringLiteral("script")] = m_script;
+    obj[QStringLiteral("script")] = script();
     obj[QStringLiteral("type")] = typeToString(m_type);
 
     QJsonArray choicesArray;
@@ -63,7 +147,7 @@ QJsonObject StoryNode::toJson() const
 
 StoryNode StoryNode::fromJson(const QJsonObject &obj)
 {
-    StoryNode node(obj.value(QStringLiteral("id")).toString());
+    StoryNode node(ObjectId::fromString(obj.value(QStringLiteral("id")).toString()));
     node.m_title = obj.value(QStringLiteral("title")).toString();
     node.m_script = obj.value(QStringLiteral("script")).toString();
     node.m_type = typeFromString(obj.value(QStringLiteral("type")).toString());
@@ -2,32 +2,57 @@
 
 #include <QJsonObject>
 #include <QList>
+#include <QMap>
 #include <QPointF>
 #include <QString>
 
+#include <memory>
+
 #include "Choice.h"
+#include "LazyScript.h"
+#include "MappedFile.h"
+#include "ObjectId.h"
 
 class StoryNode
 {
 public:
     enum class Type { Dialogue, Menu, Jump, End };
 
-    explicit StoryNode(const QString &id = {});
+    explicit StoryNode(const ObjectId &id = {});
 
-    QString id() const { return m_id; }
-    void setId(const QString &id) { m_id = id; }
+    ObjectId id() const { return m_id; }
+    void setId(const ObjectId &id) { m_id = id; }
 
     QString title() const { return m_title; }
     void setTitle(const QString &title) { m_title = title; }
 
-    QString script() const { return m_script; }
-    void setScript(const QString &script) { m_script = script; }
+    // A script set from a mapped file is decoded on the first call to
+    // script(); see LazyScript.
+    QString script() const;
+    void setScript(const QString &script);
+    void setScript(MappedBytes utf8);
+    [[nodiscard]] bool isScriptLoaded() const;
+    // Rewrites a script saved as HTML in RichText's stored form; returns
+    // whether it did. GUI thread only, see RichText::fromLegacyScript().
+    bool convertLegacyScript();
+    // A script read from a file that does not match its checksum. script()
+    // still returns what was read, but the node is not saved until its
+    // script is set again.
+    [[nodiscard]] bool isScriptDamaged() const;
+    [[nodiscard]] std::shared_ptr<const MappedFile> scriptFile() const;
+    // Encoded script; an unloaded script is copied without being decoded.
+    [[nodiscard]] QByteArray scriptUtf8() const;
+    // A still unloaded script shared by both nodes is not decoded.
+    [[nodiscard]] bool hasSameScript(const StoryNode &other) const;
+    void copyScriptFrom(const StoryNode &other);
 
     Type type() const { return m_type; }
     void setType(Type type) { m_type = type; }
 
     QList<Choice> &choices() { return m_choices; }
     const QList<Choice> &choices() const { return m_choices; }
+    Choice *findChoice(const ObjectId &choiceId);
+    const Choice *findChoice(const ObjectId &choiceId) const;
 
     QPointF position() const { return m_position; }
     void setPosition(const QPointF &pos) { m_position = pos; }
@@ -35,11 +60,18 @@ public:
     [[nodiscard]] QJsonObject toJson() const;
     static StoryNode fromJson(const QJsonObject &obj);
 
+    static QString typeToString(Type type);
+    static Type typeFromString(const QString &value);
+
 private:
-    QString m_id;
+    ObjectId m_id;
     QString m_title;
     QString m_script;
+    std::shared_ptr<const LazyScript> m_lazyScript;
     Type m_type{Type::Dialogue};
     QList<Choice> m_choices;
     QPointF m_position{};
 };
+
+// Nodes being loaded or adopted; snapshots hold theirs in a SharedNodeMap.
+using StoryNodeMap = QMap<ObjectId, std::shared_ptr<StoryNode>>;
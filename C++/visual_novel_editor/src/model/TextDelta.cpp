@@ -0,0 +1,26 @@
+#include "TextDelta.h"
+
+TextDelta TextDelta::between(const QString &before, const QString &after)
+{
+    const qsizetype shorter = qMin(before.size(), after.size());
+    qsizetype prefix = 0;
+    while (prefix < shorter && before[prefix] == after[prefix]) {
+        ++prefix;
+    }
+    qsizetype suffix = 0;
+    while (suffix < shorter - prefix && before[before.size() - 1 - suffix] == after[after.size() - 1 - suffix]) {
+        ++suffix;
+    }
+    return TextDelta{prefix, before.mid(prefix, before.size() - prefix - suffix),
+                     after.mid(prefix, after.size() - prefix - suffix)};
+}
+
+QString TextDelta::apply(const QString &text) const
+{
+    return text.left(position) + inserted + text.mid(position + removed.size());
+}
+
+QString TextDelta::revert(const QString &text) const
+{
+    return text.left(position) + removed + text.mid(position + inserted.size());
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <QString>
+#include <QtGlobal>
+
+// One replaced range that turns a text into another. The common prefix and
+// suffix of the two texts are left out, so a typing edit stays small however
+// long the text is.
+struct TextDelta {
+    qsizetype position{0};
+    QString removed;
+    QString inserted;
+
+    [[nodiscard]] static TextDelta between(const QString &before, const QString &after);
+    [[nodiscard]] bool isEmpty() const { return removed.isEmpty() && inserted.isEmpty(); }
+    // Turns the text before into the text after, and back.
+    [[nodiscard]] QString apply(const QString &text) const;
+    [[nodiscard]] QString revert(const QString &text) const;
+};
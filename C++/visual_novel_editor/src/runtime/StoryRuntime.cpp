@@ -0,0 +1,181 @@
+#include "StoryRuntime.h"
+
+#include <QtEndian>
+
+#include "StoryRuntimeFormat.h"
+
+using namespace StoryRuntimeFormat;
+
+namespace {
+quint32 readUInt32(QByteArrayView data, qsizetype offset)
+{
+    return qFromLittleEndian<quint32>(data.data() + offset);
+}
+
+// Whether count records of size bytes at offset lie within the data.
+bool fits(QByteArrayView data, qsizetype offset, quint32 count, qsizetype size)
+{
+    return offset >= kHeaderSize && offset <= data.size() && qint64(count) * size <= data.size() - offset;
+}
+}
+
+bool StoryRuntime::load(QByteArrayView data)
+{
+    m_data = {};
+    m_atEnd = true;
+    m_choices.clear();
+    m_errorString.clear();
+    if (data.size() < kHeaderSize || data.first(sizeof(kMagic)) != QByteArrayView(kMagic, sizeof(kMagic))) {
+        m_errorString = QStringLiteral("Not a compiled story");
+        return false;
+    }
+    const quint16 version = qFromLittleEndian<quint16>(data.data() + 4);
+    if (version != kVersion) {
+        m_errorString = QStringLiteral("Unsupported compiled story version %1").arg(version);
+        return false;
+    }
+
+    m_labelCount = readUInt32(data, kLabelCountOffset);
+    m_entryLabel = readUInt32(data, kEntryLabelOffset);
+    m_labels = readUInt32(data, kLabelsOffset);
+    m_instructionCount = readUInt32(data, kInstructionCountOffset);
+    m_instructions = readUInt32(data, kInstructionsOffset);
+    m_stringCount = readUInt32(data, kStringCountOffset);
+    m_strings = readUInt32(data, kStringsOffset);
+    m_poolSize = readUInt32(data, kPoolSizeOffset);
+    m_pool = readUInt32(data, kPoolOffset);
+    if (!fits(data, m_labels, m_labelCount, kLabelSize) || !fits(data, m_instructions, m_instructionCount, kInstructionSize)
+        || !fits(data, m_strings, m_stringCount, kStringSize) || !fits(data, m_pool, m_poolSize, 1)
+        || (m_labelCount > 0 && m_entryLabel >= m_labelCount)) {
+        m_errorString = QStringLiteral("Compiled story is truncated or corrupt");
+        return false;
+    }
+
+    m_data = data;
+    if (m_labelCount > 0) {
+        jumpTo(m_entryLabel);
+    }
+    return true;
+}
+
+QUtf8StringView StoryRuntime::labelName(quint32 label) const
+{
+    QUtf8StringView name;
+    if (label < m_labelCount) {
+        string(readUInt32(m_data, m_labels + qsizetype(label) * kLabelSize + 4), name);
+    }
+    return name;
+}
+
+bool StoryRuntime::jumpTo(quint32 label)
+{
+    if (label >= m_labelCount) {
+        return false;
+    }
+    const quint32 first = readUInt32(m_data, m_labels + qsizetype(label) * kLabelSize);
+    if (first >= m_instructionCount) {
+        return false;
+    }
+    m_position = first;
+    m_atEnd = false;
+    m_choices.clear();
+    return true;
+}
+
+StoryRuntime::Event StoryRuntime::next()
+{
+    if (m_atEnd) {
+        return Event::End;
+    }
+    if (m_position >= m_instructionCount) {
+        return fail(QStringLiteral("Label runs past the last instruction"));
+    }
+
+    const Instruction current = instruction(m_position);
+    switch (Opcode(current.opcode)) {
+    case Opcode::Line:
+        if (!string(current.a, m_text)) {
+            return fail(QStringLiteral("Line %1 refers to a missing string").arg(m_position));
+        }
+        ++m_position;
+        return Event::Line;
+    case Opcode::Menu: {
+        if (qint64(m_position) + current.a >= m_instructionCount) {
+            return fail(QStringLiteral("Menu %1 runs past the last instruction").arg(m_position));
+        }
+        m_choices.clear();
+        for (quint32 index = m_position + 1; index <= m_position + current.a; ++index) {
+            const Instruction choice = instruction(index);
+            QUtf8StringView condition;
+            if (Opcode(choice.opcode) != Opcode::Choice || choice.b >= m_labelCount
+                || (choice.c != kNoString && !string(choice.c, condition))) {
+                return fail(QStringLiteral("Menu %1 holds a broken choice").arg(m_position));
+            }
+            if (choice.c == kNoString || !m_conditionEvaluator || m_conditionEvaluator(condition)) {
+                m_choices.append(index);
+            }
+        }
+        if (m_choices.isEmpty()) {
+            m_atEnd = true;
+            return Event::End;
+        }
+        return Event::Menu;
+    }
+    case Opcode::End:
+        m_atEnd = true;
+        return Event::End;
+    case Opcode::Choice:
+        break;
+    }
+    return fail(QStringLiteral("Unexpected instruction at %1").arg(m_position));
+}
+
+QUtf8StringView StoryRuntime::choiceText(qsizetype choice) const
+{
+    QUtf8StringView text;
+    if (choice >= 0 && choice < m_choices.size()) {
+        string(instruction(m_choices[choice]).a, text);
+    }
+    return text;
+}
+
+bool StoryRuntime::choose(qsizetype choice)
+{
+    if (choice < 0 || choice >= m_choices.size()) {
+        return false;
+    }
+    return jumpTo(instruction(m_choices[choice]).b);
+}
+
+StoryRuntime::Instruction StoryRuntime::instruction(quint32 index) const
+{
+    const qsizetype offset = m_instructions + qsizetype(index) * kInstructionSize;
+    Instruction result;
+    result.opcode = quint8(m_data[offset]);
+    result.a = readUInt32(m_data, offset + 4);
+    result.b = readUInt32(m_data, offset + 8);
+    result.c = readUInt32(m_data, offset + 12);
+    return result;
+}
+
+bool StoryRuntime::string(quint32 index, QUtf8StringView &value) const
+{
+    if (index >= m_stringCount) {
+        return false;
+    }
+    const qsizetype entry = m_strings + qsizetype(index) * kStringSize;
+    const quint32 offset = readUInt32(m_data, entry);
+    const quint32 size = readUInt32(m_data, entry + 4);
+    if (qint64(offset) + size > m_poolSize) {
+        return false;
+    }
+    value = QUtf8StringView(m_data.data() + m_pool + offset, size);
+    return true;
+}
+
+StoryRuntime::Event StoryRuntime::fail(const QString &message)
+{
+    m_errorString = message;
+    m_atEnd = true;
+    return Event::Error;
+}
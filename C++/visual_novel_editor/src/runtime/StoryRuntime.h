@@ -0,0 +1,81 @@
+#pragma once
+
+#include <QByteArrayView>
+#include <QList>
+#include <QString>
+#include <QUtf8StringView>
+#include <QtGlobal>
+
+#include <functional>
+#include <utility>
+
+// Plays a compiled story (see StoryRuntimeFormat.h) straight from its bytes,
+// typically a mapped file, which must stay valid while the runtime uses it.
+// Loading only checks the header and table bounds; instructions are checked
+// as they are reached, and jumps go through the label table.
+class StoryRuntime
+{
+public:
+    enum class Event {
+        // text() holds the next line of the current label.
+        Line,
+        // The label ends in a menu; pick with choose().
+        Menu,
+        End,
+        // The story data is broken; see errorString().
+        Error
+    };
+
+    // Decides whether a choice with a condition is offered. Without one,
+    // every choice is.
+    using ConditionEvaluator = std::function<bool(QUtf8StringView condition)>;
+
+    [[nodiscard]] bool load(QByteArrayView data);
+    [[nodiscard]] QString errorString() const { return m_errorString; }
+
+    [[nodiscard]] quint32 labelCount() const { return m_labelCount; }
+    [[nodiscard]] quint32 entryLabel() const { return m_entryLabel; }
+    [[nodiscard]] QUtf8StringView labelName(quint32 label) const;
+    void setConditionEvaluator(ConditionEvaluator evaluator) { m_conditionEvaluator = std::move(evaluator); }
+
+    // Continues at the start of label; false for labels that do not exist.
+    bool jumpTo(quint32 label);
+    [[nodiscard]] Event next();
+
+    [[nodiscard]] QUtf8StringView text() const { return m_text; }
+    // The choices of the current menu that passed their condition.
+    [[nodiscard]] qsizetype choiceCount() const { return m_choices.size(); }
+    [[nodiscard]] QUtf8StringView choiceText(qsizetype choice) const;
+    bool choose(qsizetype choice);
+
+private:
+    struct Instruction {
+        quint8 opcode{0};
+        quint32 a{0};
+        quint32 b{0};
+        quint32 c{0};
+    };
+
+    [[nodiscard]] Instruction instruction(quint32 index) const;
+    bool string(quint32 index, QUtf8StringView &value) const;
+    Event fail(const QString &message);
+
+    QByteArrayView m_data;
+    quint32 m_labelCount{0};
+    quint32 m_entryLabel{0};
+    qsizetype m_labels{0};
+    quint32 m_instructionCount{0};
+    qsizetype m_instructions{0};
+    quint32 m_stringCount{0};
+    qsizetype m_strings{0};
+    qsizetype m_poolSize{0};
+    qsizetype m_pool{0};
+
+    quint32 m_position{0};
+    bool m_atEnd{true};
+    QUtf8StringView m_text;
+    // Instruction indices of the offered choices.
+    QList<quint32> m_choices;
+    ConditionEvaluator m_conditionEvaluator;
+    QString m_errorString;
+};
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <QtGlobal>
+
+// Layout of compiled story (.vnr) files. Integers are little endian and
+// every offset counts from the start of the file, so a file can be mapped
+// anywhere and read in place; nothing needs to be aligned.
+//
+//   header        "VNRT", quint16 version, quint16 0, then the quint32 fields
+//                 below from kLabelCountOffset on
+//   labels        per label: quint32 first instruction, quint32 name string
+//   instructions  per instruction: quint8 opcode, 3 zero bytes, quint32
+//                 operands a, b and c
+//   strings       per string: quint32 offset and quint32 size in the pool
+//   pool          UTF-8 bytes of every distinct string, back to back
+//
+// A label is a run of Line instructions followed by a Menu and its Choices,
+// or by End. Line text is the plain script line, with no markup; every
+// Choice target is a label of the file. Labels refer to nothing but
+// instruction and string indices, so a jump is one table lookup.
+namespace StoryRuntimeFormat {
+
+inline constexpr char kMagic[] = {'V', 'N', 'R', 'T'};
+inline constexpr quint16 kVersion = 1;
+
+inline constexpr qsizetype kLabelCountOffset = 8;
+inline constexpr qsizetype kEntryLabelOffset = 12;
+inline constexpr qsizetype kLabelsOffset = 16;
+inline constexpr qsizetype kInstructionCountOffset = 20;
+inline constexpr qsizetype kInstructionsOffset = 24;
+inline constexpr qsizetype kStringCountOffset = 28;
+inline constexpr qsizetype kStringsOffset = 32;
+inline constexpr qsizetype kPoolSizeOffset = 36;
+inline constexpr qsizetype kPoolOffset = 40;
+inline constexpr qsizetype kHeaderSize = 44;
+
+inline constexpr qsizetype kLabelSize = 8;
+inline constexpr qsizetype kInstructionSize = 16;
+inline constexpr qsizetype kStringSize = 8;
+
+// Marks an absent string operand.
+inline constexpr quint32 kNoString = 0xFFFFFFFF;
+
+enum class Opcode : quint8 {
+    // a: plain text string.
+    Line = 1,
+    // a: number of Choice instructions that follow.
+    Menu = 2,
+    // a: text string, b: target label, c: condition string or kNoString.
+    Choice = 3,
+    End = 4,
+};
+
+} // namespace StoryRuntimeFormat
@@ -0,0 +1,212 @@
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QGuiApplication>
+#include <QList>
+#include <QStringList>
+#include <QTemporaryDir>
+#include <QTextDocument>
+#include <QTextStream>
+#include <QThread>
+#include <QThreadPool>
+
+#include "export/CsvBackend.h"
+#include "export/ExportBackend.h"
+#include "export/ExportFragmentCache.h"
+#include "export/ExportIr.h"
+#include "export/ExporterRenpy.h"
+#include "export/JsonBackend.h"
+#include "export/RenpyBackend.h"
+#include "export/ScriptFormatter.h"
+#include "model/Project.h"
+#include "model/RichText.h"
+
+namespace {
+constexpr int kDefaultNodeCount = 50000;
+
+// Scripts as QTextEdit::toHtml() wrote them before scripts were stored as
+// runs, which is what existing projects still contain.
+QString legacyScriptTemplate()
+{
+    TextRun bold;
+    bold.start = 0;
+    bold.length = 1;
+    bold.flags = TextRun::Bold;
+    TextRun colored;
+    colored.start = 7;
+    colored.length = 10;
+    colored.flags = TextRun::Italic;
+    colored.color = qRgb(0xc0, 0x30, 0x30);
+    QTextDocument document;
+    RichText(QStringLiteral("e \"Line %1\"\nnarrator \"Second line\"\n$ seen = True"), {bold, colored})
+        .toDocument(&document);
+    return document.toHtml();
+}
+
+// The export path before RichText: one QTextDocument per node.
+qint64 timeDocumentPath(const Project &project)
+{
+    QElapsedTimer timer;
+    timer.start();
+    qsizetype lineCount = 0;
+    for (const StoryNode &node : project.nodes()) {
+        QTextDocument document;
+        document.setHtml(node.script());
+        lineCount += document.toPlainText().split(QLatin1Char('\n')).size();
+    }
+    Q_UNUSED(lineCount);
+    return timer.elapsed();
+}
+
+qint64 timeRunPath(const Project &project)
+{
+    QElapsedTimer timer;
+    timer.start();
+    qsizetype lineCount = 0;
+    for (const StoryNode &node : project.nodes()) {
+        lineCount += ScriptFormatter::renpyLines(RichText::fromLegacyScript(node.script())).size();
+    }
+    Q_UNUSED(lineCount);
+    return timer.elapsed();
+}
+}
+
+int main(int argc, char *argv[])
+{
+    if (!qEnvironmentVariableIsSet("QT_QPA_PLATFORM")) {
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+    }
+    QGuiApplication app(argc, argv);
+    QCoreApplication::setApplicationName(QStringLiteral("export_benchmark"));
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription(
+        QStringLiteral("Times converting node scripts to Ren'Py lines through QTextDocument and through RichText, "
+                       "then a full Ren'Py export with increasing thread counts and an incremental re-export, on a generated project."));
+    parser.addHelpOption();
+    const QCommandLineOption nodesOption(QStringLiteral("nodes"), QStringLiteral("Number of nodes to generate."),
+                                         QStringLiteral("count"), QString::number(kDefaultNodeCount));
+    parser.addOption(nodesOption);
+    const QCommandLineOption threadsOption(QStringLiteral("threads"),
+                                           QStringLiteral("Largest thread count to export with."),
+                                           QStringLiteral("count"));
+    parser.addOption(threadsOption);
+    parser.process(app);
+
+    const int nodeCount = qMax(1, parser.value(nodesOption).toInt());
+    const QString legacyScript = legacyScriptTemplate();
+    Project project;
+    {
+        // A binary tree, so every node is reachable from the first one.
+        ProjectBatch batch(&project);
+        QList<ObjectId> ids;
+        ids.reserve(nodeCount);
+        for (int i = 0; i < nodeCount; ++i) {
+            StoryNode *node = project.addNode(StoryNode::Type::Dialogue);
+            node->setScript(legacyScript.arg(i));
+            ids.append(node->id());
+            if (i > 0) {
+                Choice choice;
+                choice.text = QStringLiteral("Next");
+                choice.targetNodeId = node->id();
+                project.addChoice(ids[(i - 1) / 2], choice);
+            }
+        }
+    }
+
+    QTextStream out(stdout);
+    out << "nodes:              " << nodeCount << Qt::endl;
+    out << "QTextDocument path: " << timeDocumentPath(project) << " ms" << Qt::endl;
+    out << "RichText path:      " << timeRunPath(project) << " ms" << Qt::endl;
+
+    // Loading a project converts its scripts like this, so exports only see
+    // the stored form.
+    {
+        ProjectBatch batch(&project);
+        for (const ObjectId &id : project.nodes().ids()) {
+            project.getNode(id)->convertLegacyScript();
+            project.notifyNodeChanged(id);
+        }
+    }
+
+    QTemporaryDir dir;
+    if (!dir.isValid()) {
+        return 1;
+    }
+    // Thread counts double up to the machine's, to show how formatting scales.
+    const int maxThreads = parser.isSet(threadsOption) ? qMax(1, parser.value(threadsOption).toInt())
+                                                       : QThread::idealThreadCount();
+    QList<int> threadCounts;
+    for (int threads = 1; threads < maxThreads; threads *= 2) {
+        threadCounts.append(threads);
+    }
+    threadCounts.append(maxThreads);
+
+    const ProjectSnapshot snapshot = project.snapshot();
+    const QList<ObjectId> ids = project.nodes().ids();
+    qint64 singleThreadTime = 0;
+    for (int threads : threadCounts) {
+        QThreadPool::globalInstance()->setMaxThreadCount(threads);
+        ExporterRenpy exporter(snapshot);
+        exporter.setSelectedNodeIds(ids);
+        QElapsedTimer timer;
+        timer.start();
+        if (!exporter.exportToFile(dir.filePath(QStringLiteral("script.rpy")))) {
+            QTextStream(stderr) << "Export failed" << Qt::endl;
+            return 1;
+        }
+        const qint64 elapsed = timer.elapsed();
+        if (threads == 1) {
+            singleThreadTime = elapsed;
+        }
+        out << "full export, " << qSetFieldWidth(2) << threads << qSetFieldWidth(0) << " threads: " << elapsed
+            << " ms";
+        if (elapsed > 0 && singleThreadTime > 0) {
+            out << " (" << QString::number(double(singleThreadTime) / double(elapsed), 'f', 2) << "x)";
+        }
+        out << Qt::endl;
+    }
+
+    // One IR for all three formats, written concurrently.
+    QThreadPool::globalInstance()->setMaxThreadCount(maxThreads);
+    {
+        QElapsedTimer timer;
+        timer.start();
+        const ExportIr ir = ExportIr::build(snapshot, ids);
+        const qint64 buildTime = timer.elapsed();
+        const RenpyBackend renpy;
+        const JsonBackend json;
+        const CsvBackend csv;
+        if (!ExportBackend::writeAll(ir, {{&renpy, dir.filePath(QStringLiteral("ir.rpy"))},
+                                          {&json, dir.filePath(QStringLiteral("story.json"))},
+                                          {&csv, dir.filePath(QStringLiteral("dialogue.csv"))}})) {
+            QTextStream(stderr) << "Export failed" << Qt::endl;
+            return 1;
+        }
+        out << "IR build: " << buildTime << " ms, Ren'Py + JSON + CSV: " << timer.elapsed() - buildTime << " ms"
+            << Qt::endl;
+    }
+
+    // Re-export after a one-node edit, reusing the other nodes' blocks.
+    ExportFragmentCache cache;
+    const auto exportCached = [&](const ProjectSnapshot &version) {
+        ExporterRenpy exporter(version);
+        exporter.setSelectedNodeIds(ids);
+        exporter.setFragmentCache(&cache);
+        return exporter.exportToFile(dir.filePath(QStringLiteral("script.rpy")));
+    };
+    if (!exportCached(snapshot)) {
+        QTextStream(stderr) << "Export failed" << Qt::endl;
+        return 1;
+    }
+    StoryNode *edited = project.getNode(ids[ids.size() / 2]);
+    edited->setScript(edited->script() + QStringLiteral(" "));
+    project.notifyNodeChanged(edited->id());
+    QElapsedTimer timer;
+    timer.start();
+    if (!exportCached(project.snapshot())) {
+        QTextStream(stderr) << "Export failed" << Qt::endl;
+        return 1;
+    }
+    out << "re-export, one node changed: " << timer.elapsed() << " ms" << Qt::endl;
+    return 0;
+}
@@ -0,0 +1,58 @@
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QJsonDocument>
+#include <QList>
+#include <QTextStream>
+
+#include <algorithm>
+
+#include "export/CompiledStoryBackend.h"
+#include "export/ExportIr.h"
+#include "model/Project.h"
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName(QStringLiteral("project_converter"));
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription(
+        QStringLiteral("Converts projects between the JSON (.json) and binary (.vnb) formats, or compiles them "
+                       "for StoryRuntime (.vnr). The input format is detected from its contents, the output format "
+                       "from its extension."));
+    parser.addHelpOption();
+    parser.addPositionalArgument(QStringLiteral("input"), QStringLiteral("Project file to read."));
+    parser.addPositionalArgument(QStringLiteral("output"), QStringLiteral("Project file to write."));
+    const QCommandLineOption compactOption(QStringLiteral("compact"), QStringLiteral("Write compact JSON."));
+    parser.addOption(compactOption);
+    parser.process(app);
+
+    const QStringList arguments = parser.positionalArguments();
+    if (arguments.size() != 2) {
+        parser.showHelp(1);
+    }
+
+    QTextStream err(stderr);
+    Project project;
+    if (!project.loadFromFile(arguments.at(0))) {
+        err << "Unable to read " << arguments.at(0) << ": " << project.errorString() << Qt::endl;
+        return 1;
+    }
+    if (arguments.at(1).endsWith(QStringLiteral(".vnr"), Qt::CaseInsensitive)) {
+        // Every node, entered at the one with the smallest id.
+        QList<ObjectId> ids = project.nodes().ids();
+        std::sort(ids.begin(), ids.end());
+        const CompiledStoryBackend backend;
+        if (!ExportBackend::writeAll(ExportIr::build(project.snapshot(), ids), {{&backend, arguments.at(1)}})) {
+            err << "Unable to write " << arguments.at(1) << Qt::endl;
+            return 1;
+        }
+        return 0;
+    }
+    const auto format = parser.isSet(compactOption) ? QJsonDocument::Compact : QJsonDocument::Indented;
+    if (!project.saveToFile(arguments.at(1), format)) {
+        err << "Unable to write " << arguments.at(1) << ": " << project.errorString() << Qt::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,177 @@
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QList>
+#include <QRandomGenerator>
+#include <QTemporaryDir>
+#include <QTextStream>
+
+#include <algorithm>
+
+#include "export/CompiledStoryBackend.h"
+#include "export/ExportIr.h"
+#include "export/ScriptFormatter.h"
+#include "model/MappedFile.h"
+#include "model/Project.h"
+#include "model/RichText.h"
+#include "runtime/StoryRuntime.h"
+
+namespace {
+constexpr int kDefaultNodeCount = 50000;
+constexpr int kDefaultLineCount = 1000000;
+
+// Plays the project model the way a runtime without a compiled story
+// would: parse the script of every node reached and follow its choices.
+qint64 stepProject(const Project &project, const ObjectId &entry, int lineCount)
+{
+    QRandomGenerator random(1);
+    ObjectId current = entry;
+    qsizetype length = 0;
+    for (int lines = 0; lines < lineCount;) {
+        const StoryNode *node = project.getNode(current);
+        for (const RichText &line : ScriptFormatter::lines(RichText::fromScript(node->script()))) {
+            if (!line.text().isEmpty()) {
+                length += line.text().size();
+                ++lines;
+            }
+        }
+        const QList<Choice> &choices = node->choices();
+        current = choices.isEmpty() ? entry : choices[random.bounded(int(choices.size()))].targetNodeId;
+    }
+    return length;
+}
+
+qint64 stepRuntime(StoryRuntime &runtime, int lineCount)
+{
+    QRandomGenerator random(1);
+    qsizetype length = 0;
+    for (int lines = 0; lines < lineCount;) {
+        switch (runtime.next()) {
+        case StoryRuntime::Event::Line:
+            length += runtime.text().size();
+            ++lines;
+            break;
+        case StoryRuntime::Event::Menu:
+            runtime.choose(random.bounded(int(runtime.choiceCount())));
+            break;
+        case StoryRuntime::Event::End:
+            runtime.jumpTo(runtime.entryLabel());
+            break;
+        case StoryRuntime::Event::Error:
+            return -1;
+        }
+    }
+    return length;
+}
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName(QStringLiteral("runtime_benchmark"));
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription(
+        QStringLiteral("Compares loading and stepping through a generated story from its JSON project and from "
+                       "the compiled story StoryRuntime plays."));
+    parser.addHelpOption();
+    const QCommandLineOption nodesOption(QStringLiteral("nodes"), QStringLiteral("Number of nodes to generate."),
+                                         QStringLiteral("count"), QString::number(kDefaultNodeCount));
+    parser.addOption(nodesOption);
+    const QCommandLineOption linesOption(QStringLiteral("lines"), QStringLiteral("Number of lines to step through."),
+                                         QStringLiteral("count"), QString::number(kDefaultLineCount));
+    parser.addOption(linesOption);
+    parser.process(app);
+
+    const int nodeCount = qMax(1, parser.value(nodesOption).toInt());
+    const int lineCount = qMax(1, parser.value(linesOption).toInt());
+    QTextStream out(stdout);
+    QTextStream err(stderr);
+    QTemporaryDir dir;
+    if (!dir.isValid()) {
+        return 1;
+    }
+    const QString projectFile = dir.filePath(QStringLiteral("story.json"));
+    const QString storyFile = dir.filePath(QStringLiteral("story.vnr"));
+
+    {
+        // A binary tree whose leaves end the story; every other node offers
+        // two choices, one of them conditional.
+        Project project;
+        QList<ObjectId> ids;
+        {
+            ProjectBatch batch(&project);
+            ids.reserve(nodeCount);
+            for (int i = 0; i < nodeCount; ++i) {
+                StoryNode *node = project.addNode(StoryNode::Type::Dialogue);
+                node->setScript(QStringLiteral("e \"Line %1\"\nnarrator \"Second line\"\n$ seen = True").arg(i));
+                ids.append(node->id());
+                if (i > 0) {
+                    Choice choice;
+                    choice.text = QStringLiteral("Go to %1").arg(i);
+                    choice.targetNodeId = node->id();
+                    if (i % 2 == 0) {
+                        choice.condition = QStringLiteral("seen");
+                    }
+                    project.addChoice(ids[(i - 1) / 2], choice);
+                }
+            }
+        }
+        if (!project.saveToFile(projectFile, QJsonDocument::Compact)) {
+            err << "Unable to write " << projectFile << ": " << project.errorString() << Qt::endl;
+            return 1;
+        }
+        std::sort(ids.begin(), ids.end());
+        QFile file(storyFile);
+        if (!file.open(QIODevice::WriteOnly)
+            || !CompiledStoryBackend().write(ExportIr::build(project.snapshot(), ids), &file)) {
+            err << "Unable to write " << storyFile << Qt::endl;
+            return 1;
+        }
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+    Project project;
+    if (!project.loadFromFile(projectFile)) {
+        err << "Unable to read " << projectFile << ": " << project.errorString() << Qt::endl;
+        return 1;
+    }
+    const qint64 projectLoadTime = timer.nsecsElapsed();
+
+    timer.restart();
+    const std::shared_ptr<const MappedFile> mapped = MappedFile::open(storyFile);
+    StoryRuntime runtime;
+    if (!mapped || !runtime.load(mapped->data())) {
+        err << "Unable to load " << storyFile << ": " << runtime.errorString() << Qt::endl;
+        return 1;
+    }
+    const qint64 storyLoadTime = timer.nsecsElapsed();
+
+    const QList<ObjectId> ids = project.nodes().ids();
+    const ObjectId entry = *std::min_element(ids.cbegin(), ids.cend());
+    timer.restart();
+    stepProject(project, entry, lineCount);
+    const qint64 projectStepTime = qMax<qint64>(1, timer.nsecsElapsed());
+
+    timer.restart();
+    if (stepRuntime(runtime, lineCount) < 0) {
+        err << "Compiled story is broken: " << runtime.errorString() << Qt::endl;
+        return 1;
+    }
+    const qint64 storyStepTime = qMax<qint64>(1, timer.nsecsElapsed());
+
+    const auto milliseconds = [](qint64 nanoseconds) { return QString::number(double(nanoseconds) / 1e6, 'f', 3); };
+    const auto linesPerSecond = [lineCount](qint64 nanoseconds) {
+        return QString::number(double(lineCount) * 1e9 / double(nanoseconds), 'f', 0);
+    };
+    out << "nodes:                   " << nodeCount << Qt::endl;
+    out << "JSON project load:       " << milliseconds(projectLoadTime) << " ms (" << QFile(projectFile).size()
+        << " bytes)" << Qt::endl;
+    out << "compiled story load:     " << milliseconds(storyLoadTime) << " ms (" << QFile(storyFile).size()
+        << " bytes)" << Qt::endl;
+    out << "JSON project stepping:   " << linesPerSecond(projectStepTime) << " lines/s" << Qt::endl;
+    out << "compiled story stepping: " << linesPerSecond(storyStepTime) << " lines/s" << Qt::endl;
+    return 0;
+}
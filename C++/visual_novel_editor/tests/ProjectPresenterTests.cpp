@@ -1,8 +1,13 @@
 #include <cassert>
+#include <functional>
 #include <memory>
+#include <utility>
 #include <vector>
 
+#include <QCoreApplication>
+#include <QFile>
 #include <QStringList>
+#include <QTemporaryDir>
 
 #include "gui/presenter/ProjectPresenter.h"
 #include "model/Project.h"
@@ -19,10 +24,12 @@ namespace {
 class DummyProgressView : public IExportProgressView
 {
 public:
-    bool update(int, int) override { return continueUpdates; }
+    void update(int, int) override { ++updates; }
+    void setCancelHandler(std::function<void()> handler) override { cancel = std::move(handler); }
     void close() override { closed = true; }
 
-    bool continueUpdates{true};
+    std::function<void()> cancel;
+    int updates{0};
     bool closed{false};
 };
 
@@ -30,6 +37,7 @@ class StubMainWindowView : public IMainWindowView
 {
 public:
     QString promptSaveFile(const QString &, const QString &) override { return saveFileResponse; }
+    QString promptDirectory(const QString &) override { return directoryResponse; }
 
     void showWarningMessage(const QString &titleKey, const QString &messageKey) override
     {
@@ -48,15 +56,16 @@ public:
                                                                     const QString &) override
     {
         createdProgressDialog = true;
-        return std::make_unique<DummyProgressView>();
+        auto view = std::make_unique<DummyProgressView>();
+        progressView = view.get();
+        return view;
     }
 
-    void processEvents() override { processedEvents = true; }
-
     QString saveFileResponse;
+    QString directoryResponse;
     bool projectFileReset{false};
     bool createdProgressDialog{false};
-    bool processedEvents{false};
+    DummyProgressView *progressView{nullptr};
     std::vector<std::pair<QString, int>> statusMessages;
     std::vector<std::pair<QString, QString>> warnings;
 };
@@ -66,10 +75,10 @@ class StubGraphSceneView : public IGraphSceneView
 public:
     void setProject(Project *project) override { lastProject = project; ++setProjectCalls; }
 
-    QStringList selectedNodeIds() const override { return selectedIds; }
+    QList<ObjectId> selectedNodeIds() const override { return selectedIds; }
 
     Project *lastProject{nullptr};
-    mutable QStringList selectedIds;
+    mutable QList<ObjectId> selectedIds;
     int setProjectCalls{0};
 };
 
@@ -123,7 +132,7 @@ void testAddNodeCreatesStoryNode()
 
     assert(!project.nodes().isEmpty());
     assert(scene.lastProject == &project);
-    assert(scene.setProjectCalls >= 2); // initial set + refresh after add
+    assert(scene.setProjectCalls == 1); // the scene follows model signals, no reset
     assert(!mainWindow.statusMessages.empty());
     assert(mainWindow.statusMessages.back().first == QStringLiteral("Node added"));
 }
@@ -139,21 +148,108 @@ void testDeleteSelectionRemovesNodes()
     presenter.setProject(&project);
 
     StoryNode *node = project.addNode(StoryNode::Type::Dialogue);
-    const QString nodeId = node->id();
+    const ObjectId nodeId = node->id();
 
-    scene.selectedIds = QStringList{nodeId};
+    scene.selectedIds = QList<ObjectId>{nodeId};
 
     presenter.deleteSelection();
 
     assert(project.getNode(nodeId) == nullptr);
-    assert(scene.setProjectCalls >= 2);
+    assert(scene.setProjectCalls == 1);
+}
+
+void testExportRunsOnSnapshot()
+{
+    StubMainWindowView mainWindow;
+    StubGraphSceneView scene;
+    StubInspectorView inspector;
+    ProjectPresenter presenter(mainWindow, scene, inspector);
+    Project project;
+    presenter.setProject(&project);
+
+    StoryNode *node = project.addNode(StoryNode::Type::Dialogue);
+    node->setScript(QStringLiteral("e \"Before\""));
+    project.notifyNodeChanged(node->id());
+
+    QTemporaryDir dir;
+    assert(dir.isValid());
+    mainWindow.saveFileResponse = dir.filePath(QStringLiteral("script.rpy"));
+    presenter.exportToRenpy();
+    assert(mainWindow.createdProgressDialog);
+    // Edits made while the export runs do not reach it.
+    node->setScript(QStringLiteral("e \"After\""));
+    project.notifyNodeChanged(node->id());
+    presenter.waitForExport();
+
+    assert(!presenter.isExporting());
+    assert(mainWindow.warnings.empty());
+    assert(mainWindow.statusMessages.back().first == QStringLiteral("Exported to Ren'Py"));
+    QFile file(mainWindow.saveFileResponse);
+    assert(file.open(QIODevice::ReadOnly | QIODevice::Text));
+    const QString exported = QString::fromUtf8(file.readAll());
+    assert(exported.contains(QStringLiteral("e \"Before\"")));
+    assert(!exported.contains(QStringLiteral("After")));
+}
+
+void testExportChaptersWritesDirectory()
+{
+    StubMainWindowView mainWindow;
+    StubGraphSceneView scene;
+    StubInspectorView inspector;
+    ProjectPresenter presenter(mainWindow, scene, inspector);
+    Project project;
+    presenter.setProject(&project);
+    const ObjectId nodeId = project.addNode(StoryNode::Type::Dialogue)->id();
+
+    QTemporaryDir dir;
+    assert(dir.isValid());
+    mainWindow.directoryResponse = dir.filePath(QStringLiteral("game"));
+    presenter.exportToRenpyChapters();
+    presenter.waitForExport();
+
+    assert(mainWindow.warnings.empty());
+    assert(mainWindow.statusMessages.back().first == QStringLiteral("Exported to Ren'Py"));
+    assert(QFile::exists(
+        dir.filePath(QStringLiteral("game/chapter_%1.rpy").arg(nodeId.toString()))));
+}
+
+void testExportJsonAndDialogueSheet()
+{
+    StubMainWindowView mainWindow;
+    StubGraphSceneView scene;
+    StubInspectorView inspector;
+    ProjectPresenter presenter(mainWindow, scene, inspector);
+    Project project;
+    presenter.setProject(&project);
+    StoryNode *node = project.addNode(StoryNode::Type::Dialogue);
+    node->setScript(QStringLiteral("e \"Hello\" with dissolve"));
+    project.notifyNodeChanged(node->id());
+
+    QTemporaryDir dir;
+    assert(dir.isValid());
+    mainWindow.directoryResponse = dir.path();
+    presenter.exportJsonAndDialogueSheet();
+    assert(mainWindow.createdProgressDialog);
+    presenter.waitForExport();
+
+    assert(mainWindow.warnings.empty());
+    assert(mainWindow.statusMessages.back().first == QStringLiteral("Exported JSON and dialogue sheet"));
+    assert(QFile::exists(dir.filePath(QStringLiteral("story.json"))));
+    QFile sheet(dir.filePath(QStringLiteral("dialogue.csv")));
+    assert(sheet.open(QIODevice::ReadOnly | QIODevice::Text));
+    assert(QString::fromUtf8(sheet.readAll()).contains(QStringLiteral("with dissolve")));
 }
 
-int main()
+int main(int argc, char *argv[])
 {
+    QCoreApplication app(argc, argv);
+
     testNewProjectResetsState();
     testAddNodeCreatesStoryNode();
     testDeleteSelectionRemovesNodes();
+    testExportRunsOnSnapshot();
+    testExportChaptersWritesDirectory();
+    testExportJsonAndDialogueSheet();
 
     return 0;
 }
@@ -0,0 +1,1467 @@
+#include <algorithm>
+#include <cassert>
+#include <utility>
+
+#include <QBitArray>
+#include <QByteArray>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QObject>
+#include <QPointF>
+#include <QSet>
+#include <QString>
+#include <QStringList>
+#include <QTemporaryDir>
+#include <QThreadPool>
+
+#include "export/CompiledStoryBackend.h"
+#include "export/CsvBackend.h"
+#include "export/ExportBackend.h"
+#include "export/ExportFragmentCache.h"
+#include "export/ExportIr.h"
+#include "export/ExporterRenpy.h"
+#include "export/JsonBackend.h"
+#include "export/RenpyBackend.h"
+#include "export/ScriptFormatter.h"
+#include "model/Choice.h"
+#include "model/Crc32.h"
+#include "model/NodeStore.h"
+#include "model/ObjectId.h"
+#include "model/Project.h"
+#include "model/ProjectAutoSaver.h"
+#include "model/ProjectHistory.h"
+#include "model/ProjectJournal.h"
+#include "model/RichText.h"
+#include "model/StoryGraph.h"
+#include "model/StoryNode.h"
+#include "runtime/StoryRuntime.h"
+
+namespace {
+
+Choice makeChoice(const ObjectId &targetId)
+{
+    Choice choice;
+    choice.text = QStringLiteral("Choice");
+    choice.targetNodeId = targetId;
+    return choice;
+}
+
+} // namespace
+
+void testObjectIdsKeepTheirText()
+{
+    const ObjectId created = ObjectId::create();
+    assert(!created.isNull());
+    assert(ObjectId::fromString(created.toString()) == created);
+    assert(ObjectId::fromString(QString()).isNull());
+
+    // Ids that are not in the editor's own UUID form survive unchanged.
+    for (const QString &text : {QStringLiteral("start"), QStringLiteral("6F9619FF-8B86-D011-B42D-00C04FC964FF"),
+                                QStringLiteral("00000000-0000-0000-0000-000000000000")}) {
+        const ObjectId id = ObjectId::fromString(text);
+        assert(!id.isNull());
+        assert(id.toString() == text);
+        assert(ObjectId::fromString(text) == id);
+    }
+
+    const QStringList texts{QStringLiteral("b"), QStringLiteral("0a5d2f34-1c4b-4f2a-8e6d-2b1f0c9e7a11"),
+                            QStringLiteral("a"), QStringLiteral("f0000000-0000-4000-8000-000000000000")};
+    for (const QString &left : texts) {
+        for (const QString &right : texts) {
+            assert((ObjectId::fromString(left) < ObjectId::fromString(right)) == (left < right));
+        }
+    }
+}
+
+void testNodeStoreReusesSlotsWithNewGeneration()
+{
+    NodeStore store;
+    const ObjectId firstId = ObjectId::create();
+    const ObjectId secondId = ObjectId::create();
+    const NodeHandle first = store.insert(StoryNode(firstId));
+    const NodeHandle second = store.insert(StoryNode(secondId));
+    const StoryNode *secondNode = store.get(second);
+    assert(store.size() == 2);
+    assert(store.find(firstId)->id() == firstId);
+
+    assert(store.remove(firstId));
+    assert(!store.remove(firstId));
+    assert(!store.get(first));
+    assert(store.get(second) == secondNode);
+
+    const ObjectId thirdId = ObjectId::create();
+    const NodeHandle third = store.insert(StoryNode(thirdId));
+    assert(third.index == first.index);
+    assert(third.generation != first.generation);
+    assert(!store.get(first));
+    assert(store.handle(thirdId) == third);
+
+    int visited = 0;
+    for (const StoryNode &node : store) {
+        assert(node.id() == secondId || node.id() == thirdId);
+        ++visited;
+    }
+    assert(visited == 2);
+}
+
+void testRichTextScriptsRoundTrip()
+{
+    const QString plain = QStringLiteral("Hello\nworld");
+    assert(RichText(plain).toScript() == plain);
+    assert(RichText::fromScript(plain) == RichText(plain));
+
+    TextRun bold;
+    bold.start = 0;
+    bold.length = 5;
+    bold.flags = TextRun::Bold;
+    TextRun styled;
+    styled.start = 6;
+    styled.length = 5;
+    styled.flags = TextRun::Italic | TextRun::Underline;
+    styled.pointSize = 18;
+    styled.color = qRgb(0xff, 0x80, 0x00);
+    const RichText rich(plain, {bold, styled});
+    const QString script = rich.toScript();
+    assert(script.endsWith(plain));
+    assert(script.size() < plain.size() + 40);
+    assert(RichText::fromScript(script) == rich);
+
+    // Text that looks like markup is stored so that it is not read as HTML.
+    const RichText tags(QStringLiteral("<b>not bold</b>"));
+    assert(tags.toScript() != tags.text());
+    assert(RichText::fromScript(tags.toScript()) == tags);
+}
+
+void testLegacyHtmlBecomesRenpyTags()
+{
+    const QString html = QStringLiteral(
+        "<!DOCTYPE HTML PUBLIC \"-//W3C//DTD HTML 4.0//EN\" \"http://www.w3.org/TR/REC-html40/strict.dtd\">\n"
+        "<html><head><meta name=\"qrichtext\" content=\"1\" /><style type=\"text/css\">\n"
+        "p, li { white-space: pre-wrap; }\n</style></head>"
+        "<body style=\" font-family:'Sans'; font-size:9pt; font-weight:400; font-style:normal;\">\n"
+        "<p style=\" margin-top:0px; -qt-block-indent:0; text-indent:0px;\">e &quot;<span style=\" "
+        "font-weight:700;\">Hi</span> &amp; <span style=\" font-size:14pt; color:#ff0000;\">there</span>&quot;  </p>\n"
+        "<p style=\"-qt-paragraph-type:empty; margin-top:0px;\"><br /></p>\n"
+        "<p style=\" margin-top:0px;\">  jump end<br />return</p></body></html>");
+    assert(RichText::isLegacyScript(html));
+    // Readers of loaded scripts, exports among them, never parse HTML.
+    assert(RichText::fromScript(html) == RichText(html));
+    const RichText script = RichText::fromLegacyScript(html);
+    assert(script.text() == QStringLiteral("e \"Hi & there\"  \n\n  jump end") + QChar(QChar::LineSeparator)
+           + QStringLiteral("return"));
+    assert(script.runs().size() == 2);
+
+    const QStringList lines = ScriptFormatter::renpyLines(script);
+    assert(lines.size() == 4);
+    assert(lines[0] == QStringLiteral("e \"{b}Hi{/b} & {size=14}{color=#ff0000}there{/color}{/size}\""));
+    assert(lines[1].isEmpty());
+    assert(lines[2] == QStringLiteral("jump end"));
+    assert(lines[3] == QStringLiteral("return"));
+
+    // Loading converts the HTML once; a file written since holds none.
+    QTemporaryDir dir;
+    assert(dir.isValid());
+    Project legacy;
+    StoryNode *node = legacy.addNode(StoryNode::Type::Dialogue);
+    node->setScript(html);
+    const ObjectId nodeId = node->id();
+    assert(legacy.saveToFile(dir.filePath(QStringLiteral("legacy.json"))));
+    Project loaded;
+    assert(loaded.loadFromFile(dir.filePath(QStringLiteral("legacy.json"))));
+    assert(loaded.convertedScriptNodeIds() == QList<ObjectId>{nodeId});
+    assert(!RichText::isLegacyScript(loaded.getNode(nodeId)->script()));
+    assert(RichText::fromScript(loaded.getNode(nodeId)->script()) == script);
+    assert(loaded.saveToFile(dir.filePath(QStringLiteral("converted.vnb"))));
+    assert(loaded.loadFromFile(dir.filePath(QStringLiteral("converted.vnb"))));
+    assert(loaded.convertedScriptNodeIds().isEmpty());
+
+    // Formatting that covers the statement only keeps its part in the
+    // string, and never reaches a comment.
+    TextRun bold;
+    bold.length = 9;
+    bold.flags = TextRun::Bold;
+    assert(ScriptFormatter::renpyText(RichText(QStringLiteral("e \"Hello\""), {bold}))
+           == QStringLiteral("e \"{b}Hello{/b}\""));
+    TextRun italic;
+    italic.start = 7;
+    italic.length = 12;
+    italic.flags = TextRun::Italic;
+    assert(ScriptFormatter::renpyText(RichText(QStringLiteral("e \"Hi\" \"\\\"x\" # \"no\""), {italic}))
+           == QStringLiteral("e \"Hi\" \"{i}\\\"x{/i}\" # \"no\""));
+}
+
+void testStoryGraphWalksWithoutRecursion()
+{
+    Project project;
+    StoryNode *a = project.addNode(StoryNode::Type::Dialogue);
+    StoryNode *b = project.addNode(StoryNode::Type::Dialogue);
+    StoryNode *c = project.addNode(StoryNode::Type::Dialogue);
+    StoryNode *d = project.addNode(StoryNode::Type::Dialogue);
+    project.addChoice(a->id(), makeChoice(b->id()));
+    project.addChoice(a->id(), makeChoice(c->id()));
+    project.addChoice(b->id(), makeChoice(d->id()));
+    project.addChoice(c->id(), makeChoice(a->id()));
+    project.addChoice(c->id(), makeChoice(ObjectId::create()));
+
+    const StoryGraph graph(project.snapshot());
+    assert(graph.size() == 4);
+    const int ia = graph.indexOf(a->id());
+    const int ib = graph.indexOf(b->id());
+    const int ic = graph.indexOf(c->id());
+    const int id = graph.indexOf(d->id());
+    assert(graph.indexOf(ObjectId::create()) == -1);
+    // The dangling choice of c is not an edge.
+    assert(graph.targets(ic).size() == 1);
+
+    assert(graph.traverse({ia}, StoryGraph::Order::DepthFirst) == QList<int>({ia, ib, id, ic}));
+    assert(graph.traverse({ia}, StoryGraph::Order::BreadthFirst) == QList<int>({ia, ib, ic, id}));
+    QBitArray mask(int(graph.size()), true);
+    mask.clearBit(ib);
+    assert(graph.traverse({ia}, StoryGraph::Order::DepthFirst, mask) == QList<int>({ia, ic}));
+    assert(graph.reachable({ib}).count(true) == 2);
+
+    // Far deeper than a recursive walk could go.
+    constexpr int kChainLength = 200000;
+    Project chain;
+    ObjectId first;
+    {
+        ProjectBatch batch(&chain);
+        ObjectId previous;
+        for (int i = 0; i < kChainLength; ++i) {
+            const ObjectId nodeId = chain.addNode(StoryNode::Type::Dialogue)->id();
+            if (previous.isNull()) {
+                first = nodeId;
+            } else {
+                chain.addChoice(previous, makeChoice(nodeId));
+            }
+            previous = nodeId;
+        }
+    }
+    const StoryGraph deep(chain.snapshot());
+    const QList<int> start{deep.indexOf(first)};
+    assert(deep.traverse(start, StoryGraph::Order::DepthFirst).size() == kChainLength);
+    assert(deep.traverse(start, StoryGraph::Order::BreadthFirst).size() == kChainLength);
+}
+
+void testParallelExportMatchesSingleThread()
+{
+    Project project;
+    StoryNode *a = project.addNode(StoryNode::Type::Dialogue);
+    StoryNode *b = project.addNode(StoryNode::Type::Dialogue);
+    StoryNode *c = project.addNode(StoryNode::Type::Dialogue);
+    StoryNode *d = project.addNode(StoryNode::Type::Dialogue);
+    project.addChoice(a->id(), makeChoice(b->id()));
+    project.addChoice(a->id(), makeChoice(c->id()));
+    project.addChoice(b->id(), makeChoice(d->id()));
+    project.addChoice(c->id(), makeChoice(d->id()));
+    project.addChoice(d->id(), makeChoice(a->id()));
+    QList<ObjectId> selection{a->id(), b->id(), c->id(), d->id()};
+    // A chain long enough to span several formatting chunks.
+    ObjectId previous = d->id();
+    for (int i = 0; i < 2500; ++i) {
+        StoryNode *node = project.addNode(StoryNode::Type::Dialogue);
+        node->setScript(QStringLiteral("e \"Line %1\"").arg(i));
+        project.addChoice(previous, makeChoice(node->id()));
+        selection.append(node->id());
+        previous = node->id();
+    }
+
+    QTemporaryDir dir;
+    assert(dir.isValid());
+    const auto exportWith = [&](int threads) {
+        QThreadPool *pool = QThreadPool::globalInstance();
+        const int defaultThreads = pool->maxThreadCount();
+        pool->setMaxThreadCount(threads);
+        ExporterRenpy exporter(project.snapshot());
+        exporter.setSelectedNodeIds(selection);
+        const QString fileName = dir.filePath(QStringLiteral("script%1.rpy").arg(threads));
+        const bool exported = exporter.exportToFile(fileName);
+        pool->setMaxThreadCount(defaultThreads);
+        assert(exported);
+        QFile file(fileName);
+        assert(file.open(QIODevice::ReadOnly));
+        return file.readAll();
+    };
+    const QByteArray sequential = exportWith(1);
+    assert(exportWith(8) == sequential);
+
+    // Depth first in choice order: d is written before c, whose target was
+    // already reached through b.
+    QStringList labels;
+    for (const QByteArray &line : sequential.split('\n')) {
+        if (line.startsWith("label ")) {
+            labels.append(QString::fromUtf8(line.mid(6).chopped(1)));
+        }
+    }
+    assert(labels.size() == selection.size());
+    assert(labels[0] == a->id().toString());
+    assert(labels[1] == b->id().toString());
+    assert(labels[2] == d->id().toString());
+    assert(labels[3] == selection[4].toString());
+    assert(labels.last() == c->id().toString());
+}
+
+void testExportReusesUnchangedFragments()
+{
+    Project project;
+    QList<ObjectId> ids;
+    for (int i = 0; i < 50; ++i) {
+        StoryNode *node = project.addNode(StoryNode::Type::Dialogue);
+        node->setScript(QStringLiteral("e \"Line %1\"").arg(i));
+        if (!ids.isEmpty()) {
+            project.addChoice(ids.last(), makeChoice(node->id()));
+        }
+        ids.append(node->id());
+    }
+
+    QTemporaryDir dir;
+    assert(dir.isValid());
+    const QString fileName = dir.filePath(QStringLiteral("script.rpy"));
+    const auto readExport = [&fileName]() {
+        QFile file(fileName);
+        assert(file.open(QIODevice::ReadOnly));
+        return file.readAll();
+    };
+    // Exports with the cache and checks the result against a fresh export.
+    ExportFragmentCache cache;
+    const auto exportCached = [&](const QList<ObjectId> &selection) {
+        ExporterRenpy uncached(project.snapshot());
+        uncached.setSelectedNodeIds(selection);
+        assert(uncached.exportToFile(fileName));
+        const QByteArray expected = readExport();
+
+        ExporterRenpy exporter(project.snapshot());
+        exporter.setSelectedNodeIds(selection);
+        exporter.setFragmentCache(&cache);
+        assert(exporter.exportToFile(fileName));
+        assert(readExport() == expected);
+        return exporter.formattedNodes();
+    };
+
+    assert(exportCached(ids) == 50);
+    assert(cache.size() == 50);
+    assert(exportCached(ids) == 0);
+
+    project.getNode(ids[10])->setScript(QStringLiteral("e \"Changed\""));
+    project.notifyNodeChanged(ids[10]);
+    assert(exportCached(ids) == 1);
+    // Titles are not written, so they do not invalidate the block.
+    project.getNode(ids[11])->setTitle(QStringLiteral("Renamed"));
+    project.notifyNodeChanged(ids[11]);
+    assert(exportCached(ids) == 0);
+
+    // Only the nodes whose menus lose a target are formatted again: the
+    // ones before the dropped node and before the end of the selection.
+    QList<ObjectId> selection = ids.mid(0, 20);
+    selection.removeAt(15);
+    assert(exportCached(selection) == 2);
+    assert(cache.size() == 19);
+
+    const QString cacheFile = ExportFragmentCache::cacheFileName(dir.filePath(QStringLiteral("story.vnp")));
+    assert(cache.save(cacheFile));
+    cache.clear();
+    assert(cache.load(cacheFile));
+    assert(cache.size() == 19);
+    assert(exportCached(selection) == 0);
+}
+
+void testChapterExportRewritesOnlyChangedFiles()
+{
+    // Two separate stories of three nodes each.
+    Project project;
+    QList<ObjectId> ids;
+    for (int i = 0; i < 6; ++i) {
+        StoryNode *node = project.addNode(StoryNode::Type::Dialogue);
+        node->setScript(QStringLiteral("e \"Line %1\"").arg(i));
+        if (i % 3 != 0) {
+            project.addChoice(ids.last(), makeChoice(node->id()));
+        }
+        ids.append(node->id());
+    }
+
+    QTemporaryDir dir;
+    assert(dir.isValid());
+    const auto exportChapters = [&](int maxLabels) {
+        ExporterRenpy exporter(project.snapshot());
+        exporter.setSelectedNodeIds(ids);
+        exporter.setMaxLabelsPerFile(maxLabels);
+        assert(exporter.exportToDirectory(dir.path()));
+        return std::make_pair(exporter.writtenFiles(), exporter.unchangedFiles());
+    };
+    const auto chapterFiles = [&dir]() {
+        return QDir(dir.path()).entryList({QStringLiteral("*.rpy")}, QDir::Files);
+    };
+
+    assert(exportChapters(0) == std::make_pair(2, 0));
+    assert(chapterFiles().size() == 2);
+    QFile first(dir.filePath(QStringLiteral("chapter_%1.rpy").arg(ids[0].toString())));
+    assert(first.open(QIODevice::ReadOnly));
+    const QByteArray firstChapter = first.readAll();
+    first.close();
+    assert(firstChapter.startsWith("# Generated by Visual Novel Editor\n\n"));
+    assert(firstChapter.count("label ") == 3);
+
+    assert(exportChapters(0) == std::make_pair(0, 2));
+    project.getNode(ids[4])->setScript(QStringLiteral("e \"Changed\""));
+    project.notifyNodeChanged(ids[4]);
+    assert(exportChapters(0) == std::make_pair(1, 1));
+
+    // Capped files replace the uncapped ones, compiled files included, and
+    // files the exports did not write are left alone.
+    const QString compiled = dir.filePath(QStringLiteral("chapter_%1.rpyc").arg(ids[0].toString()));
+    const QString notes = dir.filePath(QStringLiteral("chapter_notes.rpy"));
+    for (const QString &path : {compiled, notes}) {
+        QFile file(path);
+        assert(file.open(QIODevice::WriteOnly));
+    }
+    assert(exportChapters(2) == std::make_pair(4, 0));
+    const QStringList files = chapterFiles();
+    assert(files.size() == 5);
+    assert(files.contains(QStringLiteral("chapter_%1_2.rpy").arg(ids[0].toString())));
+    assert(!QFile::exists(compiled));
+    assert(QFile::exists(notes));
+
+    // A story starting at "a_2" must not take the name of the second part of
+    // the story starting at "a".
+    StoryNodeMap nodes;
+    for (const char *name : {"a", "b", "c", "a_2"}) {
+        const ObjectId id = ObjectId::fromString(QLatin1String(name));
+        nodes.insert(id, std::make_shared<StoryNode>(id));
+        nodes[id]->setScript(QStringLiteral("e \"%1\"").arg(QLatin1String(name)));
+    }
+    Project named;
+    named.adoptNodes(nodes);
+    named.addChoice(ObjectId::fromString(u"a"), makeChoice(ObjectId::fromString(u"b")));
+    named.addChoice(ObjectId::fromString(u"b"), makeChoice(ObjectId::fromString(u"c")));
+    QTemporaryDir namedDir;
+    assert(namedDir.isValid());
+    ExporterRenpy exporter(named.snapshot());
+    exporter.setSelectedNodeIds({ObjectId::fromString(u"a"), ObjectId::fromString(u"b"), ObjectId::fromString(u"c"),
+                                 ObjectId::fromString(u"a_2")});
+    exporter.setMaxLabelsPerFile(2);
+    assert(exporter.exportToDirectory(namedDir.path()));
+    assert(exporter.writtenFiles() == 3);
+    assert(QDir(namedDir.path()).entryList({QStringLiteral("*.rpy")}, QDir::Files).size() == 3);
+}
+
+void testExportBackendsShareOneIr()
+{
+    Project project;
+    StoryNode *a = project.addNode(StoryNode::Type::Dialogue);
+    StoryNode *b = project.addNode(StoryNode::Type::Dialogue);
+    TextRun bold;
+    bold.start = 3;
+    bold.length = 5;
+    bold.flags = TextRun::Bold;
+    a->setScript(RichText(QStringLiteral("e \"Hello, \\\"you\\\"\"\n$ seen = True"), {bold}).toScript());
+    a->setTitle(QStringLiteral("Start"));
+    b->setScript(QStringLiteral("e \"Narration\" with dissolve"));
+    Choice choice = makeChoice(b->id());
+    choice.text = QStringLiteral("Left\rRight");
+    choice.condition = QStringLiteral("seen");
+    project.addChoice(a->id(), choice);
+    const QList<ObjectId> selection{a->id(), b->id()};
+
+    const ExportIr ir = ExportIr::build(project.snapshot(), selection);
+    assert(ir.labels().size() == 2);
+    assert(ir.labels()[0].nodeId == a->id());
+    assert(ir.labels()[0].lines.size() == 2);
+    assert(ir.labels()[0].choices.size() == 1);
+
+    QTemporaryDir dir;
+    assert(dir.isValid());
+    const RenpyBackend renpy;
+    const JsonBackend json;
+    const CsvBackend csv;
+    const QString renpyFile = dir.filePath(QStringLiteral("ir.rpy"));
+    const QString jsonFile = dir.filePath(QStringLiteral("story.json"));
+    const QString csvFile = dir.filePath(QStringLiteral("dialogue.csv"));
+    assert(ExportBackend::writeAll(ir, {{&renpy, renpyFile}, {&json, jsonFile}, {&csv, csvFile}}));
+    const auto read = [](const QString &fileName) {
+        QFile file(fileName);
+        assert(file.open(QIODevice::ReadOnly));
+        return file.readAll();
+    };
+
+    // The Ren'Py backend writes what the exporter does.
+    ExporterRenpy exporter(project.snapshot());
+    exporter.setSelectedNodeIds(selection);
+    const QString exportedFile = dir.filePath(QStringLiteral("exported.rpy"));
+    assert(exporter.exportToFile(exportedFile));
+    assert(read(renpyFile) == read(exportedFile));
+
+    const QJsonArray labels = QJsonDocument::fromJson(read(jsonFile)).object().value(QStringLiteral("labels")).toArray();
+    assert(labels.size() == 2);
+    const QJsonObject first = labels[0].toObject();
+    assert(first.value(QStringLiteral("title")).toString() == QStringLiteral("Start"));
+    const QJsonObject firstLine = first.value(QStringLiteral("lines")).toArray()[0].toObject();
+    assert(firstLine.value(QStringLiteral("runs")).toArray()[0].toObject().value(QStringLiteral("bold")).toBool());
+    const QJsonObject firstChoice = first.value(QStringLiteral("choices")).toArray()[0].toObject();
+    assert(firstChoice.value(QStringLiteral("condition")).toString() == QStringLiteral("seen"));
+    assert(firstChoice.value(QStringLiteral("target")).toString() == b->id().toString());
+
+    const QStringList rows = QString::fromUtf8(read(csvFile)).remove(QChar(0xfeff)).split(QLatin1Char('\n'),
+                                                                                          Qt::SkipEmptyParts);
+    assert(rows.size() == 5);
+    assert(rows[0] == QStringLiteral("label,type,index,text"));
+    assert(rows[1] == a->id().toString() + QStringLiteral(R"(,line,0,"e ""Hello, \""you\""""")"));
+    assert(rows[2] == a->id().toString() + QStringLiteral(",line,1,$ seen = True"));
+    assert(rows[3] == a->id().toString() + QStringLiteral(",choice,0,\"Left\rRight\""));
+    assert(rows[4] == b->id().toString() + QStringLiteral(R"(,line,0,"e ""Narration"" with dissolve")"));
+}
+
+void testCompiledStoryPlaysTheGraph()
+{
+    Project project;
+    StoryNode *start = project.addNode(StoryNode::Type::Dialogue);
+    StoryNode *left = project.addNode(StoryNode::Type::Dialogue);
+    StoryNode *right = project.addNode(StoryNode::Type::Dialogue);
+    start->setScript(QStringLiteral("e \"Hi\"\n\n  e \"Pick one\"  "));
+    left->setScript(QStringLiteral("e \"Left\""));
+    right->setScript(QStringLiteral("e \"Right\""));
+    Choice toLeft = makeChoice(left->id());
+    toLeft.text = QStringLiteral("Left");
+    Choice toRight = makeChoice(right->id());
+    toRight.text = QStringLiteral("Right");
+    toRight.condition = QStringLiteral("brave");
+    project.addChoice(start->id(), toLeft);
+    project.addChoice(start->id(), toRight);
+    // Back to the start, so the story loops.
+    project.addChoice(right->id(), makeChoice(start->id()));
+
+    const QByteArray story =
+        CompiledStoryBackend::compile(ExportIr::build(project.snapshot(), {start->id(), left->id(), right->id()}));
+    StoryRuntime runtime;
+    assert(runtime.load(story));
+    assert(runtime.labelCount() == 3);
+    assert(runtime.labelName(runtime.entryLabel()) == start->id().toString().toUtf8());
+
+    // Empty lines are dropped and the rest trimmed.
+    assert(runtime.next() == StoryRuntime::Event::Line);
+    assert(runtime.text() == "e \"Hi\"");
+    assert(runtime.next() == StoryRuntime::Event::Line);
+    assert(runtime.text() == "e \"Pick one\"");
+    assert(runtime.next() == StoryRuntime::Event::Menu);
+    assert(runtime.choiceCount() == 2);
+    assert(runtime.choiceText(1) == "Right");
+    assert(runtime.choose(1));
+    assert(runtime.next() == StoryRuntime::Event::Line);
+    assert(runtime.text() == "e \"Right\"");
+    assert(runtime.next() == StoryRuntime::Event::Menu);
+    assert(runtime.choose(0));
+
+    // Conditions are left to the game.
+    runtime.setConditionEvaluator([](QUtf8StringView condition) { return condition != "brave"; });
+    assert(runtime.next() == StoryRuntime::Event::Line);
+    assert(runtime.next() == StoryRuntime::Event::Line);
+    assert(runtime.next() == StoryRuntime::Event::Menu);
+    assert(runtime.choiceCount() == 1);
+    assert(runtime.choose(0));
+    assert(runtime.next() == StoryRuntime::Event::Line);
+    assert(runtime.text() == "e \"Left\"");
+    assert(runtime.next() == StoryRuntime::Event::End);
+    assert(runtime.next() == StoryRuntime::Event::End);
+
+    // Cut anywhere, the data is rejected or reported as broken, never read
+    // out of bounds.
+    for (qsizetype size = 0; size < story.size(); ++size) {
+        StoryRuntime truncated;
+        if (!truncated.load(QByteArrayView(story).first(size))) {
+            continue;
+        }
+        for (int step = 0; step < 16 && truncated.next() != StoryRuntime::Event::Error; ++step) {
+            truncated.choose(0);
+        }
+    }
+
+    // Lines lose their formatting, and a choice to a node that does not
+    // exist is dropped instead of jumping to the entry label.
+    Project dangling;
+    StoryNode *only = dangling.addNode(StoryNode::Type::Dialogue);
+    TextRun bold;
+    bold.length = 9;
+    bold.flags = TextRun::Bold;
+    only->setScript(RichText(QStringLiteral("e \"Alone\""), {bold}).toScript());
+    Choice lost = makeChoice(ObjectId::create());
+    lost.text = QStringLiteral("Lost");
+    const ObjectId lostId = dangling.addChoice(only->id(), lost);
+    Choice again = makeChoice(only->id());
+    again.text = QStringLiteral("Again");
+    const ObjectId againId = dangling.addChoice(only->id(), again);
+    const QByteArray looping = CompiledStoryBackend::compile(ExportIr::build(dangling.snapshot()));
+    StoryRuntime alone;
+    assert(alone.load(looping));
+    assert(alone.next() == StoryRuntime::Event::Line);
+    assert(alone.text() == "e \"Alone\"");
+    assert(alone.next() == StoryRuntime::Event::Menu);
+    assert(alone.choiceCount() == 1);
+    assert(alone.choiceText(0) == "Again");
+    dangling.removeChoice(only->id(), againId);
+    assert(dangling.findChoice(lostId));
+    const QByteArray ending = CompiledStoryBackend::compile(ExportIr::build(dangling.snapshot()));
+    StoryRuntime last;
+    assert(last.load(ending));
+    assert(last.next() == StoryRuntime::Event::Line);
+    assert(last.next() == StoryRuntime::Event::End);
+}
+
+void testIncomingChoicesTracksEdges()
+{
+    Project project;
+    StoryNode *a = project.addNode(StoryNode::Type::Dialogue);
+    StoryNode *b = project.addNode(StoryNode::Type::Dialogue);
+    StoryNode *c = project.addNode(StoryNode::Type::Dialogue);
+
+    const ObjectId ab = project.addChoice(a->id(), makeChoice(b->id()));
+    const ObjectId cb = project.addChoice(c->id(), makeChoice(b->id()));
+    assert(!ab.isNull());
+    assert(!cb.isNull());
+
+    assert(project.incomingChoices(b->id()).size() == 2);
+    assert(project.incomingChoices(a->id()).isEmpty());
+    assert(project.choiceSource(ab) == a->id());
+    assert(project.findChoice(cb) == c->findChoice(cb));
+
+    project.removeChoice(c->id(), ab);
+    assert(project.choiceSource(ab) == a->id());
+    project.removeChoice(a->id(), ab);
+    const QList<ChoiceRef> incoming = project.incomingChoices(b->id());
+    assert(incoming.size() == 1);
+    assert(incoming.front().sourceNodeId == c->id());
+    assert(incoming.front().choiceId == cb);
+    assert(project.choiceSource(ab).isNull());
+    assert(!project.findChoice(ab));
+}
+
+void testRemoveNodeStripsIncomingChoices()
+{
+    Project project;
+    StoryNode *a = project.addNode(StoryNode::Type::Dialogue);
+    StoryNode *b = project.addNode(StoryNode::Type::Dialogue);
+    StoryNode *c = project.addNode(StoryNode::Type::Dialogue);
+    const ObjectId aId = a->id();
+    const ObjectId bId = b->id();
+    const ObjectId cId = c->id();
+
+    const ObjectId abId = project.addChoice(aId, makeChoice(bId));
+    const ObjectId bcId = project.addChoice(bId, makeChoice(cId));
+    project.addChoice(bId, makeChoice(bId));
+
+    project.removeNode(bId);
+    assert(!project.findChoice(abId));
+    assert(!project.findChoice(bcId));
+
+    assert(project.getNode(bId) == nullptr);
+    assert(project.getNode(aId)->choices().isEmpty());
+    assert(project.incomingChoices(bId).isEmpty());
+    assert(project.incomingChoices(cId).isEmpty());
+}
+
+void testBatchCoalescesNotifications()
+{
+    Project project;
+    StoryNode *a = project.addNode(StoryNode::Type::Dialogue);
+    StoryNode *b = project.addNode(StoryNode::Type::Dialogue);
+    const ObjectId aId = a->id();
+    const ObjectId bId = b->id();
+    const ObjectId choiceId = project.addChoice(aId, makeChoice(bId));
+
+    int changedCount = 0;
+    ProjectChangeSet lastChanges;
+    QObject::connect(&project, &Project::changed, [&]() { ++changedCount; });
+    QObject::connect(&project, &Project::changesCommitted, [&](const ProjectChangeSet &changes) {
+        lastChanges = changes;
+    });
+
+    ObjectId cId;
+    {
+        ProjectBatch batch(&project);
+        StoryNode *c = project.addNode(StoryNode::Type::Dialogue);
+        cId = c->id();
+        StoryNode *scratch = project.addNode(StoryNode::Type::Dialogue);
+        project.removeNode(scratch->id());
+        project.removeNodes(QSet<ObjectId>{bId});
+        assert(changedCount == 0);
+    }
+
+    assert(changedCount == 1);
+    assert(lastChanges.addedNodes == QSet<ObjectId>{cId});
+    assert(lastChanges.removedNodes == QSet<ObjectId>{bId});
+    assert(lastChanges.modifiedNodes == QSet<ObjectId>{aId});
+    assert(lastChanges.removedChoices.value(choiceId) == aId);
+    assert(project.getNode(aId)->choices().isEmpty());
+}
+
+void testTypedSignalsReportRemovalsFirst()
+{
+    Project project;
+    StoryNode *a = project.addNode(StoryNode::Type::Dialogue);
+    StoryNode *b = project.addNode(StoryNode::Type::Dialogue);
+    const ObjectId aId = a->id();
+    const ObjectId bId = b->id();
+    const ObjectId choiceId = project.addChoice(aId, makeChoice(bId));
+
+    QStringList events;
+    QObject::connect(&project, &Project::choiceRemoved, [&](const ObjectId &sourceId, const ObjectId &id) {
+        assert(sourceId == aId);
+        assert(id == choiceId);
+        events.append(QStringLiteral("choiceRemoved"));
+    });
+    QObject::connect(&project, &Project::nodeRemoved, [&](const ObjectId &id) {
+        assert(id == bId);
+        events.append(QStringLiteral("nodeRemoved"));
+    });
+    QObject::connect(&project, &Project::nodeChanged, [&](const ObjectId &id) {
+        assert(id == aId);
+        events.append(QStringLiteral("nodeChanged"));
+    });
+
+    project.removeNode(bId);
+
+    assert(events == QStringList({QStringLiteral("choiceRemoved"),
+                                  QStringLiteral("nodeRemoved"),
+                                  QStringLiteral("nodeChanged")}));
+}
+
+void testLoadFromFileStreamsNodes()
+{
+    QTemporaryDir dir;
+    assert(dir.isValid());
+    const QString fileName = dir.filePath(QStringLiteral("story.json"));
+
+    QFile file(fileName);
+    assert(file.open(QIODevice::WriteOnly));
+    file.write(R"({
+        "version": {"major": 1, "tags": ["a", null]},
+        "nodes": [
+            {"id": "start", "title": "Caf\u00e9 \"intro\"", "script": "line 1\nline 2",
+             "type": "menu", "position": {"x": 12.5, "y": -4},
+             "choices": [{"id": "c1", "text": "Go", "target": "end", "condition": "flag"}]},
+            {"id": "end", "type": "end", "extra": [1, {"deep": true}], "choices": []}
+        ]
+    })");
+    file.close();
+
+    Project project;
+    assert(project.loadFromFile(fileName));
+    assert(project.nodes().size() == 2);
+
+    const StoryNode *start = project.getNode(ObjectId::fromString(u"start"));
+    assert(start);
+    assert(start->title() == QStringLiteral("Caf\u00e9 \"intro\""));
+    assert(start->script() == QStringLiteral("line 1\nline 2"));
+    assert(start->type() == StoryNode::Type::Menu);
+    assert(start->position() == QPointF(12.5, -4.0));
+    assert(start->choices().size() == 1);
+    assert(start->choices().front().condition == QStringLiteral("flag"));
+    assert(project.incomingChoices(ObjectId::fromString(u"end")).size() == 1);
+
+    int calls = 0;
+    const bool loaded = project.loadFromFile(fileName, [&calls](qint64, qint64) {
+        ++calls;
+        return false;
+    });
+    assert(!loaded);
+    assert(calls == 1);
+    assert(project.nodes().size() == 2);
+
+    assert(file.open(QIODevice::WriteOnly | QIODevice::Truncate));
+    file.write(R"({"nodes": [{"id": "broken")");
+    file.close();
+    assert(!project.loadFromFile(fileName));
+    assert(!project.errorString().isEmpty());
+    assert(project.nodes().size() == 2);
+}
+
+void testSaveToFileMatchesQJsonDocument()
+{
+    Project project;
+    StoryNode *a = project.addNode(StoryNode::Type::Menu);
+    StoryNode *b = project.addNode(StoryNode::Type::End);
+    a->setTitle(QStringLiteral("Caf\u00e9"));
+    a->setScript(QStringLiteral("e \"quoted\"\ttab\\slash\nnext"));
+    a->setPosition(QPointF(12.5, -4.0));
+    Choice conditional = makeChoice(b->id());
+    conditional.condition = QStringLiteral("seen_intro");
+    project.addChoice(a->id(), conditional);
+    project.addChoice(a->id(), makeChoice(b->id()));
+
+    QList<ObjectId> ids = project.nodes().ids();
+    std::sort(ids.begin(), ids.end());
+    QJsonArray nodesArray;
+    for (const ObjectId &id : ids) {
+        nodesArray.append(project.getNode(id)->toJson());
+    }
+    QJsonObject root;
+    root[QStringLiteral("nodes")] = nodesArray;
+    const QJsonDocument expected(root);
+
+    QTemporaryDir dir;
+    assert(dir.isValid());
+    const QString fileName = dir.filePath(QStringLiteral("story.json"));
+    for (const auto format : {QJsonDocument::Indented, QJsonDocument::Compact}) {
+        assert(project.saveToFile(fileName, format));
+
+        QFile file(fileName);
+        assert(file.open(QIODevice::ReadOnly));
+        assert(file.readAll() == expected.toJson(format));
+        file.close();
+
+        Project reloaded;
+        assert(reloaded.loadFromFile(fileName));
+        assert(reloaded.nodes().size() == 2);
+        assert(reloaded.getNode(a->id())->script() == a->script());
+        assert(reloaded.getNode(a->id())->choices().size() == 2);
+    }
+
+    // Files saved by editors that prepend a UTF-8 BOM still load.
+    QFile file(fileName);
+    assert(file.open(QIODevice::WriteOnly));
+    file.write("\xEF\xBB\xBF" + expected.toJson());
+    file.close();
+    Project withBom;
+    assert(withBom.loadFromFile(fileName));
+    assert(withBom.nodes().size() == 2);
+}
+
+void testBinaryFormatRoundTrip()
+{
+    Project project;
+    StoryNode *a = project.addNode(StoryNode::Type::Jump);
+    StoryNode *b = project.addNode(StoryNode::Type::End);
+    a->setScript(QStringLiteral("<p>Caf\u00e9 \U0001F600</p>"));
+    a->setPosition(QPointF(-3.25, 7.0));
+    Choice conditional = makeChoice(b->id());
+    conditional.condition = QStringLiteral("flag");
+    project.addChoice(a->id(), conditional);
+    project.addChoice(a->id(), makeChoice(b->id()));
+
+    QTemporaryDir dir;
+    assert(dir.isValid());
+    const QString fileName = dir.filePath(QStringLiteral("story.vnb"));
+    assert(Project::formatForFileName(fileName) == Project::FileFormat::Binary);
+    assert(project.saveToFile(fileName));
+
+    // Loading goes by content, not by extension.
+    const QString renamed = dir.filePath(QStringLiteral("story.json"));
+    assert(QFile::copy(fileName, renamed));
+
+    Project reloaded;
+    assert(reloaded.loadFromFile(renamed));
+    assert(reloaded.nodes().size() == 2);
+    const StoryNode *loaded = reloaded.getNode(a->id());
+    assert(loaded);
+    assert(loaded->type() == StoryNode::Type::Jump);
+    assert(loaded->title() == a->title());
+    assert(loaded->script() == a->script());
+    assert(loaded->position() == a->position());
+    assert(loaded->choices().size() == 2);
+    assert(loaded->choices().at(0).id == a->choices().at(0).id);
+    assert(loaded->choices().at(0).condition == conditional.condition);
+    assert(!loaded->choices().at(1).condition.has_value());
+    assert(reloaded.incomingChoices(b->id()).size() == 2);
+}
+
+void testBinaryFormatReportsCorruptSection()
+{
+    Project project;
+    project.addNode(StoryNode::Type::Dialogue);
+
+    QTemporaryDir dir;
+    assert(dir.isValid());
+    const QString fileName = dir.filePath(QStringLiteral("story.vnb"));
+    assert(project.saveToFile(fileName));
+
+    QFile file(fileName);
+    assert(file.open(QIODevice::ReadWrite));
+    QByteArray data = file.readAll();
+    data[data.size() - 1] = char(data.at(data.size() - 1) ^ 0x5A);
+    assert(file.seek(0));
+    assert(file.write(data) == data.size());
+    file.close();
+
+    Project reloaded;
+    reloaded.addNode(StoryNode::Type::Menu);
+    assert(!reloaded.loadFromFile(fileName));
+    assert(reloaded.errorString().contains(QStringLiteral("NODE")));
+    assert(reloaded.errorString().contains(QStringLiteral("checksum")));
+    assert(reloaded.nodes().size() == 1);
+
+    assert(crc32(QByteArrayView("123456789")) == 0xCBF43926u);
+}
+
+void testBinaryLoadDecodesScriptsLazily()
+{
+    Project project;
+    StoryNode *a = project.addNode(StoryNode::Type::Dialogue);
+    StoryNode *b = project.addNode(StoryNode::Type::Dialogue);
+    a->setScript(QStringLiteral("<p>first</p>"));
+    b->setScript(QStringLiteral("<p>second \u00e9</p>"));
+
+    QTemporaryDir dir;
+    assert(dir.isValid());
+    const QString fileName = dir.filePath(QStringLiteral("story.vnb"));
+    assert(project.saveToFile(fileName));
+
+    Project reloaded;
+    assert(reloaded.loadFromFile(fileName));
+    StoryNode *loadedA = reloaded.getNode(a->id());
+    StoryNode *loadedB = reloaded.getNode(b->id());
+    assert(!loadedA->isScriptLoaded());
+    assert(!loadedB->isScriptLoaded());
+
+    assert(loadedA->script() == a->script());
+    assert(loadedA->isScriptLoaded());
+    assert(!loadedB->isScriptLoaded());
+    assert(loadedB->scriptUtf8() == b->script().toUtf8());
+    assert(!loadedB->isScriptLoaded());
+
+    // Saving over the mapped file must not lose the scripts still in it.
+    loadedA->setScript(QStringLiteral("<p>edited</p>"));
+    assert(reloaded.saveToFile(fileName));
+    Project again;
+    assert(again.loadFromFile(fileName));
+    assert(again.getNode(a->id())->script() == QStringLiteral("<p>edited</p>"));
+    assert(again.getNode(b->id())->script() == b->script());
+}
+
+void testBinaryLoadFlagsDamagedScripts()
+{
+    Project project;
+    StoryNode *intact = project.addNode(StoryNode::Type::Dialogue);
+    StoryNode *damaged = project.addNode(StoryNode::Type::Dialogue);
+    intact->setScript(QStringLiteral("<p>intact</p>"));
+    damaged->setScript(QStringLiteral("<p>damaged</p>"));
+
+    QTemporaryDir dir;
+    assert(dir.isValid());
+    const QString fileName = dir.filePath(QStringLiteral("story.vnb"));
+    assert(project.saveToFile(fileName));
+    {
+        QFile file(fileName);
+        assert(file.open(QIODevice::ReadWrite));
+        QByteArray data = file.readAll();
+        const qsizetype position = data.indexOf("damaged");
+        assert(position >= 0);
+        data[position] = 'D';
+        assert(file.seek(0));
+        assert(file.write(data) == data.size());
+    }
+
+    // Scripts carry their own checksum, so the file still opens.
+    Project reloaded;
+    assert(reloaded.loadFromFile(fileName));
+    StoryNode *loaded = reloaded.getNode(damaged->id());
+    assert(loaded->isScriptDamaged());
+    assert(loaded->script() == QStringLiteral("<p>Damaged</p>"));
+    assert(!reloaded.getNode(intact->id())->isScriptDamaged());
+    assert(reloaded.damagedScriptNodeIds() == QList<ObjectId>{damaged->id()});
+
+    const QString copyName = dir.filePath(QStringLiteral("copy.vnb"));
+    assert(!reloaded.saveToFile(copyName));
+    assert(reloaded.errorString().contains(damaged->id().toString()));
+    assert(!QFile::exists(copyName));
+
+    loaded->setScript(QStringLiteral("<p>repaired</p>"));
+    assert(!loaded->isScriptDamaged());
+    assert(reloaded.saveToFile(copyName));
+}
+
+void testJournalRecordsEditsWithoutRewritingProject()
+{
+    QTemporaryDir dir;
+    assert(dir.isValid());
+    const QString fileName = dir.filePath(QStringLiteral("story.json"));
+
+    Project project;
+    StoryNode *kept = project.addNode(StoryNode::Type::Dialogue);
+    StoryNode *removed = project.addNode(StoryNode::Type::Dialogue);
+    const ObjectId keptId = kept->id();
+    const ObjectId removedId = removed->id();
+    assert(project.saveToFile(fileName));
+
+    QByteArray baseContents;
+    {
+        QFile file(fileName);
+        assert(file.open(QIODevice::ReadOnly));
+        baseContents = file.readAll();
+    }
+
+    ProjectJournal journal(&project);
+    assert(journal.create(fileName));
+    kept->setTitle(QStringLiteral("Edited"));
+    project.notifyNodeChanged(keptId);
+    project.removeNode(removedId);
+    const ObjectId addedId = project.addNode(StoryNode::Type::End)->id();
+    project.addChoice(keptId, makeChoice(addedId));
+    assert(journal.commit());
+    assert(!journal.hasUncommittedRecords());
+
+    {
+        QFile file(fileName);
+        assert(file.open(QIODevice::ReadOnly));
+        assert(file.readAll() == baseContents);
+    }
+
+    // An edit that is never saved.
+    project.getNode(addedId)->setTitle(QStringLiteral("Unsaved"));
+    project.notifyNodeChanged(addedId);
+    assert(journal.hasUncommittedRecords());
+    journal.close();
+
+    // Below the compaction threshold, closing leaves the project file alone.
+    {
+        QFile file(fileName);
+        assert(file.open(QIODevice::ReadOnly));
+        assert(file.readAll() == baseContents);
+    }
+
+    Project reloaded;
+    assert(reloaded.loadFromFile(fileName));
+    ProjectJournal reloadedJournal(&reloaded);
+    assert(reloadedJournal.open(fileName));
+    assert(reloaded.nodes().size() == 2);
+    assert(reloaded.getNode(keptId)->title() == QStringLiteral("Edited"));
+    assert(!reloaded.getNode(removedId));
+    assert(reloaded.getNode(addedId)->title() == QStringLiteral("New Node"));
+    assert(reloaded.incomingChoices(addedId).size() == 1);
+
+    assert(reloadedJournal.hasUncommittedRecords());
+    reloadedJournal.recoverUncommitted();
+    assert(reloaded.getNode(addedId)->title() == QStringLiteral("Unsaved"));
+}
+
+void testJournalCompactsIntoProjectFile()
+{
+    QTemporaryDir dir;
+    assert(dir.isValid());
+    const QString fileName = dir.filePath(QStringLiteral("story.json"));
+
+    Project project;
+    StoryNode *node = project.addNode(StoryNode::Type::Dialogue);
+    const ObjectId nodeId = node->id();
+    assert(project.saveToFile(fileName));
+
+    ProjectJournal journal(&project);
+    assert(journal.create(fileName));
+    journal.setCompactionThreshold(0);
+    node->setScript(QStringLiteral("compacted"));
+    project.notifyNodeChanged(nodeId);
+    assert(journal.commit());
+    journal.waitForCompaction();
+    assert(journal.errorString().isEmpty());
+
+    // The project file alone now carries the edit, and the journal still
+    // matches it.
+    Project plain;
+    assert(plain.loadFromFile(fileName));
+    assert(plain.getNode(nodeId)->script() == QStringLiteral("compacted"));
+    journal.close();
+
+    Project reloaded;
+    assert(reloaded.loadFromFile(fileName));
+    ProjectJournal reloadedJournal(&reloaded);
+    assert(reloadedJournal.open(fileName));
+    assert(!reloadedJournal.hasUncommittedRecords());
+    assert(reloaded.getNode(nodeId)->script() == QStringLiteral("compacted"));
+}
+
+void testJournalSurvivesCrashDuringCompaction()
+{
+    QTemporaryDir dir;
+    assert(dir.isValid());
+    const QString fileName = dir.filePath(QStringLiteral("story.json"));
+    const QString journalName = ProjectJournal::journalFileName(fileName);
+    const auto readFile = [](const QString &name) {
+        QFile file(name);
+        assert(file.open(QIODevice::ReadOnly));
+        return file.readAll();
+    };
+    const auto writeFile = [](const QString &name, const QByteArray &contents) {
+        QFile file(name);
+        assert(file.open(QIODevice::WriteOnly | QIODevice::Truncate));
+        assert(file.write(contents) == contents.size());
+    };
+
+    Project project;
+    StoryNode *node = project.addNode(StoryNode::Type::Dialogue);
+    const ObjectId nodeId = node->id();
+    assert(project.saveToFile(fileName));
+    ProjectJournal journal(&project);
+    assert(journal.create(fileName));
+    journal.setCompactionThreshold(0);
+    node->setTitle(QStringLiteral("Compacted"));
+    project.notifyNodeChanged(nodeId);
+    assert(journal.commit());
+    // Saved while the project file is being rewritten.
+    node->setTitle(QStringLiteral("During"));
+    project.notifyNodeChanged(nodeId);
+    assert(journal.commit());
+    const QByteArray journalBeforeRewrite = readFile(journalName);
+    journal.waitForCompaction();
+    const QByteArray compactedProject = readFile(fileName);
+    journal.close();
+
+    // A crash after the project file was replaced but before the journal
+    // header was: the journal no longer matches, but is still applied.
+    writeFile(fileName, compactedProject);
+    writeFile(journalName, journalBeforeRewrite);
+    Project reloaded;
+    assert(reloaded.loadFromFile(fileName));
+    ProjectJournal reloadedJournal(&reloaded);
+    assert(reloadedJournal.open(fileName));
+    assert(!reloadedJournal.hasUncommittedRecords());
+    assert(reloaded.getNode(nodeId)->title() == QStringLiteral("During"));
+    reloadedJournal.close();
+
+    // The header now describes the project file as it is.
+    Project again;
+    assert(again.loadFromFile(fileName));
+    ProjectJournal againJournal(&again);
+    assert(againJournal.open(fileName));
+    assert(again.getNode(nodeId)->title() == QStringLiteral("During"));
+}
+
+void testJournalRecordsOnlyChangedFields()
+{
+    QTemporaryDir dir;
+    assert(dir.isValid());
+    const QString fileName = dir.filePath(QStringLiteral("story.json"));
+    const QString journalName = ProjectJournal::journalFileName(fileName);
+    const auto readFile = [](const QString &name) {
+        QFile file(name);
+        assert(file.open(QIODevice::ReadOnly));
+        return file.readAll();
+    };
+    const auto writeFile = [](const QString &name, const QByteArray &contents) {
+        QFile file(name);
+        assert(file.open(QIODevice::WriteOnly | QIODevice::Truncate));
+        assert(file.write(contents) == contents.size());
+    };
+
+    const QString script = QStringLiteral("e \"line\"\n").repeated(2000);
+    Project project;
+    StoryNode *node = project.addNode(StoryNode::Type::Dialogue);
+    const ObjectId nodeId = node->id();
+    node->setScript(script);
+    assert(project.saveToFile(fileName));
+    ProjectJournal journal(&project);
+    assert(journal.create(fileName));
+    journal.setCompactionThreshold(0);
+
+    // Typing one character appends about that much, not the whole script.
+    const qint64 sizeBefore = QFileInfo(journalName).size();
+    node->setScript(script + QStringLiteral("!"));
+    project.notifyNodeChanged(nodeId);
+    node->setPosition(QPointF(40.0, 20.0));
+    project.notifyNodeChanged(nodeId);
+    assert(QFileInfo(journalName).size() - sizeBefore < 200);
+
+    assert(journal.commit());
+    const QByteArray journalBeforeRewrite = readFile(journalName);
+    journal.waitForCompaction();
+    const QByteArray compactedProject = readFile(fileName);
+    journal.close();
+
+    // Replayed over a project file that already holds them, the edits are
+    // not applied a second time.
+    writeFile(fileName, compactedProject);
+    writeFile(journalName, journalBeforeRewrite);
+    Project reloaded;
+    assert(reloaded.loadFromFile(fileName));
+    ProjectJournal reloadedJournal(&reloaded);
+    assert(reloadedJournal.open(fileName));
+    assert(reloaded.getNode(nodeId)->script() == script + QStringLiteral("!"));
+    assert(reloaded.getNode(nodeId)->position() == QPointF(40.0, 20.0));
+
+    // Recovered on the file they were made on, they are.
+    Project original;
+    StoryNode *originalNode = original.addNode(StoryNode::Type::Dialogue);
+    originalNode->setScript(script);
+    const QString originalName = dir.filePath(QStringLiteral("original.json"));
+    assert(original.saveToFile(originalName));
+    ProjectJournal originalJournal(&original);
+    assert(originalJournal.create(originalName));
+    originalNode->setScript(QStringLiteral("e \"first\"\n") + script);
+    original.notifyNodeChanged(originalNode->id());
+    originalNode->setTitle(QStringLiteral("Edited"));
+    original.notifyNodeChanged(originalNode->id());
+    originalJournal.close();
+
+    Project replayed;
+    assert(replayed.loadFromFile(originalName));
+    ProjectJournal replayedJournal(&replayed);
+    assert(replayedJournal.open(originalName));
+    assert(replayed.getNode(originalNode->id())->script() == script);
+    replayedJournal.recoverUncommitted();
+    assert(replayed.getNode(originalNode->id())->script() == QStringLiteral("e \"first\"\n") + script);
+    assert(replayed.getNode(originalNode->id())->title() == QStringLiteral("Edited"));
+}
+
+void testAutoSaverRotatesBackups()
+{
+    QTemporaryDir dir;
+    assert(dir.isValid());
+    const QString fileName = dir.filePath(QStringLiteral("story.json"));
+    assert(ProjectAutoSaver::backupFileName(fileName) == dir.filePath(QStringLiteral("story.autosave.json")));
+    assert(ProjectAutoSaver::backupFileName(fileName, 2) == dir.filePath(QStringLiteral("story.autosave.2.json")));
+
+    Project project;
+    ProjectAutoSaver autoSaver(&project);
+    autoSaver.setBackupCount(2);
+    autoSaver.setProjectFileName(fileName);
+    assert(!autoSaver.saveNow());
+
+    StoryNode *node = project.addNode(StoryNode::Type::Dialogue);
+    const ObjectId nodeId = node->id();
+    for (const QString &title : {QStringLiteral("first"), QStringLiteral("second"), QStringLiteral("third")}) {
+        node->setTitle(title);
+        project.notifyNodeChanged(nodeId);
+        assert(autoSaver.saveNow());
+        // The snapshot is taken up front; later edits do not leak into it.
+        node->setTitle(QStringLiteral("pending"));
+        autoSaver.waitForSave();
+        node->setTitle(title);
+        assert(!autoSaver.saveNow());
+    }
+
+    Project newest;
+    assert(newest.loadFromFile(ProjectAutoSaver::backupFileName(fileName)));
+    assert(newest.getNode(nodeId)->title() == QStringLiteral("third"));
+    Project older;
+    assert(older.loadFromFile(ProjectAutoSaver::backupFileName(fileName, 1)));
+    assert(older.getNode(nodeId)->title() == QStringLiteral("second"));
+    assert(!QFile::exists(ProjectAutoSaver::backupFileName(fileName, 2)));
+    assert(!QFile::exists(ProjectAutoSaver::backupFileName(fileName, -1)));
+    assert(!QFile::exists(fileName));
+}
+
+void testSnapshotsShareUnchangedNodes()
+{
+    Project project;
+    StoryNode *a = project.addNode(StoryNode::Type::Dialogue);
+    StoryNode *b = project.addNode(StoryNode::Type::Dialogue);
+    const ObjectId aId = a->id();
+    const ObjectId bId = b->id();
+    a->setTitle(QStringLiteral("before"));
+    project.notifyNodeChanged(aId);
+
+    const ProjectSnapshot first = project.snapshot();
+    assert(first.version() == project.version());
+    assert(first.size() == 2);
+    assert(first.node(aId) != a);
+    assert(first.node(aId)->title() == QStringLiteral("before"));
+
+    // Unreported edits are not visible; reported ones are, without touching
+    // the earlier snapshot.
+    a->setTitle(QStringLiteral("after"));
+    assert(project.snapshot().node(aId)->title() == QStringLiteral("before"));
+    project.notifyNodeChanged(aId);
+    const ObjectId cId = project.addNode(StoryNode::Type::End)->id();
+    project.removeNode(bId);
+
+    const ProjectSnapshot second = project.snapshot();
+    assert(second.version() > first.version());
+    assert(first.node(aId)->title() == QStringLiteral("before"));
+    assert(second.node(aId)->title() == QStringLiteral("after"));
+    assert(first.node(bId));
+    assert(!second.node(bId));
+    assert(!first.node(cId));
+    assert(second.node(cId));
+
+    const ProjectSnapshot third = project.snapshot();
+    assert(third.node(aId) == second.node(aId));
+    assert(third.node(cId) == second.node(cId));
+
+    // A load builds the snapshot map as it adopts the nodes, so the first
+    // snapshot after it copies nothing and, like any other, shows the state
+    // of the last change set.
+    StoryNodeMap adopted;
+    adopted.insert(aId, std::make_shared<StoryNode>(*project.getNode(aId)));
+    Project reloaded;
+    reloaded.adoptNodes(adopted);
+    reloaded.getNode(aId)->setTitle(QStringLiteral("unreported"));
+    const ProjectSnapshot loaded = reloaded.snapshot();
+    assert(loaded.version() == reloaded.version());
+    assert(loaded.size() == 1);
+    assert(loaded.node(aId)->title() == QStringLiteral("after"));
+    // Adopting inside a batch leaves the map to snapshot(), as later edits
+    // in the batch would make it stale.
+    {
+        ProjectBatch batch(&reloaded);
+        reloaded.adoptNodes(adopted);
+        reloaded.getNode(aId)->setTitle(QStringLiteral("in batch"));
+    }
+    assert(reloaded.snapshot().node(aId)->title() == QStringLiteral("in batch"));
+
+    // With an earlier snapshot alive, an edit copies one chunk of the node
+    // map rather than the whole map.
+    Project large;
+    QList<ObjectId> ids;
+    {
+        ProjectBatch batch(&large);
+        for (int i = 0; i < 5000; ++i) {
+            ids.append(large.addNode(StoryNode::Type::Dialogue)->id());
+        }
+    }
+    const ProjectSnapshot before = large.snapshot();
+    large.getNode(ids[1234])->setTitle(QStringLiteral("edited"));
+    large.notifyNodeChanged(ids[1234]);
+    const ProjectSnapshot after = large.snapshot();
+    assert(before.nodes().chunkCount() > 1);
+    assert(after.nodes().sharedChunkCount(before.nodes()) == before.nodes().chunkCount() - 1);
+    assert(before.node(ids[1234])->title() != after.node(ids[1234])->title());
+
+    // Chunks split and disappear as nodes come and go, keeping id order.
+    QSet<ObjectId> removed;
+    for (qsizetype i = 0; i < ids.size(); i += 2) {
+        removed.insert(ids[i]);
+    }
+    large.removeNodes(removed);
+    {
+        ProjectBatch batch(&large);
+        for (int i = 0; i < 3000; ++i) {
+            large.addNode(StoryNode::Type::End);
+        }
+    }
+    const ProjectSnapshot reshaped = large.snapshot();
+    assert(reshaped.size() == large.nodes().size());
+    assert(!reshaped.node(ids[0]));
+    assert(reshaped.node(ids[1]));
+    qsizetype count = 0;
+    const ObjectId *previous = nullptr;
+    for (auto it = reshaped.nodes().cbegin(); it != reshaped.nodes().cend(); ++it) {
+        assert(!previous || *previous < it.key());
+        assert(it.value()->id() == it.key());
+        previous = &it.key();
+        ++count;
+    }
+    assert(count == reshaped.size());
+    assert(before.size() == 5000);
+}
+
+void testHistoryUndoesBulkDeleteInOneStep()
+{
+    Project project;
+    QSet<ObjectId> ids;
+    ObjectId hubId;
+    {
+        ProjectBatch batch(&project);
+        StoryNode *hub = project.addNode(StoryNode::Type::Menu);
+        hubId = hub->id();
+        for (int i = 0; i < 5000; ++i) {
+            StoryNode *node = project.addNode(StoryNode::Type::Dialogue);
+            node->setScript(QStringLiteral("line %1").arg(i));
+            ids.insert(node->id());
+            project.addChoice(hubId, makeChoice(node->id()));
+        }
+    }
+    ProjectHistory history(&project);
+    assert(!history.canUndo());
+
+    project.removeNodes(ids);
+    assert(project.nodes().size() == 1);
+    assert(project.getNode(hubId)->choices().isEmpty());
+    assert(history.count() == 1);
+
+    int commits = 0;
+    QObject::connect(&project, &Project::changesCommitted, [&](const ProjectChangeSet &) { ++commits; });
+    history.undo();
+    assert(commits == 1);
+    assert(project.nodes().size() == 5001);
+    assert(project.getNode(hubId)->choices().size() == 5000);
+    const ObjectId someId = *ids.cbegin();
+    assert(project.incomingChoices(someId).size() == 1);
+    assert(project.getNode(someId)->script().startsWith(QStringLiteral("line ")));
+
+    history.redo();
+    assert(commits == 2);
+    assert(project.nodes().size() == 1);
+    assert(project.incomingChoices(someId).isEmpty());
+    assert(!history.canRedo());
+}
+
+void testHistoryMergesScriptEditsAsDeltas()
+{
+    Project project;
+    StoryNode *node = project.addNode(StoryNode::Type::Dialogue);
+    const ObjectId nodeId = node->id();
+    const QString original = QString(QStringLiteral("x")).repeated(100000);
+    node->setScript(original);
+    project.notifyNodeChanged(nodeId);
+
+    ProjectHistory history(&project);
+    history.setMergeInterval(60 * 1000);
+    QString typed = original;
+    for (const QChar ch : QStringLiteral("hello")) {
+        typed.insert(50000, ch);
+        node->setScript(typed);
+        project.notifyNodeChanged(nodeId);
+    }
+    assert(history.count() == 1);
+    assert(history.memoryUsage() < 4096);
+
+    history.closeStep();
+    node->setTitle(QStringLiteral("Renamed"));
+    project.notifyNodeChanged(nodeId);
+    node->setPosition(QPointF(10, 20));
+    project.notifyNodeChanged(nodeId);
+    assert(history.count() == 3);
+
+    history.undo();
+    history.undo();
+    assert(node->title() == QStringLiteral("New Node"));
+    assert(node->script() == typed);
+    history.undo();
+    assert(node->script() == original);
+    history.redo();
+    assert(node->script() == typed);
+
+    // A new edit drops the steps that were undone.
+    node->setTitle(QStringLiteral("Other"));
+    project.notifyNodeChanged(nodeId);
+    assert(history.count() == 2);
+    assert(!history.canRedo());
+
+    history.setMemoryLimit(0);
+    assert(history.count() == 1);
+    assert(history.canUndo());
+}
+
+int main()
+{
+    testObjectIdsKeepTheirText();
+    testNodeStoreReusesSlotsWithNewGeneration();
+    testRichTextScriptsRoundTrip();
+    testLegacyHtmlBecomesRenpyTags();
+    testStoryGraphWalksWithoutRecursion();
+    testParallelExportMatchesSingleThread();
+    testExportReusesUnchangedFragments();
+    testChapterExportRewritesOnlyChangedFiles();
+    testExportBackendsShareOneIr();
+    testCompiledStoryPlaysTheGraph();
+    testIncomingChoicesTracksEdges();
+    testRemoveNodeStripsIncomingChoices();
+    testBatchCoalescesNotifications();
+    testTypedSignalsReportRemovalsFirst();
+    testLoadFromFileStreamsNodes();
+    testSaveToFileMatchesQJsonDocument();
+    testBinaryFormatRoundTrip();
+    testBinaryFormatReportsCorruptSection();
+    testBinaryLoadDecodesScriptsLazily();
+    testBinaryLoadFlagsDamagedScripts();
+    testJournalRecordsEditsWithoutRewritingProject();
+    testJournalCompactsIntoProjectFile();
+    testJournalSurvivesCrashDuringCompaction();
+    testJournalRecordsOnlyChangedFields();
+    testAutoSaverRotatesBackups();
+    testSnapshotsShareUnchangedNodes();
+    testHistoryUndoesBulkDeleteInOneStep();
+    testHistoryMergesScriptEditsAsDeltas();
+
+    return 0;
+}